@@ -6,6 +6,17 @@ var webrtc = (function(parent, global) {
   let mReportError;
   let mSendDataChannel;
   let mRecvDataChannelCallback;
+  let mRpcNextRequestId = 1;
+  let mRpcPendingCalls = new Map();
+
+  // RPC のフレームの種類 (gst-rpc-codec.h と同じ値)
+  const RPC_FRAME_REQUEST = 0;
+  const RPC_FRAME_RESPONSE = 1;
+  const RPC_FRAME_ERROR = 2;
+  const RPC_FRAME_FLAG_COMPRESSED = 0x80;
+
+  // RPC のメソッド ID (gst-webrtc-main.h と同じ値)
+  const RPC_METHOD_SET_AUDIO = 3;
 
   /**
    * SDP の設定を接続先に送り返す。
@@ -61,9 +72,13 @@ var webrtc = (function(parent, global) {
       return;
     }
     // console.log("Sending ICE candidate out: " + JSON.stringify(event.candidate));
+    // 受信側が使うのは candidate と sdpMLineIndex だけなので、それ以外は送らない
     mWebsocketConnection.send(JSON.stringify({
       'type': 'ice', 
-      'data': event.candidate
+      'data': {
+        'candidate': event.candidate.candidate,
+        'sdpMLineIndex': event.candidate.sdpMLineIndex
+      }
     }));
   }
 
@@ -92,6 +107,9 @@ var webrtc = (function(parent, global) {
         case 'ice':
           onIncomingICE(msg.data);
           break;
+        case 'admission':
+          onAdmission(msg.data);
+          break;
         default:
           console.log('unknown type. type=' + msg.type);
           break;
@@ -99,6 +117,20 @@ var webrtc = (function(parent, global) {
     }
   }
 
+  /**
+   * 配信側がセッションを受け入れるかを判定した場合に呼び出される。
+   * 
+   * reject の場合は配信されないので、エラーとして通知する。
+   * 
+   * @param {*} admission { decision: 'accept' | 'degrade' | 'reject', reason }
+   */
+  function onAdmission(admission) {
+    console.log('admission: ' + admission.decision + (admission.reason ? ' (' + admission.reason + ')' : ''));
+    if (admission.decision === 'reject') {
+      mReportError('The sender is busy (' + admission.reason + ').');
+    }
+  }
+
   /**
    * WebRTC の状態が変更された時の呼び出される。
    * 
@@ -128,6 +160,89 @@ var webrtc = (function(parent, global) {
     mHtml5VideoElement.srcObject = event.streams[0];
   } 
 
+  /**
+   * varint を書き込む。
+   * 
+   * @param {*} out 書き込む先の配列
+   * @param {*} value 書き込む値 (Number.MAX_SAFE_INTEGER まで)
+   */
+  function writeVarint(out, value) {
+    while (value >= 0x80) {
+      out.push((value % 0x80) | 0x80);
+      value = Math.floor(value / 0x80);
+    }
+    out.push(value);
+  }
+
+  /**
+   * varint を読み込む。
+   * 
+   * @param {*} bytes 読み込む Uint8Array
+   * @param {*} pos 読み込む位置を持つオブジェクト { offset }
+   * @returns 読み込んだ値、データが途中で切れている場合は undefined
+   */
+  function readVarint(bytes, pos) {
+    let value = 0;
+    let scale = 1;
+    while (pos.offset < bytes.length) {
+      let b = bytes[pos.offset++];
+      value += (b & 0x7F) * scale;
+      if ((b & 0x80) == 0) {
+        return value;
+      }
+      scale *= 0x80;
+    }
+    return undefined;
+  }
+
+  /**
+   * raw deflate で圧縮されたペイロードを展開する。
+   * 
+   * @param {*} payload 
+   * @returns 展開したデータの Promise
+   */
+  function inflateRaw(payload) {
+    let stream = new Blob([payload]).stream().pipeThrough(new DecompressionStream('deflate-raw'));
+    return new Response(stream).arrayBuffer().then((buffer) => new Uint8Array(buffer));
+  }
+
+  /**
+   * データチャンネルで受信した RPC のメッセージを処理する。
+   * 
+   * 1 つのメッセージに複数のレスポンスが入っている場合がある。
+   * 
+   * @param {*} buffer 
+   */
+  function onRpcMessage(buffer) {
+    let bytes = new Uint8Array(buffer);
+    let pos = { offset: 0 };
+    while (pos.offset < bytes.length) {
+      let type = bytes[pos.offset++];
+      let requestId = readVarint(bytes, pos);
+      let code = readVarint(bytes, pos);
+      let length = readVarint(bytes, pos);
+      if (length === undefined || pos.offset + length > bytes.length) {
+        console.log('invalid rpc message');
+        return;
+      }
+      let payload = bytes.subarray(pos.offset, pos.offset + length);
+      pos.offset += length;
+
+      let call = mRpcPendingCalls.get(requestId);
+      if (!call || (type & 0x0F) == RPC_FRAME_REQUEST) {
+        continue;
+      }
+      mRpcPendingCalls.delete(requestId);
+
+      let result = (type & RPC_FRAME_FLAG_COMPRESSED) ? inflateRaw(payload) : Promise.resolve(payload);
+      if ((type & 0x0F) == RPC_FRAME_RESPONSE) {
+        result.then(call.resolve, call.reject);
+      } else {
+        result.then((detail) => call.reject({ 'status': code, 'detail': detail }), call.reject);
+      }
+    }
+  }
+
   /**
    * 接続先からデータチャンネルの追加要求があった場合に呼び出される。
    * 
@@ -135,11 +250,17 @@ var webrtc = (function(parent, global) {
    */
   function onDataChannel(event) {
     let receiveChannel = event.channel;
+    receiveChannel.binaryType = 'arraybuffer';
     receiveChannel.onopen = function (event) {
       console.log('datachannel::onopen', event);
     }
 
     receiveChannel.onmessage = function (event) {
+      if (event.data instanceof ArrayBuffer) {
+        onRpcMessage(event.data);
+        return;
+      }
+
       console.log('datachannel::onmessage:', event.data);
 
       if (mRecvDataChannelCallback) {
@@ -197,6 +318,9 @@ var webrtc = (function(parent, global) {
       mWebrtcPeerConnection.close();
       mWebrtcPeerConnection = null;
     }
+
+    mRpcPendingCalls.forEach((call) => call.reject({ 'status': 3, 'detail': null }));
+    mRpcPendingCalls.clear();
   }
 
   /**
@@ -276,5 +400,49 @@ var webrtc = (function(parent, global) {
   }
   parent.sendDataChannel = sendDataChannel;
 
+  /**
+   * データチャンネルで RPC のリクエストを送信する。
+   * 
+   * レスポンスを待たずに続けて呼び出すことができる。
+   * 
+   * @param {*} methodId メソッド ID
+   * @param {*} payload リクエストのペイロード (文字列または Uint8Array)
+   * @returns レスポンスのペイロード (Uint8Array) の Promise、エラーの場合は { status, detail } で reject する
+   */
+  function callRpc(methodId, payload) {
+    if (!mSendDataChannel || mSendDataChannel.readyState !== 'open') {
+      return Promise.reject({ 'status': 3, 'detail': null });
+    }
+
+    let body = (typeof payload === 'string') ? new TextEncoder().encode(payload) : (payload || new Uint8Array(0));
+    let requestId = mRpcNextRequestId++;
+    let header = [RPC_FRAME_REQUEST];
+    writeVarint(header, requestId);
+    writeVarint(header, methodId);
+    writeVarint(header, body.length);
+
+    let frame = new Uint8Array(header.length + body.length);
+    frame.set(header, 0);
+    frame.set(body, header.length);
+
+    return new Promise(function(resolve, reject) {
+      mRpcPendingCalls.set(requestId, { 'resolve': resolve, 'reject': reject });
+      mSendDataChannel.send(frame);
+    });
+  }
+  parent.callRpc = callRpc;
+
+  /**
+   * 配信側の音声のトラックを追加・削除する。
+   * 
+   * 配信側が --audio-on-demand で起動している場合のみ使用できる。接続はそのままで再ネゴシエーションが行われる。
+   * 
+   * @param {*} enabled 音声を受信する場合は true
+   */
+  function setAudioEnabled(enabled) {
+    return callRpc(RPC_METHOD_SET_AUDIO, enabled ? '1' : '0');
+  }
+  parent.setAudioEnabled = setAudioEnabled;
+
   return parent;
 })(webrtc || {}, this.self || global);
@@ -8,7 +8,9 @@ let index = 0
 
 const express = require('express')
 const app = express()
-const expressWs = require('express-ws')(app);
+// PER_MESSAGE_DEFLATE=1 の場合は、permessage-deflate を要求してきたクライアントとは圧縮して送受信する
+const perMessageDeflate = process.env.PER_MESSAGE_DEFLATE === '1'
+const expressWs = require('express-ws')(app, null, { wsOptions: { perMessageDeflate: perMessageDeflate } });
 
 app.ws('/', function(ws, req) {  
   let connectionId = 'conn_' + (index++)
@@ -16,15 +18,39 @@ app.ws('/', function(ws, req) {
 
   console.log('ws connect...');
 
+  // 指定されたコネクションにメッセージを送信
+  // サブプロトコル targeted で接続されている場合には、送信元の ID を付けて送信する
+  function _deliver(key, message) {
+    let _ws = connections[key]
+    if (_ws) {
+      if (_ws.protocol === 'targeted') {
+        _ws.send(JSON.stringify({ 'from': connectionId, 'payload': message.toString() }))
+      } else {
+        _ws.send(message)
+      }
+    }
+  }
+
+  // targeted で接続しているコネクションがあるか
+  function _hasTargeted() {
+    for (let key in connections) {
+      if (key != connectionId && connections[key].protocol === 'targeted') {
+        return true
+      }
+    }
+    return false
+  }
+
   // 自分以外の全員にメッセージを送信
+  // targeted でないコネクション (ブラウザ) からのメッセージは、他のブラウザには送らずに targeted のコネクションにだけ送る
+  // 他の視聴者の answer や ICE の候補が届くと、ブラウザは自分の RTCPeerConnection に設定してしまうため
+  // targeted のコネクションがない場合は、これまで通り全員に送信する
   function _send(message) {
+    let targetedOnly = ws.protocol !== 'targeted' && _hasTargeted()
     for (let key in connections) {
-      if (key != connectionId) {
+      if (key != connectionId && (!targetedOnly || connections[key].protocol === 'targeted')) {
         try {
-          let _ws = connections[key]
-          if (_ws) {
-            _ws.send(message)
-          }
+          _deliver(key, message)
         } catch (e) {
           console.log('websocket.send() error.', e)
         }
@@ -33,15 +59,41 @@ app.ws('/', function(ws, req) {
   }
 
   ws.on('message', function(message) {
+    // サブプロトコル targeted で接続されている場合は、宛先が指定されたメッセージを宛先にだけ送信
+    if (ws.protocol === 'targeted') {
+      let msg
+      try {
+        msg = JSON.parse(message)
+      } catch (e) {
+      }
+      if (msg && msg.to !== undefined) {
+        if (connections[msg.to]) {
+          try {
+            _deliver(msg.to, msg.payload)
+          } catch (e) {
+            console.log('websocket.send() error.', e)
+          }
+        }
+        return
+      }
+    }
     _send(message)
   });
 
+  // targeted で接続しているのは配信側のプロセスなので、視聴者としては通知しない
+  // --takeover で起動した後継のプロセスが、前のプロセスに視聴者として扱われないようにする
+  let isPlayer = ws.protocol !== 'targeted'
+
   ws.on('close', function() {
-    _send("playerDisconnected")
+    if (isPlayer) {
+      _send("playerDisconnected")
+    }
     delete connections[connectionId]
   });
 
-  _send("playerConnected")
+  if (isPlayer) {
+    _send("playerConnected")
+  }
 });
 
 app.use(express.static(htmlDir))
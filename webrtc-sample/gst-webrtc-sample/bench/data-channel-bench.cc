@@ -0,0 +1,270 @@
+/**
+ * データチャンネルのスループットと遅延のベンチマーク。
+ *
+ * 同一プロセス内でデータチャンネルだけの WebRTCPipeline (送信側) と webrtcbin (受信側) を接続し、
+ * WebRTCPipeline::sendMessage で送信したメッセージが受信側の WebRTCDataChannel に届くまでを計測します。
+ * メッセージには送信時刻を入れておき、受信時刻との差を遅延とします。
+ * 送信済みで未受信のメッセージがウィンドウ数を超えないように送信します。
+ *
+ * 使い方: data-channel-bench [メッセージ数] [メッセージサイズ (バイト)] [ウィンドウ数]
+ */
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <gst/gst.h>
+#include <gst/sdp/sdp.h>
+#define GST_USE_UNSTABLE_API
+#include <gst/webrtc/webrtc.h>
+
+#include "gst-webrtc-data-channel.h"
+#include "gst-webrtc-pipeline.h"
+
+// 接続や受信が進まない場合に諦めるまでの時間 (秒)
+#define STALL_TIMEOUT 10
+
+class DataChannelBench : public WebRTCPipelineListener, public WebRTCDataChannelListener {
+private:
+  GMainLoop *mLoop;
+  WebRTCPipeline mSender;
+  GstElement *mPipeline;
+  GstElement *mWebRTCBin;
+  WebRTCDataChannel mReceiver;
+
+  int mTotal;
+  int mSize;
+  int mWindow;
+  std::atomic<int> mSent;
+  std::atomic<int> mReceived;
+  std::atomic<bool> mConnected;
+  int mLastReceived;
+  gint64 mStartTime;
+  gint64 mEndTime;
+  guint mSendTimerId;
+
+  std::mutex mMutex;
+  std::vector<gint64> mLatencies;
+
+  static void onAnswerCreated(GstPromise *promise, gpointer userData) {
+    DataChannelBench *self = (DataChannelBench *) userData;
+    GstWebRTCSessionDescription *answer = NULL;
+    const GstStructure *reply = gst_promise_get_reply(promise);
+    gst_structure_get(reply, "answer", GST_TYPE_WEBRTC_SESSION_DESCRIPTION, &answer, NULL);
+    gst_promise_unref(promise);
+    if (!answer) {
+      g_printerr("Failed to create an answer.\n");
+      return;
+    }
+
+    g_signal_emit_by_name(self->mWebRTCBin, "set-local-description", answer, NULL);
+    gchar *text = gst_sdp_message_as_text(answer->sdp);
+    self->mSender.onAnswerReceived(text);
+    g_free(text);
+    gst_webrtc_session_description_free(answer);
+  }
+
+  static void onIceCandidate(GstElement *webrtcbin, guint mlineIndex, gchar *candidate, gpointer userData) {
+    DataChannelBench *self = (DataChannelBench *) userData;
+    self->mSender.onIceReceived(mlineIndex, candidate);
+  }
+
+  static void onDataChannel(GstElement *webrtcbin, GObject *dataChannel, gpointer userData) {
+    DataChannelBench *self = (DataChannelBench *) userData;
+    self->mReceiver.setListener(self);
+    self->mReceiver.connect((GstWebRTCDataChannel *) dataChannel);
+  }
+
+  static gboolean onSendTimer(gpointer userData) {
+    DataChannelBench *self = (DataChannelBench *) userData;
+    std::string padding(self->mSize, 'x');
+    while (self->mSent < self->mTotal && self->mSent - self->mReceived < self->mWindow) {
+      gchar header[64];
+      int length = g_snprintf(header, sizeof(header), "%d:%" G_GINT64_FORMAT ":", self->mSent.load(), g_get_monotonic_time());
+      std::string message(header);
+      if ((int) message.size() < self->mSize) {
+        message.append(padding, 0, self->mSize - length);
+      }
+      self->mSender.sendMessage(message);
+      self->mSent++;
+    }
+    if (self->mSent < self->mTotal) {
+      return G_SOURCE_CONTINUE;
+    }
+    self->mSendTimerId = 0;
+    return G_SOURCE_REMOVE;
+  }
+
+  static gboolean onStartSending(gpointer userData) {
+    DataChannelBench *self = (DataChannelBench *) userData;
+    self->mStartTime = g_get_monotonic_time();
+    self->mSendTimerId = g_timeout_add(1, DataChannelBench::onSendTimer, self);
+    return G_SOURCE_REMOVE;
+  }
+
+  static gboolean onWatchdog(gpointer userData) {
+    DataChannelBench *self = (DataChannelBench *) userData;
+    if (!self->mConnected || self->mReceived == self->mLastReceived) {
+      g_main_loop_quit(self->mLoop);
+      return G_SOURCE_REMOVE;
+    }
+    self->mLastReceived = self->mReceived;
+    return G_SOURCE_CONTINUE;
+  }
+
+  static gboolean onQuit(gpointer userData) {
+    g_main_loop_quit((GMainLoop *) userData);
+    return G_SOURCE_REMOVE;
+  }
+
+public:
+  DataChannelBench(int total, int size, int window) {
+    mLoop = g_main_loop_new(NULL, FALSE);
+    mPipeline = nullptr;
+    mWebRTCBin = nullptr;
+    mTotal = total;
+    mSize = size;
+    mWindow = window;
+    mSent = 0;
+    mReceived = 0;
+    mConnected = false;
+    mLastReceived = -1;
+    mStartTime = 0;
+    mEndTime = 0;
+    mSendTimerId = 0;
+  }
+
+  virtual ~DataChannelBench() {
+    if (mSendTimerId) {
+      g_source_remove(mSendTimerId);
+    }
+    mSender.stopPipeline();
+    mReceiver.disconnect();
+    if (mWebRTCBin) {
+      gst_object_unref(mWebRTCBin);
+    }
+    if (mPipeline) {
+      gst_element_set_state(mPipeline, GST_STATE_NULL);
+      gst_object_unref(mPipeline);
+    }
+    g_main_loop_unref(mLoop);
+  }
+
+  bool run() {
+    // 受信側
+    GError *error = NULL;
+    mPipeline = gst_parse_launch("webrtcbin name=receiver bundle-policy=max-bundle", &error);
+    if (error) {
+      g_printerr("Failed to parse launch: %s.\n", error->message);
+      g_error_free(error);
+      return false;
+    }
+    mWebRTCBin = gst_bin_get_by_name(GST_BIN(mPipeline), "receiver");
+    g_signal_connect(mWebRTCBin, "on-ice-candidate", G_CALLBACK(DataChannelBench::onIceCandidate), this);
+    g_signal_connect(mWebRTCBin, "on-data-channel", G_CALLBACK(DataChannelBench::onDataChannel), this);
+    gst_element_set_state(mPipeline, GST_STATE_PLAYING);
+
+    // 送信側、映像と音声は流さない
+    std::string peerId("receiver");
+    std::string bin("webrtcbin name=webrtcbin bundle-policy=max-bundle");
+    mSender.setPeerId(peerId);
+    mSender.setListener(this);
+    mSender.setStatsInterval(0);
+    mSender.startPipeline(bin);
+
+    guint watchdogId = g_timeout_add_seconds(STALL_TIMEOUT, DataChannelBench::onWatchdog, this);
+    g_main_loop_run(mLoop);
+
+    if (!mConnected) {
+      g_printerr("Data channel did not open within %d seconds.\n", STALL_TIMEOUT);
+      return false;
+    }
+    if (mReceived == mTotal) {
+      g_source_remove(watchdogId);
+      return true;
+    }
+    g_printerr("No message received for %d seconds.\n", STALL_TIMEOUT);
+    return false;
+  }
+
+  void report() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    double seconds = (mEndTime - mStartTime) / 1e6;
+    printf("messages   %10d x %d bytes (window %d)\n", mTotal, mSize, mWindow);
+    printf("received   %10d\n", mReceived.load());
+    if (seconds <= 0 || mLatencies.empty()) {
+      return;
+    }
+    printf("throughput %10.0f msg/s %10.2f MB/s\n", mReceived / seconds, mReceived * (double) mSize / seconds / 1e6);
+
+    std::sort(mLatencies.begin(), mLatencies.end());
+    gint64 total = 0;
+    for (auto itr = mLatencies.begin(); itr != mLatencies.end(); ++itr) {
+      total += *itr;
+    }
+    printf("latency    avg %8.3f ms  p50 %8.3f ms  p99 %8.3f ms  max %8.3f ms\n",
+        total / 1e3 / mLatencies.size(),
+        mLatencies[mLatencies.size() / 2] / 1e3,
+        mLatencies[std::min(mLatencies.size() - 1, mLatencies.size() * 99 / 100)] / 1e3,
+        mLatencies.back() / 1e3);
+  }
+
+  // WebRTCPipelineListener implements.
+  virtual void onSendSdp(WebRTCPipeline *pipeline, gint type, gchar *sdpString) {
+    if (type != GST_WEBRTC_SDP_TYPE_OFFER) {
+      return;
+    }
+    GstSDPMessage *sdp = NULL;
+    gst_sdp_message_new(&sdp);
+    gst_sdp_message_parse_buffer((guint8 *) sdpString, strlen(sdpString), sdp);
+    GstWebRTCSessionDescription *offer = gst_webrtc_session_description_new(GST_WEBRTC_SDP_TYPE_OFFER, sdp);
+    g_signal_emit_by_name(mWebRTCBin, "set-remote-description", offer, NULL);
+    gst_webrtc_session_description_free(offer);
+
+    GstPromise *promise = gst_promise_new_with_change_func(DataChannelBench::onAnswerCreated, this, NULL);
+    g_signal_emit_by_name(mWebRTCBin, "create-answer", NULL, promise);
+  }
+
+  virtual void onSendIceCandidate(WebRTCPipeline *pipeline, guint mlineindex, gchar *candidate) {
+    g_signal_emit_by_name(mWebRTCBin, "add-ice-candidate", mlineindex, candidate);
+  }
+
+  virtual void onDataChannelConnected(WebRTCPipeline *pipeline) {
+    mConnected = true;
+    g_idle_add(DataChannelBench::onStartSending, this);
+  }
+
+  // WebRTCDataChannelListener implements.
+  virtual void onMessage(WebRTCDataChannel *channel, std::string& message) {
+    gint64 now = g_get_monotonic_time();
+    const gchar *timestamp = strchr(message.c_str(), ':');
+    if (!timestamp) {
+      return;
+    }
+    gint64 sentTime = g_ascii_strtoll(timestamp + 1, NULL, 10);
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    mLatencies.push_back(now - sentTime);
+    if (++mReceived == mTotal) {
+      mEndTime = now;
+      g_idle_add(DataChannelBench::onQuit, mLoop);
+    }
+  }
+};
+
+int main(int argc, char *argv[])
+{
+  int total = argc > 1 ? atoi(argv[1]) : 10000;
+  int size = argc > 2 ? atoi(argv[2]) : 256;
+  int window = argc > 3 ? atoi(argv[3]) : 64;
+
+  gst_init(&argc, &argv);
+
+  DataChannelBench bench(MAX(total, 1), MAX(size, 32), MAX(window, 1));
+  bool succeeded = bench.run();
+  bench.report();
+  return succeeded ? 0 : 1;
+}
@@ -0,0 +1,144 @@
+/**
+ * 1 セッションあたりのメモリ使用量の回帰ベンチマーク。
+ *
+ * LoopbackSignalingHub で視聴者を N 人接続して、配信用のパイプラインを N 個作成し、
+ * 作成前後の RSS と CountingAllocator で確保したバイト数の差分から 1 セッションあたりのメモリを求めます。
+ * 視聴者は answer を返さないので、ICE と SCTP の接続は含みません (webrtcbin, エンコーダ, queue まで)。
+ * 1 セッションあたりの RSS が予算を超えた場合は終了コード 1 で終了します。
+ *
+ * 使い方: memory-budget-bench [セッション数] [1 セッションあたりの予算 (KB)] [待ち時間 (秒)]
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+#include <gst/gst.h>
+
+#include "gst-counting-allocator.h"
+#include "gst-loopback-signaling.h"
+#include "gst-memory-accounting.h"
+#include "gst-webrtc-main.h"
+
+struct Snapshot {
+  gint64 residentBytes;
+  gint64 allocatedBytes;
+};
+
+static Snapshot takeSnapshot()
+{
+  Snapshot snapshot;
+  snapshot.residentBytes = MemoryAccounting::getResidentBytes();
+  snapshot.allocatedBytes = CountingAllocator::getLiveBytes();
+  return snapshot;
+}
+
+static gboolean onTimeout(gpointer userData)
+{
+  g_main_loop_quit((GMainLoop *) userData);
+  return G_SOURCE_REMOVE;
+}
+
+// パイプラインの起動や停止はメインループで行われるので、指定した時間だけメインループを回す
+static void runFor(GMainLoop *loop, guint seconds)
+{
+  g_timeout_add_seconds(seconds, onTimeout, loop);
+  g_main_loop_run(loop);
+}
+
+static void connectViewers(LoopbackSignalingHub *hub, std::vector<std::unique_ptr<LoopbackSignalingTransport>>& viewers, int count)
+{
+  std::string url;
+  std::string origin;
+  for (int i = 0; i < count; i++) {
+    std::string peerId = "viewer-" + std::to_string(viewers.size());
+    std::unique_ptr<LoopbackSignalingTransport> viewer(new LoopbackSignalingTransport(hub, peerId));
+    viewer->connectAsync(url, origin);
+    viewers.push_back(std::move(viewer));
+  }
+}
+
+static void disconnectViewers(std::vector<std::unique_ptr<LoopbackSignalingTransport>>& viewers)
+{
+  for (auto itr = viewers.begin(); itr != viewers.end(); ++itr) {
+    (*itr)->disconnect();
+  }
+  viewers.clear();
+}
+
+int main(int argc, char *argv[])
+{
+  int sessions = argc > 1 ? atoi(argv[1]) : 8;
+  gint64 budget = (argc > 2 ? atoll(argv[2]) : 32768) * 1024;
+  guint settle = argc > 3 ? (guint) atoi(argv[3]) : 3;
+  if (sessions <= 0) {
+    sessions = 1;
+  }
+
+  gst_init(&argc, &argv);
+  CountingAllocator::install();
+
+  GMainLoop *loop = g_main_loop_new(NULL, FALSE);
+
+  LoopbackSignalingHub hub;
+  hub.setTargetedRouting(true);
+
+  // 外部への通信と統計情報の取得は行わない
+  WebRTCConfig config;
+  config.stunServer.clear();
+  config.statsInterval = 0;
+
+  WebRTCMain main;
+  main.setConfig(config);
+
+  std::string senderId("sender");
+  std::string url;
+  std::string origin;
+  LoopbackSignalingTransport sender(&hub, senderId);
+  main.setTransport(&sender);
+  main.connectSignallingServer(url, origin);
+  runFor(loop, 1);
+
+  std::vector<std::unique_ptr<LoopbackSignalingTransport>> viewers;
+
+  // プラグインの読み込みやスレッドの作成など、初回だけ確保されるメモリを除くために 1 セッション流しておく
+  connectViewers(&hub, viewers, 1);
+  runFor(loop, settle);
+  disconnectViewers(viewers);
+  runFor(loop, 1);
+
+  Snapshot baseline = takeSnapshot();
+
+  connectViewers(&hub, viewers, sessions);
+  runFor(loop, settle);
+  Snapshot active = takeSnapshot();
+  size_t started = main.getSessionCount();
+
+  disconnectViewers(viewers);
+  runFor(loop, settle);
+  Snapshot stopped = takeSnapshot();
+
+  gint64 perSession = (active.residentBytes - baseline.residentBytes) / sessions;
+  gint64 perSessionAllocated = (active.allocatedBytes - baseline.allocatedBytes) / sessions;
+
+  printf("sessions            %10d (%zu started)\n", sessions, started);
+  printf("rss per session     %10lld KB\n", (long long) (perSession / 1024));
+  printf("gst mem per session %10lld KB\n", (long long) (perSessionAllocated / 1024));
+  printf("gst mem peak        %10lld KB\n", (long long) (CountingAllocator::getPeakBytes() / 1024));
+  printf("rss after stop      %+10lld KB\n", (long long) ((stopped.residentBytes - baseline.residentBytes) / 1024));
+  printf("gst mem after stop  %+10lld KB\n", (long long) ((stopped.allocatedBytes - baseline.allocatedBytes) / 1024));
+  printf("budget              %10lld KB\n", (long long) (budget / 1024));
+
+  main.disconnectSignallingServer();
+  g_main_loop_unref(loop);
+
+  if ((int) started != sessions) {
+    printf("FAILED: only %zu of %d sessions started\n", started, sessions);
+    return 1;
+  }
+  if (perSession > budget) {
+    printf("FAILED: per-session memory exceeds the budget\n");
+    return 1;
+  }
+  return 0;
+}
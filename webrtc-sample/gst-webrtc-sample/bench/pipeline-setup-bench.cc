@@ -0,0 +1,140 @@
+/**
+ * セッションのパイプラインの作成・破棄の時間のベンチマーク。
+ *
+ * WebRTCMain に playerConnected を渡してパイプラインを作成し、offer が送信されるまでの時間と、
+ * playerDisconnected を渡してパイプラインを破棄するまでの時間を繰り返し計測します。
+ * 視聴者は answer を返さないので、ICE と DTLS の接続は含みません。
+ * 1 回目はプラグインの読み込みなどを含むので、別に出力します。
+ *
+ * 使い方: pipeline-setup-bench [繰り返し回数] [offer を待つ最大時間 (ミリ秒)]
+ */
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <gst/gst.h>
+
+#include "gst-signaling-transport.h"
+#include "gst-webrtc-main.h"
+
+/**
+ * 送信されたメッセージを捨てて、offer が送信された時刻だけを記録するトランスポート。
+ */
+class NullSignalingTransport : public SignalingTransport {
+public:
+  // offer は webrtcbin のスレッドから送信される
+  std::atomic<gint64> mOfferTime{0};
+
+  virtual void connectAsync(std::string& url, std::string& origin) {
+    if (mListener) {
+      mListener->onConnected(this);
+    }
+  }
+
+  virtual void disconnect() {
+  }
+
+  virtual size_t sendMessage(std::string& peerId, std::string& message) {
+    if (mOfferTime == 0 && message.find("\"offer\"") != std::string::npos) {
+      mOfferTime = g_get_monotonic_time();
+    }
+    return message.size();
+  }
+};
+
+static void printStats(const char *name, std::vector<gint64>& values)
+{
+  if (values.empty()) {
+    printf("%-8s %10s\n", name, "-");
+    return;
+  }
+  std::sort(values.begin(), values.end());
+  gint64 total = 0;
+  for (auto itr = values.begin(); itr != values.end(); ++itr) {
+    total += *itr;
+  }
+  printf("%-8s avg %8.2f ms  p50 %8.2f ms  p99 %8.2f ms  max %8.2f ms\n",
+      name,
+      total / 1e3 / values.size(),
+      values[values.size() / 2] / 1e3,
+      values[std::min(values.size() - 1, values.size() * 99 / 100)] / 1e3,
+      values.back() / 1e3);
+}
+
+int main(int argc, char *argv[])
+{
+  int iterations = argc > 1 ? atoi(argv[1]) : 50;
+  gint64 offerTimeout = (argc > 2 ? atoll(argv[2]) : 5000) * 1000;
+  if (iterations <= 0) {
+    iterations = 1;
+  }
+
+  gst_init(&argc, &argv);
+
+  // 外部への通信と統計情報の取得は行わない
+  WebRTCConfig config;
+  config.stunServer.clear();
+  config.statsInterval = 0;
+
+  WebRTCMain main;
+  main.setConfig(config);
+
+  NullSignalingTransport transport;
+  main.setTransport(&transport);
+
+  std::string url;
+  std::string origin;
+  main.connectSignallingServer(url, origin);
+
+  std::string connected("playerConnected");
+  std::string disconnected("playerDisconnected");
+  std::vector<gint64> startTimes;
+  std::vector<gint64> offerTimes;
+  std::vector<gint64> stopTimes;
+  int timeouts = 0;
+
+  for (int i = 0; i <= iterations; i++) {
+    std::string peerId = "viewer-" + std::to_string(i);
+    transport.mOfferTime = 0;
+
+    gint64 start = g_get_monotonic_time();
+    main.onMessage(&transport, peerId, connected, connected.size());
+    gint64 started = g_get_monotonic_time();
+
+    // offer はメインループとは別のスレッドで作成されるので、メインループを回しながら待つ
+    while (transport.mOfferTime == 0 && g_get_monotonic_time() - start < offerTimeout) {
+      g_main_context_iteration(NULL, FALSE);
+      g_usleep(100);
+    }
+
+    gint64 stop = g_get_monotonic_time();
+    main.onMessage(&transport, peerId, disconnected, disconnected.size());
+    gint64 stopped = g_get_monotonic_time();
+
+    if (i == 0) {
+      printf("first    start %8.2f ms  offer %8.2f ms  stop %8.2f ms\n",
+          (started - start) / 1e3,
+          transport.mOfferTime ? (transport.mOfferTime - start) / 1e3 : 0.0,
+          (stopped - stop) / 1e3);
+      continue;
+    }
+
+    startTimes.push_back(started - start);
+    if (transport.mOfferTime) {
+      offerTimes.push_back(transport.mOfferTime - start);
+    } else {
+      timeouts++;
+    }
+    stopTimes.push_back(stopped - stop);
+  }
+
+  printStats("start", startTimes);
+  printStats("offer", offerTimes);
+  printStats("stop", stopTimes);
+  printf("iterations %d, offer timeouts %d\n", iterations, timeouts);
+
+  main.disconnectSignallingServer();
+  return timeouts > 0 ? 1 : 0;
+}
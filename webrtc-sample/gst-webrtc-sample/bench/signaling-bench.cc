@@ -0,0 +1,175 @@
+/**
+ * シグナリングのメッセージの JSON の作成・解析のマイクロベンチマーク。
+ *
+ * SignalingMessage で SDP (映像・音声・データチャンネルの offer) と ICE 候補のメッセージを作成・解析し、
+ * 宛先指定モードの SignalingEnvelope で包む・取り出す処理も含めて 1 メッセージあたりの時間を計測します。
+ * SdpMinimizer で削減した場合の時間とメッセージの大きさも計測します。
+ *
+ * 使い方: signaling-bench [繰り返し回数]
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <glib.h>
+#include <gst/sdp/sdp.h>
+
+#include "gst-sdp-minimizer.h"
+#include "gst-signaling-envelope.h"
+#include "gst-signaling-message.h"
+
+// webrtcbin が作成する offer と同程度の大きさの SDP
+static const char *OFFER_SDP =
+    "v=0\r\n"
+    "o=- 1876527335622343934 0 IN IP4 0.0.0.0\r\n"
+    "s=-\r\n"
+    "t=0 0\r\n"
+    "a=ice-options:trickle\r\n"
+    "a=group:BUNDLE video0 audio1 application2\r\n"
+    "m=video 9 UDP/TLS/RTP/SAVPF 96\r\n"
+    "c=IN IP4 0.0.0.0\r\n"
+    "a=setup:actpass\r\n"
+    "a=ice-ufrag:hOUJ8tyGgyvTnXfOgYArpxaURiZYfhVa\r\n"
+    "a=ice-pwd:qi4Nm5TDapGvrA6JFHp2GdJJDiaNfAvm\r\n"
+    "a=rtcp-mux\r\n"
+    "a=rtcp-rsize\r\n"
+    "a=sendonly\r\n"
+    "a=rtpmap:96 VP8/90000\r\n"
+    "a=rtcp-fb:96 nack\r\n"
+    "a=rtcp-fb:96 nack pli\r\n"
+    "a=rtcp-fb:96 ccm fir\r\n"
+    "a=ssrc:3484078950 msid:user3926890496@host-6a8a0b5b webrtctransceiver0\r\n"
+    "a=ssrc:3484078950 cname:user3926890496@host-6a8a0b5b\r\n"
+    "a=mid:video0\r\n"
+    "a=fingerprint:sha-256 56:1B:42:E0:7E:6B:AB:3F:BE:1E:D2:C6:55:0B:50:44:3A:4C:46:7D:4A:AC:E5:6B:64:3A:C3:27:60:57:41:F4\r\n"
+    "m=audio 0 UDP/TLS/RTP/SAVPF 97\r\n"
+    "c=IN IP4 0.0.0.0\r\n"
+    "a=setup:actpass\r\n"
+    "a=ice-ufrag:hOUJ8tyGgyvTnXfOgYArpxaURiZYfhVa\r\n"
+    "a=ice-pwd:qi4Nm5TDapGvrA6JFHp2GdJJDiaNfAvm\r\n"
+    "a=bundle-only\r\n"
+    "a=rtcp-mux\r\n"
+    "a=rtcp-rsize\r\n"
+    "a=sendrecv\r\n"
+    "a=rtpmap:97 OPUS/48000/2\r\n"
+    "a=rtcp-fb:97 nack\r\n"
+    "a=rtcp-fb:97 nack pli\r\n"
+    "a=fmtp:97 sprop-maxcapturerate=48000;sprop-stereo=0\r\n"
+    "a=ssrc:1150395218 msid:user3926890496@host-6a8a0b5b webrtctransceiver1\r\n"
+    "a=ssrc:1150395218 cname:user3926890496@host-6a8a0b5b\r\n"
+    "a=mid:audio1\r\n"
+    "a=fingerprint:sha-256 56:1B:42:E0:7E:6B:AB:3F:BE:1E:D2:C6:55:0B:50:44:3A:4C:46:7D:4A:AC:E5:6B:64:3A:C3:27:60:57:41:F4\r\n"
+    "m=application 0 UDP/DTLS/SCTP webrtc-datachannel\r\n"
+    "c=IN IP4 0.0.0.0\r\n"
+    "a=setup:actpass\r\n"
+    "a=ice-ufrag:hOUJ8tyGgyvTnXfOgYArpxaURiZYfhVa\r\n"
+    "a=ice-pwd:qi4Nm5TDapGvrA6JFHp2GdJJDiaNfAvm\r\n"
+    "a=bundle-only\r\n"
+    "a=mid:application2\r\n"
+    "a=sctp-port:5000\r\n"
+    "a=fingerprint:sha-256 56:1B:42:E0:7E:6B:AB:3F:BE:1E:D2:C6:55:0B:50:44:3A:4C:46:7D:4A:AC:E5:6B:64:3A:C3:27:60:57:41:F4\r\n";
+
+static const char *CANDIDATE =
+    "candidate:1 1 UDP 2015363327 192.168.10.23 51234 typ host";
+
+// ブラウザが送信する形式の、省略できる属性を含む候補
+static const char *SRFLX_CANDIDATE =
+    "candidate:842163049 1 udp 1677729535 203.0.113.7 61021 typ srflx raddr 192.168.10.23 rport 61021 "
+    "generation 0 ufrag hOUJ network-id 1 network-cost 10";
+
+static void run(const char *name, int iterations, size_t& bytes, const std::function<bool()>& func)
+{
+  // キャッシュやアロケータを温めておく
+  for (int i = 0; i < iterations / 10 + 1; i++) {
+    func();
+  }
+
+  gint64 start = g_get_monotonic_time();
+  int failed = 0;
+  for (int i = 0; i < iterations; i++) {
+    if (!func()) {
+      failed++;
+    }
+  }
+  gint64 elapsed = g_get_monotonic_time() - start;
+
+  double seconds = elapsed / 1e6;
+  printf("%-14s %12.0f msg/s %10.0f ns/msg %8zu bytes %6d failed\n",
+      name,
+      seconds > 0 ? iterations / seconds : 0,
+      iterations > 0 ? elapsed * 1e3 / iterations : 0,
+      bytes,
+      failed);
+}
+
+int main(int argc, char *argv[])
+{
+  int iterations = argc > 1 ? atoi(argv[1]) : 100000;
+  if (iterations <= 0) {
+    iterations = 1;
+  }
+
+  std::string peerId("conn_1");
+  std::string sdpMessage;
+  std::string iceMessage;
+  std::string envelope;
+  SignalingMessage::encodeSdp("offer", OFFER_SDP, sdpMessage);
+  SignalingMessage::encodeIce(0, CANDIDATE, iceMessage);
+  SignalingEnvelope::wrap("to", peerId, sdpMessage, envelope);
+
+  std::string out;
+  std::string from;
+  std::string payloadText;
+  SignalingPayload payload;
+  size_t bytes = 0;
+
+  bytes = sdpMessage.size();
+  run("encode sdp", iterations, bytes, [&]() {
+    return SignalingMessage::encodeSdp("offer", OFFER_SDP, out);
+  });
+  run("decode sdp", iterations, bytes, [&]() {
+    return SignalingMessage::decode(sdpMessage, payload);
+  });
+
+  bytes = iceMessage.size();
+  run("encode ice", iterations, bytes, [&]() {
+    return SignalingMessage::encodeIce(0, CANDIDATE, out);
+  });
+  run("decode ice", iterations, bytes, [&]() {
+    return SignalingMessage::decode(iceMessage, payload);
+  });
+
+  GstSDPMessage *sdp = NULL;
+  gst_sdp_message_new(&sdp);
+  gst_sdp_message_parse_buffer((const guint8 *) OFFER_SDP, strlen(OFFER_SDP), sdp);
+  gchar *minimized = SdpMinimizer::minimize(sdp);
+  SignalingMessage::encodeSdp("offer", minimized, out);
+  g_free(minimized);
+  bytes = out.size();
+  run("minimize sdp", iterations, bytes, [&]() {
+    gchar *text = SdpMinimizer::minimize(sdp);
+    bool result = SignalingMessage::encodeSdp("offer", text, out);
+    g_free(text);
+    return result;
+  });
+  gst_sdp_message_free(sdp);
+
+  std::string compact;
+  SdpMinimizer::compactCandidate(SRFLX_CANDIDATE, compact);
+  SignalingMessage::encodeIce(0, compact.c_str(), out);
+  bytes = out.size();
+  run("compact ice", iterations, bytes, [&]() {
+    SdpMinimizer::compactCandidate(SRFLX_CANDIDATE, compact);
+    return SignalingMessage::encodeIce(0, compact.c_str(), out);
+  });
+
+  bytes = envelope.size();
+  run("wrap sdp", iterations, bytes, [&]() {
+    return SignalingEnvelope::wrap("to", peerId, sdpMessage, out);
+  });
+  run("unwrap sdp", iterations, bytes, [&]() {
+    return SignalingEnvelope::unwrap("to", envelope, from, payloadText);
+  });
+  return 0;
+}
@@ -0,0 +1,93 @@
+/**
+ * UdpBatchSender のマイクロベンチマーク。
+ *
+ * ローカルホストの受信ソケットに向けて RTP と同じサイズのパケットを送信し、
+ * 送信方法 (sendto, sendmmsg, GSO) ごとに 1 コアあたりの送信パケット数/秒を計測します。
+ * 受信側は読み出さないので、カーネルの受信バッファが一杯になった分は受信側で破棄されます。
+ *
+ * 使い方: udp-batch-bench [秒数] [1 回にまとめるパケット数] [パケットサイズ]
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "gst-udp-batch-sender.h"
+
+static double getTime(clockid_t clock)
+{
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void run(UdpBatchSender::Mode mode, int port, double seconds, int batch, int size)
+{
+  UdpBatchSender sender(batch);
+  if (!sender.open("127.0.0.1", port, mode)) {
+    return;
+  }
+
+  // RTP のペイローダーと同様に、1 フレームを MTU いっぱいのパケットと最後の小さなパケットに分ける
+  std::vector<uint8_t> packet(size, 0x80);
+  int lastSize = size / 3 > 12 ? size / 3 : 12;
+
+  double wallStart = getTime(CLOCK_MONOTONIC);
+  double cpuStart = getTime(CLOCK_THREAD_CPUTIME_ID);
+  double wall = 0;
+  while (wall < seconds) {
+    for (int i = 0; i < 64; i++) {
+      for (int j = 0; j < batch; j++) {
+        sender.add(packet.data(), j == batch - 1 ? lastSize : size);
+      }
+      sender.flush();
+    }
+    wall = getTime(CLOCK_MONOTONIC) - wallStart;
+  }
+  double cpu = getTime(CLOCK_THREAD_CPUTIME_ID) - cpuStart;
+
+  uint64_t packets = sender.getPacketCount();
+  printf("%-10s %12.0f pkt/s %12.0f pkt/s/core %10.2f pkt/syscall %10llu dropped\n",
+      UdpBatchSender::getModeName(sender.getMode()),
+      packets / wall,
+      cpu > 0 ? packets / cpu : 0,
+      sender.getSyscallCount() > 0 ? (double) packets / sender.getSyscallCount() : 0,
+      (unsigned long long) sender.getDropCount());
+}
+
+int main(int argc, char *argv[])
+{
+  double seconds = argc > 1 ? atof(argv[1]) : 2.0;
+  int batch = argc > 2 ? atoi(argv[2]) : 32;
+  int size = argc > 3 ? atoi(argv[3]) : 1200;
+  if (seconds <= 0 || batch <= 0 || size <= 12 || size > 65000) {
+    fprintf(stderr, "usage: %s [seconds] [packets per batch] [packet size]\n", argv[0]);
+    return 1;
+  }
+
+  int receiver = socket(AF_INET, SOCK_DGRAM, 0);
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0;
+  socklen_t len = sizeof(addr);
+  if (receiver < 0
+      || bind(receiver, (struct sockaddr *) &addr, sizeof(addr)) != 0
+      || getsockname(receiver, (struct sockaddr *) &addr, &len) != 0) {
+    perror("receiver");
+    return 1;
+  }
+  int port = ntohs(addr.sin_port);
+
+  printf("%.1f s, %d packets per batch, %d bytes per packet\n", seconds, batch, size);
+  run(UdpBatchSender::MODE_SENDTO, port, seconds, batch, size);
+  run(UdpBatchSender::MODE_SENDMMSG, port, seconds, batch, size);
+  run(UdpBatchSender::MODE_GSO, port, seconds, batch, size);
+
+  close(receiver);
+  return 0;
+}
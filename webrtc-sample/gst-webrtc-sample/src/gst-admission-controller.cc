@@ -0,0 +1,86 @@
+#include "gst-admission-controller.h"
+
+AdmissionController::AdmissionController()
+{
+  mAcceptCount = 0;
+  mDegradeCount = 0;
+  mRejectCount = 0;
+}
+
+AdmissionController::~AdmissionController()
+{
+}
+
+AdmissionDecision AdmissionController::decide(const AdmissionUsage& usage, std::string& reason)
+{
+  struct Resource {
+    const char *name;
+    gdouble estimated;
+    gdouble limit;
+  };
+
+  // セッション数以外は、既存のセッションの平均を新しいセッションの分として加える
+  Resource resources[] = {
+    { "sessions", (gdouble) usage.sessions + 1, (gdouble) mLimits.maxSessions },
+    { "cpu", estimate(usage.cpu, usage.sessions), mLimits.maxCpu },
+    { "memory", estimate((gdouble) usage.memory, usage.sessions), (gdouble) mLimits.maxMemory },
+    { "bandwidth", estimate((gdouble) usage.bandwidth, usage.sessions), (gdouble) mLimits.maxBandwidth },
+  };
+
+  AdmissionDecision decision = ADMISSION_ACCEPT;
+  reason.clear();
+
+  for (size_t i = 0; i < G_N_ELEMENTS(resources); i++) {
+    Resource& resource = resources[i];
+    if (resource.limit <= 0.0) {
+      continue;
+    }
+
+    gdouble ratio = resource.estimated / resource.limit;
+    if (ratio > 1.0) {
+      decision = ADMISSION_REJECT;
+      reason = resource.name;
+      break;
+    }
+    if (ratio > mLimits.degradeRatio && decision == ADMISSION_ACCEPT) {
+      decision = ADMISSION_DEGRADE;
+      reason = resource.name;
+    }
+  }
+
+  switch (decision) {
+  case ADMISSION_ACCEPT:
+    mAcceptCount++;
+    break;
+  case ADMISSION_DEGRADE:
+    mDegradeCount++;
+    break;
+  case ADMISSION_REJECT:
+    mRejectCount++;
+    break;
+  }
+  return decision;
+}
+
+const char *AdmissionController::getDecisionName(AdmissionDecision decision)
+{
+  switch (decision) {
+  case ADMISSION_ACCEPT:
+    return "accept";
+  case ADMISSION_DEGRADE:
+    return "degrade";
+  case ADMISSION_REJECT:
+    return "reject";
+  }
+  return "unknown";
+}
+
+// private functions.
+
+gdouble AdmissionController::estimate(gdouble usage, guint sessions)
+{
+  if (sessions == 0) {
+    return usage;
+  }
+  return usage + usage / sessions;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <string>
+#include <glib.h>
+
+// 新しいセッションを受け入れるかの判定結果
+enum AdmissionDecision {
+  // そのまま受け入れる
+  ADMISSION_ACCEPT,
+  // 品質 (ビットレート) を下げて受け入れる
+  ADMISSION_DEGRADE,
+  // 受け入れない
+  ADMISSION_REJECT
+};
+
+/**
+ * 受け入れるかを判定する上限値。0 の項目は判定に使用しません。
+ */
+struct AdmissionLimits {
+  // 同時に配信するセッション数
+  guint maxSessions = 0;
+  // エンコーダの CPU 使用率の合計 (%、1 コアで 100%)
+  gdouble maxCpu = 0.0;
+  // queue に溜まっているバイト数の合計
+  guint64 maxMemory = 0;
+  // 送信ビットレートの合計 (bps)
+  guint64 maxBandwidth = 0;
+  // 上限に対してこの割合を超えた場合に、品質を下げて受け入れる
+  gdouble degradeRatio = 0.8;
+};
+
+/**
+ * 現在配信しているセッションのリソースの合計。
+ */
+struct AdmissionUsage {
+  guint sessions = 0;
+  gdouble cpu = 0.0;
+  guint64 memory = 0;
+  guint64 bandwidth = 0;
+};
+
+/**
+ * 新しいセッションを受け入れるかを判定します。
+ *
+ * 現在のセッションの平均から新しいセッションを追加した後の使用量を見積もり、
+ * いずれかの上限を超える場合は拒否、degradeRatio を超える場合は品質を下げて受け入れます。
+ */
+class AdmissionController {
+private:
+  AdmissionLimits mLimits;
+  guint64 mAcceptCount;
+  guint64 mDegradeCount;
+  guint64 mRejectCount;
+
+  static gdouble estimate(gdouble usage, guint sessions);
+
+public:
+  AdmissionController();
+  virtual ~AdmissionController();
+
+  inline void setLimits(const AdmissionLimits& limits) {
+    mLimits = limits;
+  }
+
+  inline bool isEnabled() const {
+    return mLimits.maxSessions > 0 || mLimits.maxCpu > 0.0 || mLimits.maxMemory > 0 || mLimits.maxBandwidth > 0;
+  }
+
+  /**
+   * 新しいセッションを受け入れるかを判定します。
+   *
+   * @param usage 現在配信しているセッションのリソースの合計
+   * @param reason 判定の理由になったリソース (sessions, cpu, memory, bandwidth)、受け入れる場合は空文字
+   * @return 判定結果
+   */
+  AdmissionDecision decide(const AdmissionUsage& usage, std::string& reason);
+
+  inline guint64 getAcceptCount() const {
+    return mAcceptCount;
+  }
+
+  inline guint64 getDegradeCount() const {
+    return mDegradeCount;
+  }
+
+  inline guint64 getRejectCount() const {
+    return mRejectCount;
+  }
+
+  static const char *getDecisionName(AdmissionDecision decision);
+};
@@ -0,0 +1,114 @@
+#include "gst-counting-allocator.h"
+
+#define GST_TYPE_COUNTING_ALLOCATOR (gst_counting_allocator_get_type())
+
+typedef struct {
+  GstAllocator parent;
+  GstAllocator *sysmem;
+} GstCountingAllocator;
+
+typedef struct {
+  GstAllocatorClass parent_class;
+} GstCountingAllocatorClass;
+
+GType gst_counting_allocator_get_type(void);
+
+G_DEFINE_TYPE(GstCountingAllocator, gst_counting_allocator, GST_TYPE_ALLOCATOR);
+
+static GstMemory *gst_counting_allocator_alloc(GstAllocator *allocator, gsize size, GstAllocationParams *params)
+{
+  GstCountingAllocator *self = (GstCountingAllocator *) allocator;
+
+  // 確保したメモリの allocator はシステムメモリのアロケータになるので、map や解放はそちらで行われる
+  GstMemory *memory = gst_allocator_alloc(self->sysmem, size, params);
+  if (memory) {
+    CountingAllocator::onMemoryAllocated(memory);
+  }
+  return memory;
+}
+
+static void gst_counting_allocator_free(GstAllocator *allocator, GstMemory *memory)
+{
+  GstCountingAllocator *self = (GstCountingAllocator *) allocator;
+  gst_allocator_free(self->sysmem, memory);
+}
+
+static void gst_counting_allocator_finalize(GObject *object)
+{
+  GstCountingAllocator *self = (GstCountingAllocator *) object;
+  gst_object_unref(self->sysmem);
+  G_OBJECT_CLASS(gst_counting_allocator_parent_class)->finalize(object);
+}
+
+static void gst_counting_allocator_class_init(GstCountingAllocatorClass *klass)
+{
+  GstAllocatorClass *allocator_class = (GstAllocatorClass *) klass;
+  allocator_class->alloc = gst_counting_allocator_alloc;
+  allocator_class->free = gst_counting_allocator_free;
+  G_OBJECT_CLASS(klass)->finalize = gst_counting_allocator_finalize;
+}
+
+static void gst_counting_allocator_init(GstCountingAllocator *self)
+{
+  self->sysmem = gst_allocator_find(GST_ALLOCATOR_SYSMEM);
+}
+
+std::atomic<gint64> CountingAllocator::sLiveBytes(0);
+std::atomic<gint64> CountingAllocator::sPeakBytes(0);
+std::atomic<guint64> CountingAllocator::sAllocationCount(0);
+
+static std::atomic<bool> sInstalled(false);
+
+void CountingAllocator::install()
+{
+  if (sInstalled.exchange(true)) {
+    return;
+  }
+
+  GstAllocator *allocator = (GstAllocator *) g_object_new(GST_TYPE_COUNTING_ALLOCATOR, NULL);
+  gst_object_ref_sink(allocator);
+
+  // gst_allocator_register と gst_allocator_set_default は参照を引き継ぐ
+  gst_allocator_register("CountingMemory", (GstAllocator *) gst_object_ref(allocator));
+  gst_allocator_set_default(allocator);
+}
+
+bool CountingAllocator::isInstalled()
+{
+  return sInstalled;
+}
+
+gint64 CountingAllocator::getLiveBytes()
+{
+  return sLiveBytes;
+}
+
+gint64 CountingAllocator::getPeakBytes()
+{
+  return sPeakBytes;
+}
+
+guint64 CountingAllocator::getAllocationCount()
+{
+  return sAllocationCount;
+}
+
+void CountingAllocator::onMemoryAllocated(GstMemory *memory)
+{
+  gint64 size = (gint64) memory->maxsize;
+  gint64 live = sLiveBytes.fetch_add(size) + size;
+  sAllocationCount++;
+
+  gint64 peak = sPeakBytes;
+  while (live > peak && !sPeakBytes.compare_exchange_weak(peak, live)) {
+  }
+
+  gst_mini_object_weak_ref(GST_MINI_OBJECT_CAST(memory), CountingAllocator::onMemoryFreed, GSIZE_TO_POINTER(memory->maxsize));
+}
+
+// callback functions.
+
+void CountingAllocator::onMemoryFreed(gpointer userData, GstMiniObject *object)
+{
+  sLiveBytes -= (gint64) GPOINTER_TO_SIZE(userData);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <atomic>
+#include <gst/gst.h>
+
+/**
+ * GStreamer のメモリ確保量を集計するアロケータ。
+ *
+ * install するとデフォルトのアロケータになり、gst_allocator_alloc(NULL, ...) や
+ * デフォルトのバッファプールで確保されるメモリを数えます。
+ * 実際の確保はシステムメモリのアロケータに任せ、確保したメモリに weak ref を付けて解放を検知します。
+ *
+ * weak ref のためにメモリごとに余分な確保が発生するので、メモリの計測を行う場合にだけ使用してください。
+ * 確保量はプロセス全体の値で、要素が独自に確保するメモリ (malloc や独自のアロケータ) は含みません。
+ */
+class CountingAllocator {
+private:
+  static std::atomic<gint64> sLiveBytes;
+  static std::atomic<gint64> sPeakBytes;
+  static std::atomic<guint64> sAllocationCount;
+
+  static void onMemoryFreed(gpointer userData, GstMiniObject *object);
+
+public:
+  // デフォルトのアロケータとして登録します。gst_init の後に一度だけ呼び出してください。
+  static void install();
+
+  static bool isInstalled();
+
+  // 確保されていて、まだ解放されていないバイト数
+  static gint64 getLiveBytes();
+
+  // getLiveBytes の最大値
+  static gint64 getPeakBytes();
+
+  // 確保した回数
+  static guint64 getAllocationCount();
+
+  // CountingAllocator から呼び出されます。
+  static void onMemoryAllocated(GstMemory *memory);
+};
@@ -0,0 +1,300 @@
+#include "gst-data-channel-scheduler.h"
+#include "gst-webrtc-stats.h"
+
+// 1 巡で重み 1 のクラスが送信できるバイト数
+#define DATA_CHANNEL_QUANTUM 1200
+
+// クラスごとに溜めておける送信待ちのバイト数
+#define DATA_CHANNEL_MAX_QUEUED_BYTES (4 * 1024 * 1024)
+
+// データチャンネルの送信バッファに溜めておく最大のバイト数
+#define DATA_CHANNEL_MAX_BUFFERED_AMOUNT (256 * 1024)
+
+// 送信できない場合に再度試すまでの間隔 (ミリ秒)
+#define DATA_CHANNEL_RETRY_INTERVAL 10
+
+DataChannelScheduler::DataChannelScheduler()
+{
+  static const guint weights[DATA_CHANNEL_CLASS_COUNT] = { 4, 2, 1 };
+  for (guint i = 0; i < DATA_CHANNEL_CLASS_COUNT; i++) {
+    mClasses[i].weight = weights[i];
+    mClasses[i].deficit = 0;
+    mClasses[i].queuedBytes = 0;
+    mClasses[i].sentBytes = 0;
+    mClasses[i].sentMessages = 0;
+    mClasses[i].droppedMessages = 0;
+  }
+  mMaxQueuedBytes = DATA_CHANNEL_MAX_QUEUED_BYTES;
+  mMaxBufferedAmount = DATA_CHANNEL_MAX_BUFFERED_AMOUNT;
+  mLinkBandwidth = 0;
+  mMinBitrate = 0;
+  mEstimatedBandwidth = 0;
+  mTokens = 0.0;
+  mLastRefillTime = 0;
+  mLimited = false;
+  mMediaBytesSent = 0;
+  mMediaBitrate = 0;
+  mLastStatsTime = 0;
+  mMinRoundTripTime = 0.0;
+  mTimerId = 0;
+}
+
+DataChannelScheduler::~DataChannelScheduler()
+{
+  reset();
+}
+
+void DataChannelScheduler::setSender(Sender sender, BufferedAmountGetter bufferedAmountGetter)
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+  mSender = sender;
+  mBufferedAmountGetter = bufferedAmountGetter;
+}
+
+void DataChannelScheduler::setWeight(DataChannelClass klass, guint weight)
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+  mClasses[klass].weight = MAX(weight, 1);
+}
+
+void DataChannelScheduler::setLinkBandwidth(guint64 bandwidth, guint64 minBitrate)
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+  mLinkBandwidth = bandwidth;
+  mMinBitrate = minBitrate;
+  mEstimatedBandwidth = bandwidth;
+}
+
+bool DataChannelScheduler::enqueue(DataChannelClass klass, bool isBinary, const std::string& data)
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  ClassState& state = mClasses[klass];
+  if (state.queuedBytes + data.size() > mMaxQueuedBytes) {
+    state.droppedMessages++;
+    return false;
+  }
+
+  state.queue.push_back({ isBinary, data });
+  state.queuedBytes += data.size();
+
+  // 送信はメインループで行う
+  if (mTimerId == 0) {
+    mTimerId = g_idle_add(DataChannelScheduler::onTimer, this);
+  }
+  return true;
+}
+
+void DataChannelScheduler::onStats(const GstStructure *stats)
+{
+  guint64 bytesSent = 0;
+  gdouble fractionLost = 0.0;
+  gdouble roundTripTime = 0.0;
+  WebRTCStats::foreach(stats, [&](GstWebRTCStatsType type, const GstStructure *stat) {
+    if (type == GST_WEBRTC_STATS_OUTBOUND_RTP) {
+      guint64 bytes = 0;
+      if (gst_structure_get_uint64(stat, "bytes-sent", &bytes)) {
+        bytesSent += bytes;
+      }
+    } else if (type == GST_WEBRTC_STATS_REMOTE_INBOUND_RTP) {
+      gdouble value = 0.0;
+      if (gst_structure_get_double(stat, "fraction-lost", &value)) {
+        fractionLost = MAX(fractionLost, value);
+      }
+      if (gst_structure_get_double(stat, "round-trip-time", &value)) {
+        roundTripTime = MAX(roundTripTime, value);
+      }
+    }
+  });
+
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  gint64 now = g_get_monotonic_time();
+  if (mLastStatsTime > 0 && now > mLastStatsTime && bytesSent >= mMediaBytesSent) {
+    mMediaBitrate = (bytesSent - mMediaBytesSent) * 8 * G_USEC_PER_SEC / (guint64) (now - mLastStatsTime);
+  }
+  mMediaBytesSent = bytesSent;
+  mLastStatsTime = now;
+
+  if (mLinkBandwidth == 0) {
+    return;
+  }
+
+  if (roundTripTime > 0.0 && (mMinRoundTripTime == 0.0 || roundTripTime < mMinRoundTripTime)) {
+    mMinRoundTripTime = roundTripTime;
+  }
+
+  // パケットロスや RTT の増加は送信が回線の帯域を超えている兆候なので、推定帯域を下げる
+  // 送信待ちが残っている場合だけ、回線の帯域まで少しずつ上げる
+  bool congested = fractionLost > 0.02 ||
+      (mMinRoundTripTime > 0.0 && roundTripTime > mMinRoundTripTime * 1.5 + 0.01);
+  if (congested) {
+    mEstimatedBandwidth = MAX((guint64) (mEstimatedBandwidth * 0.85), mMediaBitrate + mMinBitrate);
+  } else if (mLimited) {
+    mEstimatedBandwidth = MIN((guint64) (mEstimatedBandwidth * 1.05) + mMinBitrate, mLinkBandwidth);
+  }
+}
+
+void DataChannelScheduler::reset()
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  if (mTimerId) {
+    g_source_remove(mTimerId);
+    mTimerId = 0;
+  }
+
+  guint64 sentBytes = 0;
+  for (guint i = 0; i < DATA_CHANNEL_CLASS_COUNT; i++) {
+    sentBytes += mClasses[i].sentBytes;
+  }
+  if (sentBytes > 0 || mMediaBytesSent > 0) {
+    g_print("Data channel sent: control %" G_GUINT64_FORMAT ", rpc %" G_GUINT64_FORMAT ", bulk %" G_GUINT64_FORMAT
+        " bytes (dropped %" G_GUINT64_FORMAT " messages), media %" G_GUINT64_FORMAT " bytes\n",
+        mClasses[DATA_CHANNEL_CLASS_CONTROL].sentBytes, mClasses[DATA_CHANNEL_CLASS_RPC].sentBytes,
+        mClasses[DATA_CHANNEL_CLASS_BULK].sentBytes,
+        mClasses[DATA_CHANNEL_CLASS_CONTROL].droppedMessages + mClasses[DATA_CHANNEL_CLASS_RPC].droppedMessages +
+        mClasses[DATA_CHANNEL_CLASS_BULK].droppedMessages,
+        mMediaBytesSent);
+  }
+
+  for (guint i = 0; i < DATA_CHANNEL_CLASS_COUNT; i++) {
+    ClassState& state = mClasses[i];
+    state.queue.clear();
+    state.queuedBytes = 0;
+    state.deficit = 0;
+    state.sentBytes = 0;
+    state.sentMessages = 0;
+    state.droppedMessages = 0;
+  }
+
+  mEstimatedBandwidth = mLinkBandwidth;
+  mTokens = 0.0;
+  mLastRefillTime = 0;
+  mLimited = false;
+  mMediaBytesSent = 0;
+  mMediaBitrate = 0;
+  mLastStatsTime = 0;
+  mMinRoundTripTime = 0.0;
+}
+
+guint64 DataChannelScheduler::getSentBytes(DataChannelClass klass)
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mClasses[klass].sentBytes;
+}
+
+guint64 DataChannelScheduler::getMediaBytesSent()
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mMediaBytesSent;
+}
+
+guint64 DataChannelScheduler::getEstimatedBandwidth()
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mEstimatedBandwidth;
+}
+
+const char *DataChannelScheduler::getClassName(DataChannelClass klass)
+{
+  switch (klass) {
+  case DATA_CHANNEL_CLASS_CONTROL:
+    return "control";
+  case DATA_CHANNEL_CLASS_RPC:
+    return "rpc";
+  case DATA_CHANNEL_CLASS_BULK:
+    return "bulk";
+  default:
+    break;
+  }
+  return "unknown";
+}
+
+// private functions.
+
+guint64 DataChannelScheduler::getDataBitrate() const
+{
+  if (mEstimatedBandwidth > mMediaBitrate + mMinBitrate) {
+    return mEstimatedBandwidth - mMediaBitrate;
+  }
+  return mMinBitrate;
+}
+
+void DataChannelScheduler::refill(gint64 now)
+{
+  if (mLinkBandwidth == 0) {
+    return;
+  }
+
+  gdouble bytesPerSecond = getDataBitrate() / 8.0;
+  if (mLastRefillTime > 0) {
+    mTokens += bytesPerSecond * (now - mLastRefillTime) / G_USEC_PER_SEC;
+  }
+  mLastRefillTime = now;
+
+  // 一度に送信できるのは 100 ミリ秒分まで
+  gdouble burst = MAX(bytesPerSecond / 10.0, (gdouble) DATA_CHANNEL_QUANTUM);
+  mTokens = MIN(mTokens, burst);
+}
+
+// callback functions.
+
+gboolean DataChannelScheduler::onTimer(gpointer userData)
+{
+  DataChannelScheduler *self = (DataChannelScheduler *) userData;
+  std::deque<Message> messages;
+  Sender sender;
+
+  {
+    std::lock_guard<std::mutex> lock(self->mMutex);
+    self->mTimerId = 0;
+    self->refill(g_get_monotonic_time());
+
+    guint64 buffered = self->mBufferedAmountGetter ? self->mBufferedAmountGetter() : 0;
+    gint64 room = (gint64) self->mMaxBufferedAmount - (gint64) buffered;
+    bool paced = self->mLinkBandwidth > 0;
+
+    // 重み付きのラウンドロビン (Deficit Round Robin)
+    // トークンは負になってもよいので、バケットより大きなメッセージも送信できる
+    bool pending = true;
+    while (pending && room > 0 && (!paced || self->mTokens > 0.0)) {
+      pending = false;
+      for (guint i = 0; i < DATA_CHANNEL_CLASS_COUNT; i++) {
+        ClassState& state = self->mClasses[i];
+        if (state.queue.empty()) {
+          state.deficit = 0;
+          continue;
+        }
+        state.deficit += (gint64) state.weight * DATA_CHANNEL_QUANTUM;
+        while (!state.queue.empty() && state.deficit >= (gint64) state.queue.front().data.size() &&
+            room > 0 && (!paced || self->mTokens > 0.0)) {
+          gsize size = state.queue.front().data.size();
+          state.deficit -= size;
+          state.queuedBytes -= size;
+          state.sentBytes += size;
+          state.sentMessages++;
+          room -= size;
+          self->mTokens -= size;
+          messages.push_back(std::move(state.queue.front()));
+          state.queue.pop_front();
+        }
+        pending = pending || !state.queue.empty();
+      }
+    }
+
+    // 帯域かバッファの上限で送信しきれなかった
+    self->mLimited = pending;
+    if (pending) {
+      self->mTimerId = g_timeout_add(DATA_CHANNEL_RETRY_INTERVAL, DataChannelScheduler::onTimer, self);
+    }
+    sender = self->mSender;
+  }
+
+  if (sender) {
+    for (auto itr = messages.begin(); itr != messages.end(); ++itr) {
+      sender(itr->isBinary, itr->data);
+    }
+  }
+  return G_SOURCE_REMOVE;
+}
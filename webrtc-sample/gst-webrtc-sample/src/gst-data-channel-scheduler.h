@@ -0,0 +1,121 @@
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <gst/gst.h>
+
+// 送信の優先度を分けるクラス
+enum DataChannelClass {
+  // 文字列のメッセージ
+  DATA_CHANNEL_CLASS_CONTROL,
+  // 小さな RPC のメッセージ
+  DATA_CHANNEL_CLASS_RPC,
+  // 大きな RPC のメッセージ
+  DATA_CHANNEL_CLASS_BULK,
+  DATA_CHANNEL_CLASS_COUNT
+};
+
+// DATA_CHANNEL_CLASS_BULK として扱うメッセージのサイズ
+#define DATA_CHANNEL_BULK_SIZE (16 * 1024)
+
+/**
+ * データチャンネルの送信をクラスごとの重みで順番に行い、映像・音声が使っていない帯域に合わせて送信量を制限します。
+ *
+ * max-bundle ではデータチャンネルと映像・音声が同じトランスポートを使うので、
+ * 大量のデータを一度に送ると映像の送信が遅れます。
+ * 送信できる量は、回線の帯域から統計情報で取得した映像・音声の送信ビットレートを引いた値にします。
+ * 受信側のパケットロスや RTT が増えた場合は推定帯域を下げ、送信量が足りない場合は回線の帯域まで少しずつ上げます。
+ *
+ * 回線の帯域が 0 の場合は送信量を制限せず、重みによる順番とデータチャンネルのバッファの上限だけで送信します。
+ */
+class DataChannelScheduler {
+public:
+  typedef std::function<void(bool isBinary, const std::string& data)> Sender;
+  typedef std::function<guint64()> BufferedAmountGetter;
+
+private:
+  struct Message {
+    bool isBinary;
+    std::string data;
+  };
+
+  struct ClassState {
+    guint weight;
+    gint64 deficit;
+    std::deque<Message> queue;
+    gsize queuedBytes;
+    guint64 sentBytes;
+    guint64 sentMessages;
+    guint64 droppedMessages;
+  };
+
+  std::mutex mMutex;
+  Sender mSender;
+  BufferedAmountGetter mBufferedAmountGetter;
+  ClassState mClasses[DATA_CHANNEL_CLASS_COUNT];
+  gsize mMaxQueuedBytes;
+  guint64 mMaxBufferedAmount;
+
+  // 送信量を制限するトークンバケット (トークンはバイト数)
+  guint64 mLinkBandwidth;
+  guint64 mMinBitrate;
+  guint64 mEstimatedBandwidth;
+  gdouble mTokens;
+  gint64 mLastRefillTime;
+  bool mLimited;
+
+  // 統計情報から求めた映像・音声の状態
+  guint64 mMediaBytesSent;
+  guint64 mMediaBitrate;
+  gint64 mLastStatsTime;
+  gdouble mMinRoundTripTime;
+
+  guint mTimerId;
+
+  guint64 getDataBitrate() const;
+  void refill(gint64 now);
+
+  static gboolean onTimer(gpointer userData);
+
+public:
+  DataChannelScheduler();
+  virtual ~DataChannelScheduler();
+
+  DataChannelScheduler(const DataChannelScheduler&) = delete;
+  DataChannelScheduler& operator=(const DataChannelScheduler&) = delete;
+
+  // 実際に送信する関数と、データチャンネルの送信バッファのサイズを取得する関数を設定します。
+  void setSender(Sender sender, BufferedAmountGetter bufferedAmountGetter);
+
+  // クラスごとの重み、1 回に送信できる量の比率になります。
+  void setWeight(DataChannelClass klass, guint weight);
+
+  /**
+   * 映像・音声とデータチャンネルで使用できる回線の帯域を設定します。
+   *
+   * @param bandwidth 回線の帯域 (bps)、0 の場合は送信量を制限しません
+   * @param minBitrate 映像・音声で帯域を使い切っている場合でも、データチャンネルに割り当てる帯域 (bps)
+   */
+  void setLinkBandwidth(guint64 bandwidth, guint64 minBitrate);
+
+  /**
+   * メッセージを送信待ちに追加します。
+   *
+   * @return クラスの送信待ちが上限を超えていて追加できなかった場合は false
+   */
+  bool enqueue(DataChannelClass klass, bool isBinary, const std::string& data);
+
+  // webrtcbin の get-stats で取得した統計情報を渡します。
+  void onStats(const GstStructure *stats);
+
+  // 送信待ちを破棄して、送信したバイト数を出力します。
+  void reset();
+
+  guint64 getSentBytes(DataChannelClass klass);
+  guint64 getMediaBytesSent();
+  guint64 getEstimatedBandwidth();
+
+  static const char *getClassName(DataChannelClass klass);
+};
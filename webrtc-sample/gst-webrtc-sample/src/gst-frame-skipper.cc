@@ -0,0 +1,98 @@
+#include "gst-frame-skipper.h"
+
+#include <string.h>
+
+FrameSkipper::FrameSkipper()
+{
+  mPad = nullptr;
+  mProbeId = 0;
+  mLastBuffer = nullptr;
+  mLastPassedTime = 0;
+  mKeepAliveInterval = 0;
+  mPassedCount = 0;
+  mSkippedCount = 0;
+}
+
+FrameSkipper::~FrameSkipper()
+{
+  detach();
+}
+
+void FrameSkipper::attach(GstPad *pad, guint keepAliveInterval)
+{
+  detach();
+
+  mPad = (GstPad *) gst_object_ref(pad);
+  mKeepAliveInterval = (gint64) keepAliveInterval * 1000;
+  mLastPassedTime = 0;
+  mPassedCount = 0;
+  mSkippedCount = 0;
+  mProbeId = gst_pad_add_probe(mPad, GST_PAD_PROBE_TYPE_BUFFER, FrameSkipper::onProbe, this, NULL);
+}
+
+void FrameSkipper::detach()
+{
+  if (mPad) {
+    if (mProbeId) {
+      gst_pad_remove_probe(mPad, mProbeId);
+      mProbeId = 0;
+    }
+    gst_object_unref(mPad);
+    mPad = nullptr;
+
+    g_print("Frame skipper: %" G_GUINT64_FORMAT " passed, %" G_GUINT64_FORMAT " skipped\n",
+        (guint64) mPassedCount, (guint64) mSkippedCount);
+  }
+
+  if (mLastBuffer) {
+    gst_buffer_unref(mLastBuffer);
+    mLastBuffer = nullptr;
+  }
+}
+
+// private functions.
+
+bool FrameSkipper::isSameFrame(GstBuffer *buffer)
+{
+  if (!mLastBuffer || gst_buffer_get_size(mLastBuffer) != gst_buffer_get_size(buffer)) {
+    return false;
+  }
+
+  GstMapInfo last;
+  GstMapInfo current;
+  if (!gst_buffer_map(mLastBuffer, &last, GST_MAP_READ)) {
+    return false;
+  }
+  if (!gst_buffer_map(buffer, &current, GST_MAP_READ)) {
+    gst_buffer_unmap(mLastBuffer, &last);
+    return false;
+  }
+
+  // 画面の一部だけが変化した場合でも、変化した行で比較が終わるので全体を比較することは少ない
+  bool same = memcmp(last.data, current.data, current.size) == 0;
+
+  gst_buffer_unmap(buffer, &current);
+  gst_buffer_unmap(mLastBuffer, &last);
+  return same;
+}
+
+// callback functions.
+
+GstPadProbeReturn FrameSkipper::onProbe(GstPad *pad, GstPadProbeInfo *info, gpointer userData)
+{
+  FrameSkipper *self = (FrameSkipper *) userData;
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+  gint64 now = g_get_monotonic_time();
+
+  bool keepAlive = now - self->mLastPassedTime >= self->mKeepAliveInterval;
+  if (!keepAlive && self->isSameFrame(buffer)) {
+    self->mSkippedCount++;
+    return GST_PAD_PROBE_DROP;
+  }
+
+  // 次のフレームと比較するために参照を保持しておく
+  gst_buffer_replace(&self->mLastBuffer, buffer);
+  self->mLastPassedTime = now;
+  self->mPassedCount++;
+  return GST_PAD_PROBE_OK;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <gst/gst.h>
+
+/**
+ * 前のフレームから変化のない映像フレームを破棄して、エンコーダを呼び出さないようにします。
+ *
+ * 画面キャプチャのように、ほとんどのフレームが前のフレームと同じ映像を想定しています。
+ * 未圧縮のフレームを前のフレームと比較して、同じ場合には破棄します。
+ * 受信側の表示が止まったと判断されないように、keepAliveInterval ごとには変化がなくてもフレームを渡します。
+ */
+class FrameSkipper {
+private:
+  GstPad *mPad;
+  gulong mProbeId;
+  GstBuffer *mLastBuffer;
+  gint64 mLastPassedTime;
+  gint64 mKeepAliveInterval;
+
+  std::atomic<guint64> mPassedCount;
+  std::atomic<guint64> mSkippedCount;
+
+  bool isSameFrame(GstBuffer *buffer);
+
+  static GstPadProbeReturn onProbe(GstPad *pad, GstPadProbeInfo *info, gpointer userData);
+
+public:
+  FrameSkipper();
+  virtual ~FrameSkipper();
+
+  FrameSkipper(const FrameSkipper&) = delete;
+  FrameSkipper& operator=(const FrameSkipper&) = delete;
+
+  /**
+   * 映像ソースの src パッドにプローブを設定します。
+   *
+   * @param pad 未圧縮の映像が流れるパッド
+   * @param keepAliveInterval 変化がなくてもフレームを渡す間隔 (ミリ秒)
+   */
+  void attach(GstPad *pad, guint keepAliveInterval);
+  void detach();
+
+  inline guint64 getPassedCount() const {
+    return mPassedCount;
+  }
+
+  inline guint64 getSkippedCount() const {
+    return mSkippedCount;
+  }
+};
@@ -0,0 +1,147 @@
+#include "gst-loopback-signaling.h"
+
+LoopbackSignalingHub::LoopbackSignalingHub()
+{
+  mTargetedRouting = false;
+}
+
+LoopbackSignalingHub::~LoopbackSignalingHub()
+{
+}
+
+void LoopbackSignalingHub::attach(LoopbackSignalingTransport *transport)
+{
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mTransports[transport->getPeerId()] = transport;
+  }
+  broadcast(transport->getPeerId(), "playerConnected");
+}
+
+void LoopbackSignalingHub::detach(LoopbackSignalingTransport *transport)
+{
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto itr = mTransports.find(transport->getPeerId());
+    if (itr == mTransports.end() || itr->second != transport) {
+      return;
+    }
+    mTransports.erase(itr);
+  }
+  broadcast(transport->getPeerId(), "playerDisconnected");
+}
+
+void LoopbackSignalingHub::route(LoopbackSignalingTransport *transport, const std::string& to, const std::string& message)
+{
+  if (!mTargetedRouting || to.empty()) {
+    broadcast(transport->getPeerId(), message);
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(mMutex);
+  auto itr = mTransports.find(to);
+  if (itr != mTransports.end()) {
+    itr->second->deliver(transport->getPeerId(), message);
+  }
+}
+
+// private functions.
+
+void LoopbackSignalingHub::broadcast(const std::string& from, const std::string& message)
+{
+  // 宛先指定モードでない場合は、app.js と同じく送信元を付けずに届ける
+  std::string peerId = mTargetedRouting ? from : "";
+
+  std::lock_guard<std::mutex> lock(mMutex);
+  for (auto itr = mTransports.begin(); itr != mTransports.end(); ++itr) {
+    if (itr->first != from) {
+      itr->second->deliver(peerId, message);
+    }
+  }
+}
+
+LoopbackSignalingTransport::LoopbackSignalingTransport(LoopbackSignalingHub *hub, std::string& peerId)
+{
+  mHub = hub;
+  mPeerId = peerId;
+  mDispatchSourceId = 0;
+  mConnectedSourceId = 0;
+}
+
+LoopbackSignalingTransport::~LoopbackSignalingTransport()
+{
+  disconnect();
+}
+
+void LoopbackSignalingTransport::connectAsync(std::string& url, std::string& origin)
+{
+  disconnect();
+
+  mHub->attach(this);
+
+  // WebsocketClient と同じく、接続の通知はメインループから行う
+  mConnectedSourceId = g_idle_add(LoopbackSignalingTransport::onConnectedIdle, this);
+}
+
+void LoopbackSignalingTransport::disconnect()
+{
+  mHub->detach(this);
+
+  std::lock_guard<std::mutex> lock(mMutex);
+  if (mConnectedSourceId) {
+    g_source_remove(mConnectedSourceId);
+    mConnectedSourceId = 0;
+  }
+  if (mDispatchSourceId) {
+    g_source_remove(mDispatchSourceId);
+    mDispatchSourceId = 0;
+  }
+  mPendingMessages.clear();
+}
+
+size_t LoopbackSignalingTransport::sendMessage(std::string& peerId, std::string& message)
+{
+  // 封筒は使わずにそのまま渡す
+  mHub->route(this, peerId, message);
+  return message.size();
+}
+
+void LoopbackSignalingTransport::deliver(const std::string& from, const std::string& message)
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+  mPendingMessages.push_back({from, message});
+  if (!mDispatchSourceId) {
+    mDispatchSourceId = g_idle_add(LoopbackSignalingTransport::onDispatch, this);
+  }
+}
+
+// callback static functions.
+
+gboolean LoopbackSignalingTransport::onConnectedIdle(gpointer userData)
+{
+  LoopbackSignalingTransport *transport = (LoopbackSignalingTransport *) userData;
+  transport->mConnectedSourceId = 0;
+  if (transport->mListener) {
+    transport->mListener->onConnected(transport);
+  }
+  return G_SOURCE_REMOVE;
+}
+
+gboolean LoopbackSignalingTransport::onDispatch(gpointer userData)
+{
+  LoopbackSignalingTransport *transport = (LoopbackSignalingTransport *) userData;
+
+  std::deque<PendingMessage> messages;
+  {
+    std::lock_guard<std::mutex> lock(transport->mMutex);
+    messages.swap(transport->mPendingMessages);
+    transport->mDispatchSourceId = 0;
+  }
+
+  for (auto itr = messages.begin(); itr != messages.end(); ++itr) {
+    if (transport->mListener) {
+      transport->mListener->onMessage(transport, itr->peerId, itr->message, itr->message.size());
+    }
+  }
+  return G_SOURCE_REMOVE;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <glib.h>
+
+#include "gst-signaling-transport.h"
+
+class LoopbackSignalingTransport;
+
+/**
+ * 同一プロセス内の LoopbackSignalingTransport 同士でシグナリングのメッセージを中継します。
+ * 
+ * signaling/src/app.js と同じように、接続・切断時には他のピアに
+ * playerConnected / playerDisconnected を通知します。
+ * 宛先指定モードが有効な場合には、宛先のピアにだけメッセージを届けます。
+ */
+class LoopbackSignalingHub {
+private:
+  std::mutex mMutex;
+  std::map<std::string, LoopbackSignalingTransport*> mTransports;
+  bool mTargetedRouting;
+
+  void broadcast(const std::string& from, const std::string& message);
+
+public:
+  LoopbackSignalingHub();
+  virtual ~LoopbackSignalingHub();
+
+  inline void setTargetedRouting(bool targeted) {
+    mTargetedRouting = targeted;
+  }
+
+  void attach(LoopbackSignalingTransport *transport);
+  void detach(LoopbackSignalingTransport *transport);
+  void route(LoopbackSignalingTransport *transport, const std::string& to, const std::string& message);
+};
+
+class LoopbackSignalingTransport : public SignalingTransport {
+private:
+  struct PendingMessage {
+    std::string peerId;
+    std::string message;
+  };
+
+  LoopbackSignalingHub *mHub;
+  std::string mPeerId;
+
+  std::mutex mMutex;
+  std::deque<PendingMessage> mPendingMessages;
+  guint mDispatchSourceId;
+  guint mConnectedSourceId;
+
+  static gboolean onDispatch(gpointer userData);
+  static gboolean onConnectedIdle(gpointer userData);
+
+public:
+  LoopbackSignalingTransport(LoopbackSignalingHub *hub, std::string& peerId);
+  virtual ~LoopbackSignalingTransport();
+
+  inline const std::string& getPeerId() const {
+    return mPeerId;
+  }
+
+  // 他のピアから届いたメッセージをメインループで通知するためにキューに積みます。
+  void deliver(const std::string& from, const std::string& message);
+
+  // SignalingTransport implements.
+  virtual void connectAsync(std::string& url, std::string& origin);
+  virtual void disconnect();
+  virtual size_t sendMessage(std::string& peerId, std::string& message);
+};
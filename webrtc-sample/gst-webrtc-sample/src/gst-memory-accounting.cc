@@ -0,0 +1,183 @@
+#include "gst-memory-accounting.h"
+#include "gst-counting-allocator.h"
+
+#include <string.h>
+#include <unistd.h>
+
+MemoryAccounting::MemoryAccounting()
+{
+  mStartResidentBytes = 0;
+  mStartAllocatedBytes = 0;
+  mStartAllocationCount = 0;
+}
+
+MemoryAccounting::~MemoryAccounting()
+{
+  detach();
+}
+
+void MemoryAccounting::attach(GstElement *pipeline)
+{
+  detach();
+
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  mStartResidentBytes = getResidentBytes();
+  mStartAllocatedBytes = CountingAllocator::getLiveBytes();
+  mStartAllocationCount = CountingAllocator::getAllocationCount();
+
+  GstIterator *itr = gst_bin_iterate_recurse(GST_BIN(pipeline));
+  GValue item = G_VALUE_INIT;
+  while (gst_iterator_next(itr, &item) == GST_ITERATOR_OK) {
+    GstElement *element = GST_ELEMENT(g_value_get_object(&item));
+    GstElementFactory *factory = gst_element_get_factory(element);
+    const gchar *factoryName = factory ? gst_plugin_feature_get_name(GST_PLUGIN_FEATURE(factory)) : "";
+
+    // webrtcbin の中の bin も列挙されるので、パッドを持つ要素だけを対象にする
+    GstPad *src = gst_element_get_static_pad(element, "src");
+
+    std::unique_ptr<ElementEntry> entry(new ElementEntry());
+    entry->element = element;
+    entry->name = GST_OBJECT_NAME(element);
+    entry->factoryName = factoryName;
+    entry->isQueue = strcmp(factoryName, "queue") == 0;
+    entry->peakQueuedBytes = 0;
+    entry->poolBufferSize = 0;
+    entry->poolMinBuffers = 0;
+    entry->poolMaxBuffers = 0;
+
+    if (src) {
+      if (entry->isQueue) {
+        addProbe(src, GST_PAD_PROBE_TYPE_BUFFER, MemoryAccounting::onQueueProbe, entry.get());
+      }
+      // クエリの応答を受け取るために PULL を指定する
+      addProbe(src, (GstPadProbeType) (GST_PAD_PROBE_TYPE_QUERY_DOWNSTREAM | GST_PAD_PROBE_TYPE_PULL),
+          MemoryAccounting::onAllocationQueryProbe, entry.get());
+      gst_object_unref(src);
+    }
+
+    mElements.push_back(std::move(entry));
+    g_value_reset(&item);
+  }
+  g_value_unset(&item);
+  gst_iterator_free(itr);
+}
+
+void MemoryAccounting::report(const std::string& name)
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  if (mElements.empty()) {
+    return;
+  }
+
+  guint64 total = 0;
+  g_print("Memory of %s:\n", name.c_str());
+  for (auto itr = mElements.begin(); itr != mElements.end(); ++itr) {
+    ElementEntry *entry = itr->get();
+    guint64 poolBytes = (guint64) entry->poolBufferSize * entry->poolMinBuffers;
+    if (entry->peakQueuedBytes == 0 && entry->poolBufferSize == 0) {
+      continue;
+    }
+    g_print("  %-24s %-16s queue %10" G_GUINT64_FORMAT " bytes, pool %u x %u-%u (%" G_GUINT64_FORMAT " bytes)\n",
+        entry->name.c_str(), entry->factoryName.c_str(), entry->peakQueuedBytes,
+        entry->poolBufferSize, entry->poolMinBuffers, entry->poolMaxBuffers, poolBytes);
+    total += entry->peakQueuedBytes + poolBytes;
+  }
+
+  g_print("  elements total %" G_GUINT64_FORMAT " bytes, rss %+" G_GINT64_FORMAT " bytes",
+      total, getResidentBytes() - mStartResidentBytes);
+  if (CountingAllocator::isInstalled()) {
+    g_print(", allocator %+" G_GINT64_FORMAT " bytes (%" G_GUINT64_FORMAT " allocations, peak %" G_GINT64_FORMAT " bytes)",
+        CountingAllocator::getLiveBytes() - mStartAllocatedBytes,
+        CountingAllocator::getAllocationCount() - mStartAllocationCount,
+        CountingAllocator::getPeakBytes());
+  }
+  g_print("\n");
+}
+
+void MemoryAccounting::detach()
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  for (auto itr = mProbes.begin(); itr != mProbes.end(); ++itr) {
+    gst_pad_remove_probe(itr->pad, itr->probeId);
+    gst_object_unref(itr->pad);
+  }
+  mProbes.clear();
+  mElements.clear();
+}
+
+guint64 MemoryAccounting::getElementBytes()
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  guint64 total = 0;
+  for (auto itr = mElements.begin(); itr != mElements.end(); ++itr) {
+    ElementEntry *entry = itr->get();
+    total += entry->peakQueuedBytes + (guint64) entry->poolBufferSize * entry->poolMinBuffers;
+  }
+  return total;
+}
+
+gint64 MemoryAccounting::getResidentBytes()
+{
+  gchar *contents = NULL;
+  if (!g_file_get_contents("/proc/self/statm", &contents, NULL, NULL)) {
+    return 0;
+  }
+
+  // statm は "size resident shared ..." をページ数で記述している
+  unsigned long size = 0;
+  unsigned long resident = 0;
+  gint64 bytes = 0;
+  if (sscanf(contents, "%lu %lu", &size, &resident) == 2) {
+    bytes = (gint64) resident * sysconf(_SC_PAGESIZE);
+  }
+  g_free(contents);
+  return bytes;
+}
+
+// private functions.
+
+void MemoryAccounting::addProbe(GstPad *pad, GstPadProbeType type, GstPadProbeCallback callback, ElementEntry *entry)
+{
+  gulong probeId = gst_pad_add_probe(pad, type, callback, entry, NULL);
+  if (probeId) {
+    mProbes.push_back({ (GstPad *) gst_object_ref(pad), probeId });
+  }
+}
+
+// callback functions.
+
+GstPadProbeReturn MemoryAccounting::onQueueProbe(GstPad *pad, GstPadProbeInfo *info, gpointer userData)
+{
+  // ストリーミングスレッドから呼ばれる。値は最大値の更新だけなので、多少の競合は許容する
+  ElementEntry *entry = (ElementEntry *) userData;
+  guint level = 0;
+  g_object_get(entry->element, "current-level-bytes", &level, NULL);
+  entry->peakQueuedBytes = MAX(entry->peakQueuedBytes, (guint64) level);
+  return GST_PAD_PROBE_OK;
+}
+
+GstPadProbeReturn MemoryAccounting::onAllocationQueryProbe(GstPad *pad, GstPadProbeInfo *info, gpointer userData)
+{
+  GstQuery *query = GST_PAD_PROBE_INFO_QUERY(info);
+  if (GST_QUERY_TYPE(query) != GST_QUERY_ALLOCATION || gst_query_get_n_allocation_pools(query) == 0) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  ElementEntry *entry = (ElementEntry *) userData;
+  GstBufferPool *pool = NULL;
+  guint size = 0;
+  guint min = 0;
+  guint max = 0;
+  gst_query_parse_nth_allocation_pool(query, 0, &pool, &size, &min, &max);
+  entry->poolBufferSize = size;
+  entry->poolMinBuffers = min;
+  entry->poolMaxBuffers = max;
+  if (pool) {
+    gst_object_unref(pool);
+  }
+  return GST_PAD_PROBE_OK;
+}
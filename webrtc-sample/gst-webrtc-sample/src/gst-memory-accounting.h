@@ -0,0 +1,78 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <gst/gst.h>
+
+/**
+ * 1 セッションのパイプラインが使用しているメモリを要素ごとに集計します。
+ *
+ * - queue: src パッドにバッファが流れるたびに current-level-bytes を取得して、最大値を記録
+ * - バッファプール: ALLOCATION クエリの結果からプールのバッファサイズと最小・最大数を記録
+ * - 全体: 開始時からの RSS と CountingAllocator で確保したバイト数の差分
+ *
+ * RSS と CountingAllocator の値はプロセス全体の値なので、
+ * 同時に複数のセッションがある場合は他のセッションの分も含まれます。
+ */
+class MemoryAccounting {
+private:
+  struct ElementEntry {
+    GstElement *element;
+    std::string name;
+    std::string factoryName;
+    bool isQueue;
+    guint64 peakQueuedBytes;
+    guint poolBufferSize;
+    guint poolMinBuffers;
+    guint poolMaxBuffers;
+  };
+
+  struct ProbeEntry {
+    GstPad *pad;
+    gulong probeId;
+  };
+
+  std::mutex mMutex;
+  std::vector<std::unique_ptr<ElementEntry>> mElements;
+  std::vector<ProbeEntry> mProbes;
+
+  gint64 mStartResidentBytes;
+  gint64 mStartAllocatedBytes;
+  guint64 mStartAllocationCount;
+
+  void addProbe(GstPad *pad, GstPadProbeType type, GstPadProbeCallback callback, ElementEntry *entry);
+
+  static GstPadProbeReturn onQueueProbe(GstPad *pad, GstPadProbeInfo *info, gpointer userData);
+  static GstPadProbeReturn onAllocationQueryProbe(GstPad *pad, GstPadProbeInfo *info, gpointer userData);
+
+public:
+  MemoryAccounting();
+  virtual ~MemoryAccounting();
+
+  MemoryAccounting(const MemoryAccounting&) = delete;
+  MemoryAccounting& operator=(const MemoryAccounting&) = delete;
+
+  inline bool isAttached() const {
+    return !mElements.empty();
+  }
+
+  /**
+   * パイプラインの要素にプローブを設定します。
+   *
+   * バッファプールは caps のネゴシエーション時に決まるので、PLAYING にする前に呼び出してください。
+   */
+  void attach(GstElement *pipeline);
+
+  // 集計結果を出力します。
+  void report(const std::string& name);
+
+  void detach();
+
+  // queue の最大値とバッファプールの最小数分のバイト数の合計
+  guint64 getElementBytes();
+
+  // プロセスの RSS (バイト)、取得できない場合は 0
+  static gint64 getResidentBytes();
+};
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * 再利用可能なオブジェクトを保持するプール。
+ * 
+ * 解放されたオブジェクトは削除せずに保持しておき、次の acquire で再利用します。
+ * 定常状態では new が発生しないことを allocationCount で確認できます。
+ * 
+ * プールに返却する前に、オブジェクトの状態は呼び出し側でリセットしておく必要があります。
+ */
+template <typename T>
+class ObjectPool {
+private:
+  std::vector<T*> mFreeObjects;
+  size_t mMaxFreeObjects;
+  size_t mAllocationCount;
+  size_t mAcquireCount;
+
+public:
+  ObjectPool(size_t maxFreeObjects = 16) {
+    mMaxFreeObjects = maxFreeObjects;
+    mAllocationCount = 0;
+    mAcquireCount = 0;
+    mFreeObjects.reserve(maxFreeObjects);
+  }
+
+  virtual ~ObjectPool() {
+    for (auto itr = mFreeObjects.begin(); itr != mFreeObjects.end(); ++itr) {
+      delete *itr;
+    }
+    mFreeObjects.clear();
+  }
+
+  ObjectPool(const ObjectPool&) = delete;
+  ObjectPool& operator=(const ObjectPool&) = delete;
+
+  T *acquire() {
+    mAcquireCount++;
+    if (!mFreeObjects.empty()) {
+      T *object = mFreeObjects.back();
+      mFreeObjects.pop_back();
+      return object;
+    }
+    mAllocationCount++;
+    return new T();
+  }
+
+  void release(T *object) {
+    if (!object) {
+      return;
+    }
+    if (mFreeObjects.size() < mMaxFreeObjects) {
+      mFreeObjects.push_back(object);
+    } else {
+      delete object;
+    }
+  }
+
+  // これまでに new したオブジェクトの数
+  inline size_t getAllocationCount() const {
+    return mAllocationCount;
+  }
+
+  // これまでに acquire が呼び出された回数
+  inline size_t getAcquireCount() const {
+    return mAcquireCount;
+  }
+
+  inline size_t getFreeCount() const {
+    return mFreeObjects.size();
+  }
+};
@@ -0,0 +1,58 @@
+#include "gst-port-allocator.h"
+
+UdpPortAllocator::UdpPortAllocator()
+{
+  mMinPort = 0;
+  mNext = 0;
+}
+
+UdpPortAllocator::~UdpPortAllocator()
+{
+}
+
+void UdpPortAllocator::setRange(guint minPort, guint maxPort)
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+  mMinPort = minPort;
+  mNext = 0;
+  mUsed.clear();
+  if (minPort > 0 && maxPort >= minPort) {
+    mUsed.resize(maxPort - minPort + 1, false);
+  }
+}
+
+guint UdpPortAllocator::acquire()
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  // 直前に解放したポートをすぐに再利用しないように、前回の続きから探す
+  for (size_t i = 0; i < mUsed.size(); i++) {
+    size_t index = (mNext + i) % mUsed.size();
+    if (!mUsed[index]) {
+      mUsed[index] = true;
+      mNext = (index + 1) % mUsed.size();
+      return mMinPort + (guint) index;
+    }
+  }
+  return 0;
+}
+
+void UdpPortAllocator::release(guint port)
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+  if (port >= mMinPort && port - mMinPort < mUsed.size()) {
+    mUsed[port - mMinPort] = false;
+  }
+}
+
+size_t UdpPortAllocator::getAvailableCount()
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+  size_t count = 0;
+  for (auto itr = mUsed.begin(); itr != mUsed.end(); ++itr) {
+    if (!*itr) {
+      count++;
+    }
+  }
+  return count;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <mutex>
+#include <vector>
+#include <glib.h>
+
+/**
+ * 指定された範囲の UDP ポートをセッションごとに 1 つずつ割り当てます。
+ * 
+ * max-bundle と rtcp-mux により 1 セッションの通信は 1 つのポートにまとまるので、
+ * セッションごとにポートを 1 つだけ割り当てることで、ファイアウォールで開けるポートの範囲をセッション数と同じにします。
+ * 
+ * 全てのセッションで 1 つのポートを共有することはできません。
+ * webrtcbin の ICE エージェント (libnice) はセッションごとに自分のソケットを作成し、
+ * 他のエージェントのソケットを使ったり、ufrag で振り分けたりする方法がないためです。
+ */
+class UdpPortAllocator {
+private:
+  std::mutex mMutex;
+  guint mMinPort;
+  std::vector<bool> mUsed;
+  size_t mNext;
+
+public:
+  UdpPortAllocator();
+  virtual ~UdpPortAllocator();
+
+  void setRange(guint minPort, guint maxPort);
+
+  // 空いているポートを返します。空いていない場合は 0 を返します。
+  guint acquire();
+  void release(guint port);
+
+  size_t getAvailableCount();
+};
@@ -0,0 +1,147 @@
+#include "gst-process-lifecycle.h"
+
+#include <signal.h>
+#include <unistd.h>
+#include <glib-unix.h>
+#include <glib/gstdio.h>
+
+ProcessLifecycle::ProcessLifecycle(WebRTCMain *main, GMainLoop *loop)
+{
+  mMain = main;
+  mLoop = loop;
+  mTakeover = false;
+  mDrainTimeout = 300;
+  mTerminateSourceId = 0;
+  mInterruptSourceId = 0;
+  mHandoffSourceId = 0;
+}
+
+ProcessLifecycle::~ProcessLifecycle()
+{
+  stop();
+}
+
+void ProcessLifecycle::start()
+{
+  mMain->setListener(this);
+
+  mTerminateSourceId = g_unix_signal_add(SIGTERM, ProcessLifecycle::onTerminate, this);
+  mInterruptSourceId = g_unix_signal_add(SIGINT, ProcessLifecycle::onTerminate, this);
+  mHandoffSourceId = g_unix_signal_add(SIGUSR1, ProcessLifecycle::onHandoff, this);
+
+  // 引き継ぐ場合は、前のプロセスに要求を送った時に書き換える
+  if (!mTakeover && !mPidFile.empty()) {
+    writePidFile();
+  }
+}
+
+void ProcessLifecycle::stop()
+{
+  if (mTerminateSourceId) {
+    g_source_remove(mTerminateSourceId);
+    mTerminateSourceId = 0;
+  }
+  if (mInterruptSourceId) {
+    g_source_remove(mInterruptSourceId);
+    mInterruptSourceId = 0;
+  }
+  if (mHandoffSourceId) {
+    g_source_remove(mHandoffSourceId);
+    mHandoffSourceId = 0;
+  }
+
+  // 後継のプロセスが書き換えている場合は削除しない
+  if (!mPidFile.empty() && readPidFile() == (gint) getpid()) {
+    g_unlink(mPidFile.c_str());
+  }
+
+  mMain->setListener(nullptr);
+}
+
+// private functions.
+
+bool ProcessLifecycle::writePidFile()
+{
+  // g_file_set_contents は一時ファイルに書き込んでから置き換えるので、読み込み側が途中の内容を見ることはない
+  std::string pid = std::to_string(getpid()) + "\n";
+  GError *error = NULL;
+  if (!g_file_set_contents(mPidFile.c_str(), pid.c_str(), pid.size(), &error)) {
+    g_printerr("Failed to write pid file %s: %s\n", mPidFile.c_str(), error->message);
+    g_error_free(error);
+    return false;
+  }
+  return true;
+}
+
+gint ProcessLifecycle::readPidFile()
+{
+  gchar *contents = NULL;
+  if (!g_file_get_contents(mPidFile.c_str(), &contents, NULL, NULL)) {
+    return 0;
+  }
+  gint pid = (gint) g_ascii_strtoll(contents, NULL, 10);
+  g_free(contents);
+  return pid;
+}
+
+/**
+ * PID ファイルに書かれている前のプロセスに引き継ぎを要求します。
+ * 
+ * 自分のシグナリングの接続が完了してから呼び出すので、新しい接続先を受け付けられない時間はありません。
+ */
+void ProcessLifecycle::takeover()
+{
+  gint pid = readPidFile();
+  if (pid > 0 && pid != (gint) getpid()) {
+    if (kill(pid, SIGUSR1) == 0) {
+      g_print("Took over from process %d.\n", pid);
+    } else {
+      g_printerr("Process %d in %s is not running, starting fresh.\n", pid, mPidFile.c_str());
+    }
+  }
+  writePidFile();
+}
+
+void ProcessLifecycle::drain(bool rejectNewPlayers)
+{
+  mMain->startDrain(mDrainTimeout, rejectNewPlayers);
+}
+
+// callback functions.
+
+gboolean ProcessLifecycle::onTerminate(gpointer userData)
+{
+  ProcessLifecycle *lifecycle = (ProcessLifecycle *) userData;
+  if (lifecycle->mMain->isDraining()) {
+    g_print("Terminating without waiting for %zu sessions.\n", lifecycle->mMain->getSessionCount());
+    g_main_loop_quit(lifecycle->mLoop);
+  } else {
+    lifecycle->drain(true);
+  }
+  return G_SOURCE_CONTINUE;
+}
+
+gboolean ProcessLifecycle::onHandoff(gpointer userData)
+{
+  ProcessLifecycle *lifecycle = (ProcessLifecycle *) userData;
+  g_print("Handing off new sessions to the next process.\n");
+  lifecycle->drain(false);
+  return G_SOURCE_CONTINUE;
+}
+
+// WebRTCMainListener implements.
+
+void ProcessLifecycle::onSignalingConnected(WebRTCMain *main)
+{
+  // 再接続した場合には引き継ぎを繰り返さない
+  if (mTakeover && !mPidFile.empty()) {
+    mTakeover = false;
+    takeover();
+  }
+}
+
+void ProcessLifecycle::onDrained(WebRTCMain *main)
+{
+  g_print("All sessions finished, exiting.\n");
+  g_main_loop_quit(mLoop);
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <string>
+#include <glib.h>
+
+#include "gst-webrtc-main.h"
+
+/**
+ * プロセスの終了と、新しいプロセスへの引き継ぎを管理します。
+ *
+ * - SIGTERM, SIGINT: ドレインを開始し、全てのセッションが終了したらメインループを終了します。
+ *   新しい接続先には reject を通知します。ドレイン中にもう一度受け取った場合はすぐに終了します。
+ * - SIGUSR1: 後継のプロセスからの引き継ぎの要求です。新しい接続先は後継のプロセスが受け付けるので、
+ *   何も通知せずに無視してドレインします。
+ *
+ * 引き継ぎを行う場合、後継のプロセスは自分のシグナリングの接続が完了してから、
+ * PID ファイルに書かれている前のプロセスに SIGUSR1 を送り、PID ファイルを自分の PID で書き換えます。
+ * 前のプロセスは配信中のセッションが終了するまで動き続けるので、視聴中の接続は切れません。
+ */
+class ProcessLifecycle : public WebRTCMainListener {
+private:
+  WebRTCMain *mMain;
+  GMainLoop *mLoop;
+  std::string mPidFile;
+  bool mTakeover;
+  guint mDrainTimeout;
+  guint mTerminateSourceId;
+  guint mInterruptSourceId;
+  guint mHandoffSourceId;
+
+  bool writePidFile();
+  gint readPidFile();
+  void takeover();
+  void drain(bool rejectNewPlayers);
+
+  static gboolean onTerminate(gpointer userData);
+  static gboolean onHandoff(gpointer userData);
+
+public:
+  ProcessLifecycle(WebRTCMain *main, GMainLoop *loop);
+  virtual ~ProcessLifecycle();
+
+  // 自分の PID を書き込むファイル、空の場合は使用しません。
+  inline void setPidFile(const std::string& path) {
+    mPidFile = path;
+  }
+
+  // シグナリングサーバに接続した後に、PID ファイルに書かれているプロセスから引き継ぐ
+  inline void setTakeover(bool takeover) {
+    mTakeover = takeover;
+  }
+
+  // ドレインでセッションの終了を待つ最大時間 (秒)、0 の場合は無制限
+  inline void setDrainTimeout(guint timeout) {
+    mDrainTimeout = timeout;
+  }
+
+  void start();
+  void stop();
+
+  // WebRTCMainListener implements.
+  virtual void onSignalingConnected(WebRTCMain *main);
+  virtual void onDrained(WebRTCMain *main);
+};
@@ -0,0 +1,159 @@
+#include "gst-rpc-codec.h"
+#include <gio/gio.h>
+
+void RpcCodec::writeVarint(std::string& out, guint64 value)
+{
+  while (value >= 0x80) {
+    out.push_back((char) ((value & 0x7F) | 0x80));
+    value >>= 7;
+  }
+  out.push_back((char) value);
+}
+
+bool RpcCodec::readVarint(const guint8 *&data, const guint8 *end, guint64& value)
+{
+  value = 0;
+  for (guint shift = 0; shift < 64 && data < end; shift += 7) {
+    guint8 byte = *data++;
+    value |= (guint64) (byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void RpcCodec::encode(const RpcFrame& frame, std::string& out, gsize compressThreshold)
+{
+  guint8 type = frame.type & 0x0F;
+
+  // 圧縮しても小さくならない場合は、そのまま送る
+  std::string compressed;
+  bool useCompressed = compressThreshold > 0
+      && frame.payload.size() >= compressThreshold
+      && compress(frame.payload, compressed)
+      && compressed.size() < frame.payload.size();
+  if (useCompressed) {
+    type |= RPC_FRAME_FLAG_COMPRESSED;
+  }
+  const std::string& payload = useCompressed ? compressed : frame.payload;
+
+  out.push_back((char) type);
+  writeVarint(out, frame.requestId);
+  writeVarint(out, frame.code);
+  writeVarint(out, payload.size());
+  out.append(payload);
+}
+
+bool RpcCodec::decode(const guint8 *data, gsize size, std::vector<RpcFrame>& frames)
+{
+  const guint8 *end = data + size;
+  gsize budget = RPC_MAX_MESSAGE_SIZE;
+  while (data < end) {
+    RpcFrame frame;
+    guint8 type = *data++;
+    guint64 code = 0;
+    guint64 length = 0;
+    if (!readVarint(data, end, frame.requestId)
+        || !readVarint(data, end, code)
+        || !readVarint(data, end, length)
+        || code > G_MAXUINT32
+        || length > RPC_MAX_PAYLOAD_SIZE
+        || length > (guint64) (end - data)) {
+      return false;
+    }
+
+    frame.type = type & 0x0F;
+    frame.code = (guint32) code;
+    if (type & RPC_FRAME_FLAG_COMPRESSED) {
+      if (!decompress(data, length, MIN(budget, (gsize) RPC_MAX_PAYLOAD_SIZE), frame.payload)) {
+        return false;
+      }
+    } else {
+      if (length > budget) {
+        return false;
+      }
+      frame.payload.assign((const char *) data, length);
+    }
+    data += length;
+    budget -= frame.payload.size();
+
+    frames.push_back(std::move(frame));
+  }
+  return true;
+}
+
+// private functions.
+
+bool RpcCodec::compress(const std::string& input, std::string& output)
+{
+  GZlibCompressor *compressor = g_zlib_compressor_new(G_ZLIB_COMPRESSOR_FORMAT_RAW, -1);
+
+  output.resize(input.size() + 64);
+  gsize bytesRead = 0;
+  gsize bytesWritten = 0;
+  GError *error = NULL;
+  GConverterResult result = g_converter_convert(G_CONVERTER(compressor),
+      input.data(), input.size(), &output[0], output.size(),
+      G_CONVERTER_INPUT_AT_END, &bytesRead, &bytesWritten, &error);
+  g_object_unref(compressor);
+
+  // 出力先に収まらないほど大きくなる場合は圧縮しない
+  if (error) {
+    g_error_free(error);
+    return false;
+  }
+  if (result != G_CONVERTER_FINISHED) {
+    return false;
+  }
+  output.resize(bytesWritten);
+  return true;
+}
+
+bool RpcCodec::decompress(const guint8 *data, gsize size, gsize limit, std::string& output)
+{
+  if (limit == 0) {
+    output.clear();
+    return false;
+  }
+
+  GZlibDecompressor *decompressor = g_zlib_decompressor_new(G_ZLIB_COMPRESSOR_FORMAT_RAW);
+
+  // 展開後のサイズは分からないので、limit までバッファを広げながら展開する
+  gsize length = 0;
+  output.resize(MIN(size * 4 + 64, limit));
+
+  bool success = false;
+  while (true) {
+    gsize bytesRead = 0;
+    gsize bytesWritten = 0;
+    GError *error = NULL;
+    GConverterResult result = g_converter_convert(G_CONVERTER(decompressor),
+        data, size, &output[length], output.size() - length,
+        G_CONVERTER_INPUT_AT_END, &bytesRead, &bytesWritten, &error);
+    data += bytesRead;
+    size -= bytesRead;
+    length += bytesWritten;
+
+    if (result == G_CONVERTER_FINISHED) {
+      success = true;
+      break;
+    }
+
+    bool noSpace = error && g_error_matches(error, G_IO_ERROR, G_IO_ERROR_NO_SPACE);
+    if (error) {
+      g_error_free(error);
+    }
+    if (result == G_CONVERTER_ERROR && !noSpace) {
+      break;
+    }
+    if (output.size() >= limit) {
+      break;
+    }
+    output.resize(MIN(output.size() * 2, limit));
+  }
+  g_object_unref(decompressor);
+
+  output.resize(success ? length : 0);
+  return success;
+}
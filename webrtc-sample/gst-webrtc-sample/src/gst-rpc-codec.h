@@ -0,0 +1,79 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <glib.h>
+
+// フレームの種類
+enum RpcFrameType {
+  RPC_FRAME_REQUEST = 0,
+  RPC_FRAME_RESPONSE = 1,
+  RPC_FRAME_ERROR = 2
+};
+
+// ペイロードが raw deflate で圧縮されていることを示すフラグ
+#define RPC_FRAME_FLAG_COMPRESSED 0x80
+
+// 1 フレームのペイロードの最大サイズ (展開後)
+#define RPC_MAX_PAYLOAD_SIZE (1024 * 1024)
+
+// 1 メッセージに含まれる全てのフレームのペイロードの合計の最大サイズ (展開後)
+// 小さい圧縮フレームを大量に並べて、展開後のサイズを膨らませるメッセージを拒否するために使用します。
+#define RPC_MAX_MESSAGE_SIZE (4 * 1024 * 1024)
+
+/**
+ * データチャンネルでやり取りする RPC の 1 フレーム。
+ *
+ * code はリクエストの場合はメソッド ID、エラーの場合はステータス、レスポンスの場合は 0 になります。
+ */
+struct RpcFrame {
+  guint8 type;
+  guint64 requestId;
+  guint32 code;
+  std::string payload;
+};
+
+/**
+ * RPC のフレームのエンコードとデコードを行います。
+ *
+ * 1 フレームは以下の形式で、1 つのメッセージに複数のフレームを続けて入れることができます。
+ *
+ *   type (1 byte) | requestId (varint) | code (varint) | length (varint) | payload
+ *
+ * type の下位 4 bit が RpcFrameType、RPC_FRAME_FLAG_COMPRESSED が立っている場合は
+ * ペイロードが raw deflate で圧縮されています。
+ * varint は protobuf と同じ、下位 7 bit ずつのリトルエンディアンです。
+ */
+class RpcCodec {
+private:
+  static bool compress(const std::string& input, std::string& output);
+  static bool decompress(const guint8 *data, gsize size, gsize limit, std::string& output);
+
+public:
+  static void writeVarint(std::string& out, guint64 value);
+
+  /**
+   * varint を読み込みます。
+   *
+   * @param data 読み込む位置、読み込んだ分だけ進めます
+   * @param end データの終端
+   * @param value 読み込んだ値
+   * @return 読み込めた場合は true、データが途中で切れている場合や 64 bit を超える場合は false
+   */
+  static bool readVarint(const guint8 *&data, const guint8 *end, guint64& value);
+
+  /**
+   * フレームをエンコードして out の後ろに追加します。
+   *
+   * @param compressThreshold ペイロードがこのサイズ以上の場合に圧縮を試みます、0 の場合は圧縮しません
+   */
+  static void encode(const RpcFrame& frame, std::string& out, gsize compressThreshold = 0);
+
+  /**
+   * メッセージに含まれるフレームをデコードして frames に追加します。
+   *
+   * @return 全てのフレームをデコードできた場合は true、
+   *         不正なデータが含まれていた場合や展開後の合計が RPC_MAX_MESSAGE_SIZE を超える場合は false
+   */
+  static bool decode(const guint8 *data, gsize size, std::vector<RpcFrame>& frames);
+};
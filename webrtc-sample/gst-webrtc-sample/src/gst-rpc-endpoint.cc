@@ -0,0 +1,149 @@
+#include "gst-rpc-endpoint.h"
+
+RpcEndpoint::RpcEndpoint()
+{
+  mNextRequestId = 1;
+  mCompressThreshold = 0;
+  mBatchDepth = 0;
+}
+
+RpcEndpoint::~RpcEndpoint()
+{
+}
+
+void RpcEndpoint::registerMethod(guint32 methodId, RpcHandler handler)
+{
+  std::lock_guard<std::recursive_mutex> lock(mMutex);
+  mHandlers[methodId] = handler;
+}
+
+void RpcEndpoint::unregisterMethod(guint32 methodId)
+{
+  std::lock_guard<std::recursive_mutex> lock(mMutex);
+  mHandlers.erase(methodId);
+}
+
+guint64 RpcEndpoint::call(guint32 methodId, const std::string& request, RpcCallback callback)
+{
+  std::lock_guard<std::recursive_mutex> lock(mMutex);
+
+  RpcFrame frame;
+  frame.type = RPC_FRAME_REQUEST;
+  frame.requestId = mNextRequestId++;
+  frame.code = methodId;
+  frame.payload = request;
+
+  if (callback) {
+    mPendingCalls[frame.requestId] = callback;
+  }
+
+  std::string data;
+  RpcCodec::encode(frame, data, mCompressThreshold);
+  send(data);
+  return frame.requestId;
+}
+
+void RpcEndpoint::beginBatch()
+{
+  std::lock_guard<std::recursive_mutex> lock(mMutex);
+  mBatchDepth++;
+}
+
+void RpcEndpoint::endBatch()
+{
+  std::lock_guard<std::recursive_mutex> lock(mMutex);
+  if (mBatchDepth == 0) {
+    return;
+  }
+  mBatchDepth--;
+  if (mBatchDepth == 0 && !mBatch.empty()) {
+    std::string data;
+    data.swap(mBatch);
+    send(data);
+  }
+}
+
+bool RpcEndpoint::receive(const guint8 *data, gsize size)
+{
+  std::vector<RpcFrame> frames;
+  bool valid = RpcCodec::decode(data, size, frames);
+  if (!valid) {
+    g_printerr("Invalid RPC message (%" G_GSIZE_FORMAT " bytes), %zu frames decoded.\n", size, frames.size());
+  }
+
+  // 同じメッセージで受信したリクエストのレスポンスは 1 つのメッセージにまとめて返す
+  beginBatch();
+  for (auto itr = frames.begin(); itr != frames.end(); ++itr) {
+    RpcFrame& frame = *itr;
+    if (frame.type == RPC_FRAME_REQUEST) {
+      RpcHandler handler;
+      {
+        std::lock_guard<std::recursive_mutex> lock(mMutex);
+        auto found = mHandlers.find(frame.code);
+        if (found != mHandlers.end()) {
+          handler = found->second;
+        }
+      }
+
+      RpcFrame response;
+      response.requestId = frame.requestId;
+      guint32 status = handler ? handler(frame.payload, response.payload) : (guint32) RPC_STATUS_UNKNOWN_METHOD;
+      response.type = status == RPC_STATUS_OK ? RPC_FRAME_RESPONSE : RPC_FRAME_ERROR;
+      response.code = status;
+
+      std::string out;
+      RpcCodec::encode(response, out, mCompressThreshold);
+      send(out);
+    } else if (frame.type == RPC_FRAME_RESPONSE || frame.type == RPC_FRAME_ERROR) {
+      RpcCallback callback;
+      {
+        std::lock_guard<std::recursive_mutex> lock(mMutex);
+        auto found = mPendingCalls.find(frame.requestId);
+        if (found != mPendingCalls.end()) {
+          callback = found->second;
+          mPendingCalls.erase(found);
+        }
+      }
+      if (callback) {
+        callback(frame.type == RPC_FRAME_RESPONSE ? (guint32) RPC_STATUS_OK : frame.code, frame.payload);
+      }
+    }
+  }
+  endBatch();
+  return valid;
+}
+
+void RpcEndpoint::cancelAll()
+{
+  std::map<guint64, RpcCallback> calls;
+  {
+    std::lock_guard<std::recursive_mutex> lock(mMutex);
+    calls.swap(mPendingCalls);
+    // バッチの深さは呼び出し側の endBatch で戻すので、溜めていたデータだけ破棄する
+    mBatch.clear();
+  }
+
+  std::string empty;
+  for (auto itr = calls.begin(); itr != calls.end(); ++itr) {
+    itr->second(RPC_STATUS_CANCELLED, empty);
+  }
+}
+
+// private functions.
+
+void RpcEndpoint::send(std::string& data)
+{
+  std::lock_guard<std::recursive_mutex> lock(mMutex);
+  if (mBatchDepth > 0) {
+    // データチャンネルで送れるメッセージのサイズには上限があるので、大きくなりすぎる前に送っておく
+    if (!mBatch.empty() && mBatch.size() + data.size() > RPC_MAX_BATCH_SIZE) {
+      if (mSender) {
+        mSender(mBatch);
+      }
+      mBatch.clear();
+    }
+    mBatch.append(data);
+  } else if (mSender) {
+    mSender(data);
+  }
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <glib.h>
+
+#include "gst-rpc-codec.h"
+
+// まとめて送るメッセージの最大サイズ
+#define RPC_MAX_BATCH_SIZE (64 * 1024)
+
+// RPC のステータス、RPC_STATUS_APPLICATION 以降はメソッドごとに定義します。
+enum RpcStatus {
+  RPC_STATUS_OK = 0,
+  RPC_STATUS_UNKNOWN_METHOD = 1,
+  RPC_STATUS_BAD_REQUEST = 2,
+  RPC_STATUS_CANCELLED = 3,
+  RPC_STATUS_APPLICATION = 16
+};
+
+/**
+ * リクエストを処理するハンドラ。
+ *
+ * response にレスポンスを設定して、ステータスを返します。
+ * RPC_STATUS_OK 以外を返した場合は、response をエラーの詳細として返します。
+ */
+typedef std::function<guint32(const std::string& request, std::string& response)> RpcHandler;
+
+/**
+ * レスポンスを受け取るコールバック。
+ */
+typedef std::function<void(guint32 status, const std::string& response)> RpcCallback;
+
+/**
+ * データチャンネルのバイナリメッセージ上で RPC を行います。
+ *
+ * メソッド ID ごとにハンドラを登録しておくと、受信したリクエストを処理してレスポンスを返します。
+ * call はレスポンスを待たずに返るので、複数のリクエストを同時に送ることができます。
+ * レスポンスはリクエスト ID で対応付けるので、順番が入れ替わっても問題ありません。
+ *
+ * 1 つのメッセージで受信したリクエストのレスポンスは、まとめて 1 つのメッセージで返します。
+ * beginBatch と endBatch の間で call したリクエストも、まとめて 1 つのメッセージで送ります。
+ *
+ * ハンドラとコールバックは receive を呼び出したスレッド (データチャンネルのスレッド) で呼び出されます。
+ */
+class RpcEndpoint {
+private:
+  std::recursive_mutex mMutex;
+  std::function<void(const std::string&)> mSender;
+  std::unordered_map<guint32, RpcHandler> mHandlers;
+  std::map<guint64, RpcCallback> mPendingCalls;
+  guint64 mNextRequestId;
+  gsize mCompressThreshold;
+  guint mBatchDepth;
+  std::string mBatch;
+
+  void send(std::string& data);
+
+public:
+  RpcEndpoint();
+  virtual ~RpcEndpoint();
+
+  RpcEndpoint(const RpcEndpoint&) = delete;
+  RpcEndpoint& operator=(const RpcEndpoint&) = delete;
+
+  // エンコードしたメッセージをデータチャンネルで送信する関数を設定します。
+  inline void setSender(std::function<void(const std::string&)> sender) {
+    std::lock_guard<std::recursive_mutex> lock(mMutex);
+    mSender = sender;
+  }
+
+  // ペイロードがこのサイズ以上の場合に圧縮を試みます。0 の場合は圧縮しません。
+  inline void setCompressThreshold(gsize threshold) {
+    mCompressThreshold = threshold;
+  }
+
+  void registerMethod(guint32 methodId, RpcHandler handler);
+  void unregisterMethod(guint32 methodId);
+
+  /**
+   * リクエストを送信します。
+   *
+   * @param methodId 呼び出すメソッド ID
+   * @param request リクエストのペイロード
+   * @param callback レスポンスを受け取るコールバック、不要な場合は nullptr
+   * @return リクエスト ID
+   */
+  guint64 call(guint32 methodId, const std::string& request, RpcCallback callback);
+
+  void beginBatch();
+  void endBatch();
+
+  // 受信したバイナリメッセージを処理します。不正なメッセージの場合は false を返します。
+  bool receive(const guint8 *data, gsize size);
+
+  // レスポンスを待っている全てのリクエストを RPC_STATUS_CANCELLED で終了させます。
+  void cancelAll();
+
+  inline size_t getPendingCount() {
+    std::lock_guard<std::recursive_mutex> lock(mMutex);
+    return mPendingCalls.size();
+  }
+};
@@ -0,0 +1,135 @@
+#include "gst-rtp-pacer.h"
+
+// 目標ビットレートに対する送信レートの倍率、エンコーダの一時的な超過を許容する
+#define PACING_FACTOR 2.5
+
+// バーストで送信できる最小のバイト数 (RTP 1 パケット分)
+#define PACING_MIN_BURST_BYTES 1200
+
+RtpPacer::RtpPacer()
+{
+  mPad = nullptr;
+  mProbeId = 0;
+  mBitrate = 0;
+  mBurstTime = 0;
+  mMaxDelay = 0;
+  mTokens = 0.0;
+  mLastRefillTime = 0;
+  mPacketCount = 0;
+  mByteCount = 0;
+  mDelayedCount = 0;
+  mCappedCount = 0;
+  mTotalDelay = 0;
+  mMaxObservedDelay = 0;
+}
+
+RtpPacer::~RtpPacer()
+{
+  detach();
+}
+
+void RtpPacer::attach(GstPad *pad, guint64 bitrate, guint burstTime, guint maxDelay)
+{
+  detach();
+
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  mPad = (GstPad *) gst_object_ref(pad);
+  mBitrate = bitrate;
+  mBurstTime = (gint64) burstTime * 1000;
+  mMaxDelay = (gint64) maxDelay * 1000;
+  mTokens = 0.0;
+  mLastRefillTime = 0;
+  mPacketCount = 0;
+  mByteCount = 0;
+  mDelayedCount = 0;
+  mCappedCount = 0;
+  mTotalDelay = 0;
+  mMaxObservedDelay = 0;
+  mProbeId = gst_pad_add_probe(mPad, (GstPadProbeType) (GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST),
+      RtpPacer::onProbe, this, NULL);
+}
+
+void RtpPacer::detach()
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  if (!mPad) {
+    return;
+  }
+
+  if (mProbeId) {
+    gst_pad_remove_probe(mPad, mProbeId);
+    mProbeId = 0;
+  }
+  gst_object_unref(mPad);
+  mPad = nullptr;
+
+  g_print("RTP pacer: %" G_GUINT64_FORMAT " packets, %" G_GUINT64_FORMAT " bytes, %" G_GUINT64_FORMAT
+      " delayed (avg %.2f ms, max %.2f ms), %" G_GUINT64_FORMAT " over max delay\n",
+      mPacketCount, mByteCount, mDelayedCount,
+      mDelayedCount > 0 ? mTotalDelay / 1000.0 / mDelayedCount : 0.0,
+      mMaxObservedDelay / 1000.0, mCappedCount);
+}
+
+// private functions.
+
+gint64 RtpPacer::reserve(gsize size)
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  mPacketCount++;
+  mByteCount += size;
+  if (mBitrate == 0) {
+    return 0;
+  }
+
+  gdouble bytesPerSecond = mBitrate * PACING_FACTOR / 8.0;
+  gdouble burst = MAX(bytesPerSecond * mBurstTime / G_USEC_PER_SEC, (gdouble) PACING_MIN_BURST_BYTES);
+
+  gint64 now = g_get_monotonic_time();
+  if (mLastRefillTime == 0) {
+    mTokens = burst;
+  } else {
+    mTokens = MIN(mTokens + bytesPerSecond * (now - mLastRefillTime) / G_USEC_PER_SEC, burst);
+  }
+  mLastRefillTime = now;
+  mTokens -= size;
+  if (mTokens >= 0.0) {
+    return 0;
+  }
+
+  // 足りないトークンが溜まるまで待つ、maxDelay を超える分は待たずに送信する
+  gint64 delay = (gint64) (-mTokens * G_USEC_PER_SEC / bytesPerSecond);
+  if (delay > mMaxDelay) {
+    mCappedCount++;
+    delay = mMaxDelay;
+    mTokens = -bytesPerSecond * mMaxDelay / G_USEC_PER_SEC;
+  }
+
+  mDelayedCount++;
+  mTotalDelay += delay;
+  mMaxObservedDelay = MAX(mMaxObservedDelay, delay);
+  return delay;
+}
+
+// callback functions.
+
+GstPadProbeReturn RtpPacer::onProbe(GstPad *pad, GstPadProbeInfo *info, gpointer userData)
+{
+  RtpPacer *self = (RtpPacer *) userData;
+
+  gsize size = 0;
+  if (info->type & GST_PAD_PROBE_TYPE_BUFFER) {
+    size = gst_buffer_get_size(GST_PAD_PROBE_INFO_BUFFER(info));
+  } else if (info->type & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+    size = gst_buffer_list_calculate_size(GST_PAD_PROBE_INFO_BUFFER_LIST(info));
+  }
+
+  // このパッドのストリーミングスレッドはパケットを送るだけなので、ここで待ってもエンコーダは止まらない
+  gint64 delay = self->reserve(size);
+  if (delay > 0) {
+    g_usleep(delay);
+  }
+  return GST_PAD_PROBE_OK;
+}
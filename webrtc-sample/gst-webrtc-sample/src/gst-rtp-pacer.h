@@ -0,0 +1,62 @@
+#pragma once
+
+#include <mutex>
+#include <gst/gst.h>
+
+/**
+ * webrtcbin に渡す RTP パケットの送信間隔を、目標ビットレートに合わせて空けます。
+ *
+ * エンコーダが出力したフレームはペイローダーでまとめてパケットになるので、
+ * キーフレームのような大きなフレームは一度に送信され、帯域の狭い回線ではパケットロスになります。
+ * 目標ビットレートの PACING_FACTOR 倍のトークンバケットで、フレームのパケットを送信間隔に分散させます。
+ *
+ * プローブのコールバックで待つので、ペイローダーと webrtcbin の間の queue の src パッドに設定して、
+ * エンコーダとは別のストリーミングスレッドで待つようにします。
+ * 1 パケットが待つ時間は maxDelay までにして、それを超える分はそのまま送信します。
+ */
+class RtpPacer {
+private:
+  std::mutex mMutex;
+  GstPad *mPad;
+  gulong mProbeId;
+
+  guint64 mBitrate;
+  gint64 mBurstTime;
+  gint64 mMaxDelay;
+  gdouble mTokens;
+  gint64 mLastRefillTime;
+
+  // 統計情報、detach の時に出力する
+  guint64 mPacketCount;
+  guint64 mByteCount;
+  guint64 mDelayedCount;
+  guint64 mCappedCount;
+  gint64 mTotalDelay;
+  gint64 mMaxObservedDelay;
+
+  gint64 reserve(gsize size);
+
+  static GstPadProbeReturn onProbe(GstPad *pad, GstPadProbeInfo *info, gpointer userData);
+
+public:
+  RtpPacer();
+  virtual ~RtpPacer();
+
+  RtpPacer(const RtpPacer&) = delete;
+  RtpPacer& operator=(const RtpPacer&) = delete;
+
+  /**
+   * RTP が流れるパッドにプローブを設定します。
+   *
+   * @param pad ペイローダーと webrtcbin の間の queue の src パッド
+   * @param bitrate 目標ビットレート (bps)
+   * @param burstTime 間隔を空けずに送信できる量 (目標ビットレートでのミリ秒)
+   * @param maxDelay 1 パケットを待たせる最大時間 (ミリ秒)
+   */
+  void attach(GstPad *pad, guint64 bitrate, guint burstTime, guint maxDelay);
+  void detach();
+
+  inline bool isAttached() const {
+    return mPad != nullptr;
+  }
+};
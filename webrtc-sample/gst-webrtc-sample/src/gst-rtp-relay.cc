@@ -0,0 +1,75 @@
+#include "gst-rtp-relay.h"
+
+RtpRelay::RtpRelay()
+{
+  mPad = nullptr;
+  mProbeId = 0;
+}
+
+RtpRelay::~RtpRelay()
+{
+  detach();
+}
+
+bool RtpRelay::attach(GstElement *sink, const std::string& host, guint port, UdpBatchSender::Mode mode)
+{
+  detach();
+
+  GstPad *pad = gst_element_get_static_pad(sink, "sink");
+  if (!pad) {
+    return false;
+  }
+
+  if (!mSender.open(host, port, mode)) {
+    gst_object_unref(pad);
+    return false;
+  }
+
+  g_print("Relaying RTP to %s:%u using %s.\n", host.c_str(), port, UdpBatchSender::getModeName(mSender.getMode()));
+
+  mPad = pad;
+  mProbeId = gst_pad_add_probe(mPad,
+      (GstPadProbeType) (GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST),
+      RtpRelay::onProbe, this, NULL);
+  return true;
+}
+
+void RtpRelay::detach()
+{
+  if (mPad) {
+    if (mProbeId) {
+      gst_pad_remove_probe(mPad, mProbeId);
+      mProbeId = 0;
+    }
+    gst_object_unref(mPad);
+    mPad = nullptr;
+
+    g_print("RTP relay: %" G_GUINT64_FORMAT " packets, %" G_GUINT64_FORMAT " syscalls, %" G_GUINT64_FORMAT " dropped\n",
+        (guint64) mSender.getPacketCount(), (guint64) mSender.getSyscallCount(), (guint64) mSender.getDropCount());
+  }
+  mSender.close();
+}
+
+gboolean RtpRelay::addBuffer(GstBuffer **buffer, guint index, gpointer userData)
+{
+  RtpRelay *self = (RtpRelay *) userData;
+  GstMapInfo info;
+  if (gst_buffer_map(*buffer, &info, GST_MAP_READ)) {
+    self->mSender.add(info.data, info.size);
+    gst_buffer_unmap(*buffer, &info);
+  }
+  return TRUE;
+}
+
+GstPadProbeReturn RtpRelay::onProbe(GstPad *pad, GstPadProbeInfo *info, gpointer userData)
+{
+  RtpRelay *self = (RtpRelay *) userData;
+  if (info->type & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+    gst_buffer_list_foreach(GST_PAD_PROBE_INFO_BUFFER_LIST(info), RtpRelay::addBuffer, self);
+  } else {
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    RtpRelay::addBuffer(&buffer, 0, self);
+  }
+  self->mSender.flush();
+  return GST_PAD_PROBE_OK;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <string>
+#include <gst/gst.h>
+
+#include "gst-udp-batch-sender.h"
+
+/**
+ * ペイローダーが出力した RTP パケットを、そのまま UDP で別のホストに転送します。
+ *
+ * RTP のペイローダーは 1 フレーム分のパケットをバッファリストで出力するので、
+ * シンクのパッドにプローブを設定してリスト単位で UdpBatchSender に渡し、1 回のシステムコールで送信します。
+ * シンクの前に queue を置いておけば、送信はその queue のスレッドで行われます。
+ */
+class RtpRelay {
+private:
+  GstPad *mPad;
+  gulong mProbeId;
+  UdpBatchSender mSender;
+
+  static gboolean addBuffer(GstBuffer **buffer, guint index, gpointer userData);
+  static GstPadProbeReturn onProbe(GstPad *pad, GstPadProbeInfo *info, gpointer userData);
+
+public:
+  RtpRelay();
+  virtual ~RtpRelay();
+
+  RtpRelay(const RtpRelay&) = delete;
+  RtpRelay& operator=(const RtpRelay&) = delete;
+
+  inline bool isAttached() const {
+    return mPad != nullptr;
+  }
+
+  /**
+   * sink に流れてくる RTP パケットの転送を開始します。
+   *
+   * @param sink 転送する RTP パケットを受け取るシンク
+   * @param host 転送先のホスト
+   * @param port 転送先のポート番号
+   * @param mode 送信方法
+   * @return 成功した場合は true
+   */
+  bool attach(GstElement *sink, const std::string& host, guint port, UdpBatchSender::Mode mode);
+  void detach();
+};
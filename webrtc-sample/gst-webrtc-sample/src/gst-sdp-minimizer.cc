@@ -0,0 +1,149 @@
+#include "gst-sdp-minimizer.h"
+
+#include <string.h>
+
+// 削除しない RTP ヘッダ拡張
+static const gchar *KEEP_EXTENSIONS[] = {
+  "urn:ietf:params:rtp-hdrext:sdes:mid",
+  "http://www.ietf.org/id/draft-holmer-rmcat-transport-wide-cc-extensions-01",
+};
+
+// inactive の m-line から削除する属性
+static const gchar *INACTIVE_ATTRIBUTES[] = {
+  "fmtp", "rtcp-fb", "extmap", "ssrc", "ssrc-group", "msid",
+};
+
+gchar *SdpMinimizer::minimize(const GstSDPMessage *sdp)
+{
+  GstSDPMessage *copy = NULL;
+  if (gst_sdp_message_copy(sdp, &copy) != GST_SDP_OK) {
+    return gst_sdp_message_as_text(sdp);
+  }
+
+  for (guint i = 0; i < gst_sdp_message_medias_len(copy); i++) {
+    minimizeMedia(gst_sdp_message_get_media_mutable(copy, i));
+  }
+
+  gchar *text = gst_sdp_message_as_text(copy);
+  gst_sdp_message_free(copy);
+  return text;
+}
+
+void SdpMinimizer::compactCandidate(const gchar *candidate, std::string& out)
+{
+  // foundation component transport priority address port typ type の後は名前と値の組
+  gchar **tokens = g_strsplit(candidate, " ", -1);
+  guint len = g_strv_length(tokens);
+
+  out.clear();
+  for (guint i = 0; i < len && i < 8; i++) {
+    if (i > 0) {
+      out += " ";
+    }
+    out += tokens[i];
+  }
+  for (guint i = 8; i + 1 < len; i += 2) {
+    // TCP の候補の種類は接続に必要なので残す
+    if (strcmp(tokens[i], "tcptype") == 0) {
+      out += " ";
+      out += tokens[i];
+      out += " ";
+      out += tokens[i + 1];
+    }
+  }
+  g_strfreev(tokens);
+}
+
+// private functions.
+
+void SdpMinimizer::minimizeMedia(GstSDPMedia *media)
+{
+  bool inactive = isInactive(media);
+  if (inactive) {
+    // 使われない m-line なので、フォーマットは 1 つあればよい
+    while (gst_sdp_media_formats_len(media) > 1) {
+      gst_sdp_media_remove_format(media, gst_sdp_media_formats_len(media) - 1);
+    }
+  }
+
+  // 削除すると後ろの属性の番号がずれるので、後ろから確認する
+  for (guint i = gst_sdp_media_attributes_len(media); i > 0; i--) {
+    const GstSDPAttribute *attr = gst_sdp_media_get_attribute(media, i - 1);
+    bool remove = false;
+
+    if (g_strcmp0(attr->key, "rtpmap") == 0 || g_strcmp0(attr->key, "fmtp") == 0 || g_strcmp0(attr->key, "rtcp-fb") == 0) {
+      remove = !isFormatUsed(media, attr->value);
+    } else if (g_strcmp0(attr->key, "extmap") == 0) {
+      remove = !isExtensionUsed(attr->value);
+    }
+
+    if (inactive) {
+      for (size_t j = 0; j < G_N_ELEMENTS(INACTIVE_ATTRIBUTES); j++) {
+        if (g_strcmp0(attr->key, INACTIVE_ATTRIBUTES[j]) == 0) {
+          remove = true;
+          break;
+        }
+      }
+    }
+
+    if (remove) {
+      gst_sdp_media_remove_attribute(media, i - 1);
+    }
+  }
+}
+
+bool SdpMinimizer::isFormatUsed(const GstSDPMedia *media, const gchar *value)
+{
+  if (!value) {
+    return true;
+  }
+
+  // rtcp-fb の * は全てのフォーマットに対する記述
+  const gchar *end = strchr(value, ' ');
+  size_t len = end ? (size_t) (end - value) : strlen(value);
+  if (len == 1 && value[0] == '*') {
+    return true;
+  }
+
+  for (guint i = 0; i < gst_sdp_media_formats_len(media); i++) {
+    const gchar *format = gst_sdp_media_get_format(media, i);
+    if (strlen(format) == len && strncmp(format, value, len) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool SdpMinimizer::isExtensionUsed(const gchar *value)
+{
+  if (!value) {
+    return true;
+  }
+
+  // extmap:<id>[/<direction>] <uri> [<attributes>]
+  const gchar *uri = strchr(value, ' ');
+  if (!uri) {
+    return true;
+  }
+  uri++;
+  const gchar *end = strchr(uri, ' ');
+  size_t len = end ? (size_t) (end - uri) : strlen(uri);
+
+  for (size_t i = 0; i < G_N_ELEMENTS(KEEP_EXTENSIONS); i++) {
+    if (strlen(KEEP_EXTENSIONS[i]) == len && strncmp(KEEP_EXTENSIONS[i], uri, len) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool SdpMinimizer::isInactive(const GstSDPMedia *media)
+{
+  // max-bundle では bundle-only の m-line もポートが 0 になるので、ポートでは判定しない
+  for (guint i = 0; i < gst_sdp_media_attributes_len(media); i++) {
+    if (g_strcmp0(gst_sdp_media_get_attribute(media, i)->key, "inactive") == 0) {
+      return true;
+    }
+  }
+  return false;
+}
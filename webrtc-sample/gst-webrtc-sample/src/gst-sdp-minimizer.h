@@ -0,0 +1,40 @@
+#pragma once
+
+#include <string>
+#include <gst/sdp/sdp.h>
+
+/**
+ * シグナリングで送信する SDP と ICE の候補から、相手が使わない記述を削除します。
+ *
+ * - m-line のフォーマットにないペイロードタイプの rtpmap, fmtp, rtcp-fb
+ * - mid と transport-cc 以外の RTP ヘッダ拡張 (extmap)
+ * - inactive の m-line では、先頭のフォーマット以外と ssrc などの送信用の記述
+ * - ICE の候補の raddr, rport, generation, ufrag, network-id, network-cost
+ *
+ * 削除するのは送信するテキストだけで、webrtcbin に設定した local description はそのままです。
+ * 相手の answer は送信した offer の範囲で作成されるので、local description との違いは問題になりません。
+ */
+class SdpMinimizer {
+private:
+  static bool isFormatUsed(const GstSDPMedia *media, const gchar *value);
+  static bool isExtensionUsed(const gchar *value);
+  static bool isInactive(const GstSDPMedia *media);
+  static void minimizeMedia(GstSDPMedia *media);
+
+public:
+  /**
+   * SDP を削減したテキストを作成します。
+   *
+   * @param sdp 元の SDP (変更しません)
+   * @return 削減した SDP のテキスト、g_free で解放してください
+   */
+  static gchar *minimize(const GstSDPMessage *sdp);
+
+  /**
+   * ICE の候補の省略できる属性を削除します。
+   *
+   * @param candidate candidate:... の形式の候補
+   * @param out 削減した候補
+   */
+  static void compactCandidate(const gchar *candidate, std::string& out);
+};
@@ -0,0 +1,143 @@
+#include "gst-session-accounting.h"
+#include "gst-webrtc-stats.h"
+
+#include <string.h>
+
+SessionAccounting::SessionAccounting()
+{
+  mCpuUsage = 0.0;
+  mQueuedBytes = 0;
+  mPeakQueuedBytes = 0;
+  mBytesSent = 0;
+  mBitrate = 0;
+  mLastStatsTime = 0;
+}
+
+SessionAccounting::~SessionAccounting()
+{
+  detach();
+}
+
+void SessionAccounting::attach(GstElement *pipeline)
+{
+  detach();
+
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  attachCpuMeter(pipeline, "videoenc", mVideoCpuMeter);
+  attachCpuMeter(pipeline, "audioenc", mAudioCpuMeter);
+
+  // パイプラインの中の queue を全て集めておく
+  GstIterator *itr = gst_bin_iterate_recurse(GST_BIN(pipeline));
+  GValue item = G_VALUE_INIT;
+  while (gst_iterator_next(itr, &item) == GST_ITERATOR_OK) {
+    GstElement *element = GST_ELEMENT(g_value_get_object(&item));
+    GstElementFactory *factory = gst_element_get_factory(element);
+    if (factory && strcmp(gst_plugin_feature_get_name(GST_PLUGIN_FEATURE(factory)), "queue") == 0) {
+      mQueues.push_back((GstElement *) gst_object_ref(element));
+    }
+    g_value_reset(&item);
+  }
+  g_value_unset(&item);
+  gst_iterator_free(itr);
+
+  mCpuUsage = 0.0;
+  mQueuedBytes = 0;
+  mPeakQueuedBytes = 0;
+  mBytesSent = 0;
+  mBitrate = 0;
+  mLastStatsTime = 0;
+}
+
+void SessionAccounting::detach()
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  if (mVideoCpuMeter.isAttached() || mAudioCpuMeter.isAttached()) {
+    g_print("Session resources: cpu %.2f%%, peak queued %" G_GUINT64_FORMAT " bytes, sent %" G_GUINT64_FORMAT " bytes\n",
+        mVideoCpuMeter.getAverageUsage() + mAudioCpuMeter.getAverageUsage(), mPeakQueuedBytes, mBytesSent);
+  }
+  mVideoCpuMeter.detach();
+  mAudioCpuMeter.detach();
+
+  for (auto itr = mQueues.begin(); itr != mQueues.end(); ++itr) {
+    gst_object_unref(*itr);
+  }
+  mQueues.clear();
+}
+
+void SessionAccounting::onStats(const GstStructure *stats)
+{
+  // 映像と音声の送信バイト数を合計する
+  guint64 bytesSent = 0;
+  WebRTCStats::foreach(stats, [&](GstWebRTCStatsType type, const GstStructure *stat) {
+    if (type != GST_WEBRTC_STATS_OUTBOUND_RTP) {
+      return;
+    }
+    guint64 bytes = 0;
+    if (gst_structure_get_uint64(stat, "bytes-sent", &bytes)) {
+      bytesSent += bytes;
+    }
+  });
+
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  guint64 queuedBytes = 0;
+  for (auto itr = mQueues.begin(); itr != mQueues.end(); ++itr) {
+    guint level = 0;
+    g_object_get(*itr, "current-level-bytes", &level, NULL);
+    queuedBytes += level;
+  }
+  mQueuedBytes = queuedBytes;
+  mPeakQueuedBytes = MAX(mPeakQueuedBytes, queuedBytes);
+
+  gint64 now = g_get_monotonic_time();
+  if (mLastStatsTime > 0 && now > mLastStatsTime && bytesSent >= mBytesSent) {
+    mBitrate = (bytesSent - mBytesSent) * 8 * G_USEC_PER_SEC / (guint64) (now - mLastStatsTime);
+  }
+  mBytesSent = bytesSent;
+  mLastStatsTime = now;
+
+  mCpuUsage = mVideoCpuMeter.sampleUsage() + mAudioCpuMeter.sampleUsage();
+}
+
+gdouble SessionAccounting::getCpuUsage()
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mCpuUsage;
+}
+
+guint64 SessionAccounting::getQueuedBytes()
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mQueuedBytes;
+}
+
+guint64 SessionAccounting::getBitrate()
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mBitrate;
+}
+
+guint64 SessionAccounting::getBytesSent()
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mBytesSent;
+}
+
+// private functions.
+
+void SessionAccounting::attachCpuMeter(GstElement *pipeline, const gchar *name, ThreadCpuMeter& meter)
+{
+  // エンコーダの前の queue から先は、そのメディア専用のストリーミングスレッドで処理される
+  GstElement *encoder = gst_bin_get_by_name(GST_BIN(pipeline), name);
+  if (!encoder) {
+    return;
+  }
+  GstPad *pad = gst_element_get_static_pad(encoder, "src");
+  if (pad) {
+    meter.attach(pad);
+    gst_object_unref(pad);
+  }
+  gst_object_unref(encoder);
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <mutex>
+#include <vector>
+#include <gst/gst.h>
+
+#include "gst-thread-cpu-meter.h"
+
+/**
+ * 1 セッションが使用しているリソースを集計します。
+ *
+ * - CPU: 映像と音声のエンコーダ (videoenc, audioenc) から先のストリーミングスレッドの CPU 使用率
+ * - メモリ: パイプラインの中の queue に溜まっているバイト数
+ * - 帯域: webrtcbin の統計情報 (outbound-rtp の bytes-sent) から求めた送信ビットレート
+ *
+ * 値は統計情報を受け取るたびに更新するので、WebRTCPipeline の統計情報の取得間隔ごとの値になります。
+ */
+class SessionAccounting {
+private:
+  std::mutex mMutex;
+  ThreadCpuMeter mVideoCpuMeter;
+  ThreadCpuMeter mAudioCpuMeter;
+  std::vector<GstElement*> mQueues;
+
+  gdouble mCpuUsage;
+  guint64 mQueuedBytes;
+  guint64 mPeakQueuedBytes;
+  guint64 mBytesSent;
+  guint64 mBitrate;
+  gint64 mLastStatsTime;
+
+  void attachCpuMeter(GstElement *pipeline, const gchar *name, ThreadCpuMeter& meter);
+
+public:
+  SessionAccounting();
+  virtual ~SessionAccounting();
+
+  void attach(GstElement *pipeline);
+  void detach();
+
+  // webrtcbin の get-stats で取得した統計情報を渡します。
+  void onStats(const GstStructure *stats);
+
+  // エンコーダのストリーミングスレッドの CPU 使用率の合計 (%、1 コアで 100%)
+  gdouble getCpuUsage();
+
+  // queue に溜まっているバイト数
+  guint64 getQueuedBytes();
+
+  // 送信ビットレート (bps)
+  guint64 getBitrate();
+
+  // 送信した RTP のバイト数
+  guint64 getBytesSent();
+};
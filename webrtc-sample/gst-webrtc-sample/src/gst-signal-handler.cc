@@ -0,0 +1,29 @@
+#include "gst-signal-handler.h"
+
+SignalHandler::SignalHandler()
+{
+  mInstance = nullptr;
+  mHandleId = 0;
+}
+
+SignalHandler::~SignalHandler()
+{
+  disconnect();
+}
+
+void SignalHandler::connect(gpointer instance, const gchar *signal, GCallback callback, gpointer userData)
+{
+  disconnect();
+
+  mInstance = instance;
+  mHandleId = g_signal_connect(instance, signal, callback, userData);
+}
+
+void SignalHandler::disconnect()
+{
+  if (mHandleId) {
+    g_signal_handler_disconnect(G_OBJECT(mInstance), mHandleId);
+    mHandleId = 0;
+  }
+  mInstance = nullptr;
+}
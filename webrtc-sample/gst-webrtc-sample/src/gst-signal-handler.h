@@ -0,0 +1,29 @@
+#pragma once
+
+#include <glib-object.h>
+
+/**
+ * GObject のシグナルハンドラを管理するクラス。
+ * 
+ * デストラクタで接続しているシグナルハンドラを自動で切断します。
+ * 接続先のインスタンスは、このクラスより長く生存している必要があります。
+ */
+class SignalHandler {
+private:
+  gpointer mInstance;
+  gulong mHandleId;
+
+public:
+  SignalHandler();
+  virtual ~SignalHandler();
+
+  SignalHandler(const SignalHandler&) = delete;
+  SignalHandler& operator=(const SignalHandler&) = delete;
+
+  inline bool isConnected() const {
+    return mHandleId != 0;
+  }
+
+  void connect(gpointer instance, const gchar *signal, GCallback callback, gpointer userData);
+  void disconnect();
+};
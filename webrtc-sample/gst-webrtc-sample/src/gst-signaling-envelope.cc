@@ -0,0 +1,64 @@
+#include "gst-signaling-envelope.h"
+#include <json-glib/json-glib.h>
+
+// 型の違うメンバーを取得すると json-glib が警告を出すので、文字列の場合だけ返す
+static const gchar *get_string_member(JsonObject *object, const gchar *name)
+{
+  JsonNode *node = json_object_get_member(object, name);
+  if (!node || !JSON_NODE_HOLDS_VALUE(node) || json_node_get_value_type(node) != G_TYPE_STRING) {
+    return NULL;
+  }
+  return json_node_get_string(node);
+}
+
+bool SignalingEnvelope::wrap(const char *key, const std::string& peerId, const std::string& payload, std::string& out)
+{
+  JsonObject *object = json_object_new();
+  json_object_set_string_member(object, key, peerId.c_str());
+  json_object_set_string_member(object, "payload", payload.c_str());
+
+  JsonNode *root = json_node_init_object(json_node_alloc(), object);
+  JsonGenerator *generator = json_generator_new();
+  json_generator_set_root(generator, root);
+  gchar *text = json_generator_to_data(generator, NULL);
+  g_object_unref(generator);
+  json_node_free(root);
+  json_object_unref(object);
+
+  if (!text) {
+    return false;
+  }
+  out = text;
+  g_free(text);
+  return true;
+}
+
+bool SignalingEnvelope::unwrap(const char *key, const std::string& text, std::string& peerId, std::string& payload)
+{
+  // 封筒は必ず JSON オブジェクトなので、それ以外は解析せずに弾く
+  if (text.empty() || text[0] != '{') {
+    return false;
+  }
+
+  JsonParser *parser = json_parser_new();
+  if (!json_parser_load_from_data(parser, text.c_str(), text.size(), NULL)) {
+    g_object_unref(G_OBJECT(parser));
+    return false;
+  }
+
+  bool result = false;
+  JsonNode *root = json_parser_get_root(parser);
+  if (JSON_NODE_HOLDS_OBJECT(root)) {
+    JsonObject *object = json_node_get_object(root);
+    const gchar *peer = get_string_member(object, key);
+    const gchar *body = get_string_member(object, "payload");
+    if (peer && body) {
+      peerId = peer;
+      payload = body;
+      result = true;
+    }
+  }
+
+  g_object_unref(G_OBJECT(parser));
+  return result;
+}
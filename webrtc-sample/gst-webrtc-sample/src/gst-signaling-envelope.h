@@ -0,0 +1,18 @@
+#pragma once
+
+#include <string>
+
+/**
+ * 宛先指定モードで使用するシグナリングメッセージの封筒。
+ * 
+ * 送信時には宛先のピア ID を、受信時には送信元のピア ID を付与します。
+ * <pre>
+ * 送信: { "to": "conn_1", "payload": "..." }
+ * 受信: { "from": "conn_1", "payload": "..." }
+ * </pre>
+ */
+class SignalingEnvelope {
+public:
+  static bool wrap(const char *key, const std::string& peerId, const std::string& payload, std::string& out);
+  static bool unwrap(const char *key, const std::string& text, std::string& peerId, std::string& payload);
+};
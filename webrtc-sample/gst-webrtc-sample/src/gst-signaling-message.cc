@@ -0,0 +1,125 @@
+#include "gst-signaling-message.h"
+#include <json-glib/json-glib.h>
+
+static bool to_string(JsonObject *object, std::string& out)
+{
+  JsonNode *root = json_node_init_object(json_node_alloc(), object);
+  JsonGenerator *generator = json_generator_new();
+  json_generator_set_root(generator, root);
+  gchar *text = json_generator_to_data(generator, NULL);
+  g_object_unref(generator);
+  json_node_free(root);
+  json_object_unref(object);
+
+  if (!text) {
+    return false;
+  }
+  out = text;
+  g_free(text);
+  return true;
+}
+
+// 型の違うメンバーを取得すると json-glib が警告を出すので、型を確認してから取得する
+static const gchar *get_string_member(JsonObject *object, const gchar *name)
+{
+  JsonNode *node = json_object_get_member(object, name);
+  if (!node || !JSON_NODE_HOLDS_VALUE(node) || json_node_get_value_type(node) != G_TYPE_STRING) {
+    return NULL;
+  }
+  return json_node_get_string(node);
+}
+
+static JsonObject *get_object_member(JsonObject *object, const gchar *name)
+{
+  JsonNode *node = json_object_get_member(object, name);
+  if (!node || !JSON_NODE_HOLDS_OBJECT(node)) {
+    return NULL;
+  }
+  return json_node_get_object(node);
+}
+
+static bool get_index_member(JsonObject *object, const gchar *name, guint& value)
+{
+  JsonNode *node = json_object_get_member(object, name);
+  if (!node || !JSON_NODE_HOLDS_VALUE(node) || json_node_get_value_type(node) != G_TYPE_INT64) {
+    return false;
+  }
+  gint64 index = json_node_get_int(node);
+  if (index < 0 || index > G_MAXUINT) {
+    return false;
+  }
+  value = (guint) index;
+  return true;
+}
+
+bool SignalingMessage::encodeSdp(const char *sdpType, const char *sdp, std::string& out)
+{
+  JsonObject *data = json_object_new();
+  json_object_set_string_member(data, "type", sdpType);
+  json_object_set_string_member(data, "sdp", sdp);
+
+  JsonObject *object = json_object_new();
+  json_object_set_string_member(object, "type", "sdp");
+  json_object_set_object_member(object, "data", data);
+  return to_string(object, out);
+}
+
+bool SignalingMessage::encodeIce(guint mlineIndex, const char *candidate, std::string& out)
+{
+  JsonObject *data = json_object_new();
+  json_object_set_int_member(data, "sdpMLineIndex", mlineIndex);
+  json_object_set_string_member(data, "candidate", candidate);
+
+  JsonObject *object = json_object_new();
+  json_object_set_string_member(object, "type", "ice");
+  json_object_set_object_member(object, "data", data);
+  return to_string(object, out);
+}
+
+bool SignalingMessage::decode(const std::string& text, SignalingPayload& payload)
+{
+  if (text.empty() || text[0] != '{') {
+    return false;
+  }
+
+  JsonParser *parser = json_parser_new();
+  if (!json_parser_load_from_data(parser, text.c_str(), text.size(), NULL)) {
+    g_object_unref(G_OBJECT(parser));
+    return false;
+  }
+
+  bool result = false;
+  JsonNode *root = json_parser_get_root(parser);
+  if (JSON_NODE_HOLDS_OBJECT(root)) {
+    JsonObject *object = json_node_get_object(root);
+    const gchar *type = get_string_member(object, "type");
+    JsonObject *data = get_object_member(object, "data");
+
+    if (type && data) {
+      payload.type = type;
+      if (g_strcmp0(type, "sdp") == 0) {
+        const gchar *sdpType = get_string_member(data, "type");
+        const gchar *sdp = get_string_member(data, "sdp");
+        if (sdpType && sdp) {
+          payload.sdpType = sdpType;
+          payload.sdp = sdp;
+          result = true;
+        }
+      } else if (g_strcmp0(type, "ice") == 0) {
+        const gchar *candidate = get_string_member(data, "candidate");
+        guint mlineIndex = 0;
+        if (candidate && get_index_member(data, "sdpMLineIndex", mlineIndex)) {
+          payload.sdpMLineIndex = mlineIndex;
+          payload.candidate = candidate;
+          result = true;
+        }
+      } else {
+        // 種類だけ返して、呼び出し側で無視する
+        result = true;
+      }
+    }
+  }
+
+  g_object_unref(G_OBJECT(parser));
+  return result;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <string>
+#include <glib.h>
+
+/**
+ * シグナリングで受け取った SDP または ICE の情報。
+ */
+struct SignalingPayload {
+  // sdp または ice
+  std::string type;
+  // SDP の種類 (offer, answer)
+  std::string sdpType;
+  std::string sdp;
+  guint sdpMLineIndex = 0;
+  std::string candidate;
+};
+
+/**
+ * シグナリングで送受信した SDP と ICE のメッセージのバイト数 (JSON の文字列の長さ)。
+ */
+struct SignalingBytes {
+  guint64 sdpSent = 0;
+  guint64 sdpReceived = 0;
+  guint64 iceSent = 0;
+  guint64 iceReceived = 0;
+  // SdpMinimizer で削減した SDP のバイト数
+  guint64 sdpSaved = 0;
+
+  inline void add(const SignalingBytes& bytes) {
+    sdpSent += bytes.sdpSent;
+    sdpReceived += bytes.sdpReceived;
+    iceSent += bytes.iceSent;
+    iceReceived += bytes.iceReceived;
+    sdpSaved += bytes.sdpSaved;
+  }
+};
+
+/**
+ * シグナリングで送受信する SDP と ICE のメッセージの JSON を作成・解析します。
+ *
+ * ICE 情報のフォーマットは下記の通りです。
+ * <pre>
+ * { "type": "ice", "data": { "candidate": ..., "sdpMLineIndex": ... } }
+ * </pre>
+ *
+ * SDP 情報のフォーマットは下記の通りです。
+ * <pre>
+ * { "type": "sdp", "data": { "type": "answer", "sdp": "o=- [....]" } }
+ * </pre>
+ */
+class SignalingMessage {
+public:
+  static bool encodeSdp(const char *sdpType, const char *sdp, std::string& out);
+  static bool encodeIce(guint mlineIndex, const char *candidate, std::string& out);
+
+  /**
+   * SDP または ICE のメッセージを解析します。
+   *
+   * @return JSON でない場合や必要なフィールドがない場合は false
+   */
+  static bool decode(const std::string& text, SignalingPayload& payload);
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string>
+
+class SignalingTransport;
+
+class SignalingTransportListener {
+public:
+  virtual void onConnected(SignalingTransport *transport) {}
+  virtual void onDisconnected(SignalingTransport *transport) {}
+
+  // peerId は送信元のピア ID です。宛先指定に対応していないトランスポートでは空文字になります。
+  // size は宛先指定の封筒を含めた、トランスポートで受信したバイト数です。
+  virtual void onMessage(SignalingTransport *transport, std::string& peerId, std::string& message, size_t size) {}
+};
+
+/**
+ * シグナリングのメッセージを送受信するトランスポートのインターフェース。
+ * 
+ * Websocket 経由でシグナリングサーバに接続する WebsocketClient と、
+ * 同一プロセス内でメッセージを中継する LoopbackSignalingTransport があります。
+ */
+class SignalingTransport {
+protected:
+  SignalingTransportListener *mListener;
+
+public:
+  SignalingTransport() {
+    mListener = nullptr;
+  }
+
+  virtual ~SignalingTransport() {}
+
+  inline void setListener(SignalingTransportListener *listener) {
+    mListener = listener;
+  }
+
+  virtual void connectAsync(std::string& url, std::string& origin) = 0;
+  virtual void disconnect() = 0;
+
+  // peerId が空の場合には、接続している全てのピアにメッセージを送信します。
+  // 宛先指定の封筒を含めた、トランスポートで送信したバイト数を返します。送信できなかった場合は 0 です。
+  virtual size_t sendMessage(std::string& peerId, std::string& message) = 0;
+};
@@ -0,0 +1,107 @@
+#include "gst-thread-cpu-meter.h"
+#include <time.h>
+
+static gint64 get_thread_cpu_time()
+{
+  struct timespec ts;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) {
+    return -1;
+  }
+  return (gint64) ts.tv_sec * GST_SECOND + ts.tv_nsec;
+}
+
+ThreadCpuMeter::ThreadCpuMeter()
+{
+  mPad = nullptr;
+  mProbeId = 0;
+  mThreadCpuTime = -1;
+  mBaseCpuTime = -1;
+  mLastCpuTime = 0;
+  mLastWallTime = 0;
+  mStartWallTime = 0;
+}
+
+ThreadCpuMeter::~ThreadCpuMeter()
+{
+  detach();
+}
+
+void ThreadCpuMeter::attach(GstPad *pad)
+{
+  detach();
+
+  mPad = (GstPad *) gst_object_ref(pad);
+  mThreadCpuTime = -1;
+  mBaseCpuTime = -1;
+  mLastCpuTime = 0;
+  mStartWallTime = g_get_monotonic_time();
+  mLastWallTime = mStartWallTime;
+  mProbeId = gst_pad_add_probe(mPad,
+      (GstPadProbeType) (GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST),
+      ThreadCpuMeter::onProbe, this, NULL);
+}
+
+void ThreadCpuMeter::detach()
+{
+  if (mPad) {
+    if (mProbeId) {
+      gst_pad_remove_probe(mPad, mProbeId);
+      mProbeId = 0;
+    }
+    gst_object_unref(mPad);
+    mPad = nullptr;
+  }
+}
+
+gint64 ThreadCpuMeter::getCpuTime()
+{
+  gint64 baseCpuTime = mBaseCpuTime;
+  if (baseCpuTime < 0) {
+    return 0;
+  }
+  return mThreadCpuTime - baseCpuTime;
+}
+
+gdouble ThreadCpuMeter::sampleUsage()
+{
+  gint64 cpuTime = getCpuTime();
+  gint64 wallTime = g_get_monotonic_time();
+
+  gdouble usage = 0.0;
+  gint64 wallDelta = (wallTime - mLastWallTime) * GST_USECOND;
+  if (wallDelta > 0) {
+    usage = 100.0 * (cpuTime - mLastCpuTime) / wallDelta;
+  }
+
+  mLastCpuTime = cpuTime;
+  mLastWallTime = wallTime;
+  return usage;
+}
+
+gdouble ThreadCpuMeter::getAverageUsage()
+{
+  gint64 wallDelta = (g_get_monotonic_time() - mStartWallTime) * GST_USECOND;
+  if (wallDelta <= 0) {
+    return 0.0;
+  }
+  return 100.0 * getCpuTime() / wallDelta;
+}
+
+// callback static functions.
+
+GstPadProbeReturn ThreadCpuMeter::onProbe(GstPad *pad, GstPadProbeInfo *info, gpointer userData)
+{
+  ThreadCpuMeter *meter = (ThreadCpuMeter *) userData;
+  gint64 cpuTime = get_thread_cpu_time();
+  if (cpuTime < 0) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  meter->mThreadCpuTime = cpuTime;
+
+  // ストリーミングスレッドはスレッドプールから再利用されるので、最初の計測値を基準にする
+  if (meter->mBaseCpuTime < 0) {
+    meter->mBaseCpuTime = cpuTime;
+  }
+  return GST_PAD_PROBE_OK;
+}
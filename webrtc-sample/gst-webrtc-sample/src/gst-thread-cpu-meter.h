@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+#include <gst/gst.h>
+
+/**
+ * パッドを流れるストリーミングスレッドの CPU 使用時間を計測します。
+ * 
+ * パッドにバッファが流れるたびに、そのスレッドの CPU 時間を記録します。
+ * queue の後ろにあるパッドに設定すると、その queue から先の処理にかかった CPU 時間が分かります。
+ */
+class ThreadCpuMeter {
+private:
+  GstPad *mPad;
+  gulong mProbeId;
+
+  std::atomic<gint64> mThreadCpuTime;
+  std::atomic<gint64> mBaseCpuTime;
+  gint64 mLastCpuTime;
+  gint64 mLastWallTime;
+  gint64 mStartWallTime;
+
+  static GstPadProbeReturn onProbe(GstPad *pad, GstPadProbeInfo *info, gpointer userData);
+
+public:
+  ThreadCpuMeter();
+  virtual ~ThreadCpuMeter();
+
+  ThreadCpuMeter(const ThreadCpuMeter&) = delete;
+  ThreadCpuMeter& operator=(const ThreadCpuMeter&) = delete;
+
+  inline bool isAttached() const {
+    return mPad != nullptr;
+  }
+
+  void attach(GstPad *pad);
+  void detach();
+
+  // 計測を開始してから使用した CPU 時間 (ナノ秒)
+  gint64 getCpuTime();
+
+  // 前回呼び出した時からの CPU 使用率 (%)
+  gdouble sampleUsage();
+
+  // 計測を開始してからの平均 CPU 使用率 (%)
+  gdouble getAverageUsage();
+};
@@ -0,0 +1,297 @@
+#include "gst-udp-batch-sender.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+
+// glibc 2.27 (Ubuntu 18.04) のヘッダーには定義されていないので、カーネルの値を使用する
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+
+UdpBatchSender::UdpBatchSender(size_t maxPackets)
+{
+  mSocket = -1;
+  mMode = MODE_SENDTO;
+  mMaxPackets = maxPackets > 0 ? maxPackets : 1;
+  mPacketCount = 0;
+  mSyscallCount = 0;
+  mDropCount = 0;
+
+  mOffsets.reserve(mMaxPackets);
+  mSizes.reserve(mMaxPackets);
+  mIovecs.reserve(mMaxPackets);
+  mMessages.reserve(mMaxPackets);
+  mGroups.reserve(mMaxPackets);
+  mControl.resize(mMaxPackets * CMSG_SPACE(sizeof(uint16_t)));
+}
+
+UdpBatchSender::~UdpBatchSender()
+{
+  close();
+}
+
+bool UdpBatchSender::open(const std::string& host, int port, Mode mode)
+{
+  close();
+
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_DGRAM;
+
+  struct addrinfo *result = NULL;
+  std::string service = std::to_string(port);
+  int ret = getaddrinfo(host.c_str(), service.c_str(), &hints, &result);
+  if (ret != 0) {
+    fprintf(stderr, "Failed to resolve %s: %s\n", host.c_str(), gai_strerror(ret));
+    return false;
+  }
+
+  for (struct addrinfo *ai = result; ai != NULL; ai = ai->ai_next) {
+    int fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol);
+    if (fd < 0) {
+      continue;
+    }
+    // 送信先を固定しておくと、パケットごとにアドレスを渡す必要がなくなる
+    if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+      mSocket = fd;
+      break;
+    }
+    ::close(fd);
+  }
+  freeaddrinfo(result);
+
+  if (mSocket < 0) {
+    fprintf(stderr, "Failed to open a UDP socket for %s:%d\n", host.c_str(), port);
+    return false;
+  }
+
+  // UDP_SEGMENT に対応していないカーネル (4.18 未満) では設定に失敗する
+  if (mode == MODE_GSO) {
+    int size = 0;
+    if (setsockopt(mSocket, SOL_UDP, UDP_SEGMENT, &size, sizeof(size)) != 0) {
+      mode = MODE_SENDMMSG;
+    }
+  }
+  mMode = mode;
+  return true;
+}
+
+void UdpBatchSender::close()
+{
+  clear();
+  if (mSocket >= 0) {
+    ::close(mSocket);
+    mSocket = -1;
+  }
+}
+
+void UdpBatchSender::clear()
+{
+  mBuffer.clear();
+  mOffsets.clear();
+  mSizes.clear();
+}
+
+void UdpBatchSender::add(const uint8_t *data, size_t size)
+{
+  if (mSizes.size() >= mMaxPackets) {
+    flush();
+  }
+  mOffsets.push_back(mBuffer.size());
+  mSizes.push_back(size);
+  mBuffer.insert(mBuffer.end(), data, data + size);
+}
+
+size_t UdpBatchSender::flush()
+{
+  if (mSizes.empty()) {
+    return 0;
+  }
+  if (mSocket < 0) {
+    mDropCount += mSizes.size();
+    clear();
+    return 0;
+  }
+
+  uint64_t before = mPacketCount;
+
+  // add の途中で mBuffer が再確保される可能性があるので、送信直前にアドレスを決める
+  mIovecs.clear();
+  for (size_t i = 0; i < mSizes.size(); i++) {
+    struct iovec iov;
+    iov.iov_base = mBuffer.data() + mOffsets[i];
+    iov.iov_len = mSizes[i];
+    mIovecs.push_back(iov);
+  }
+
+  // 使用できない送信方法だった場合は、送信方法を切り替えて残りを送り直す
+  bool done = false;
+  while (!done) {
+    if (mMode == MODE_SENDTO) {
+      done = sendEach();
+    } else {
+      buildGroups(mMode == MODE_GSO);
+      done = sendGroups();
+    }
+  }
+
+  clear();
+  return (size_t) (mPacketCount - before);
+}
+
+/**
+ * 送信するパケットを sendmmsg の 1 メッセージごとにまとめます。
+ *
+ * GSO の場合、カーネルは渡されたバッファを segmentSize ごとに分割するので、
+ * 同じサイズのパケットが続く間を 1 つのメッセージにまとめます。最後のパケットだけは小さくても構いません。
+ * RTP のペイローダーは 1 フレームを MTU いっぱいのパケットに分割するので、ほとんどが 1 メッセージになります。
+ */
+void UdpBatchSender::buildGroups(bool useGso)
+{
+  mGroups.clear();
+
+  size_t total = 0;
+  for (size_t i = 0; i < mIovecs.size(); i++) {
+    size_t size = mIovecs[i].iov_len;
+    if (useGso && !mGroups.empty()) {
+      Group& group = mGroups.back();
+      size_t lastSize = mIovecs[group.first + group.count - 1].iov_len;
+      if (lastSize == group.segmentSize
+          && size <= group.segmentSize
+          && group.count < MAX_GSO_SEGMENTS
+          && total + size <= MAX_GSO_SIZE) {
+        group.count++;
+        total += size;
+        continue;
+      }
+    }
+
+    Group group;
+    group.first = i;
+    group.count = 1;
+    group.segmentSize = (uint16_t) size;
+    mGroups.push_back(group);
+    total = size;
+  }
+}
+
+/**
+ * まとめたメッセージを sendmmsg で送信します。
+ *
+ * 送信できた分は mIovecs から取り除きます。
+ *
+ * @return 送信を終えた場合は true、送信方法を切り替えて送り直す必要がある場合は false
+ */
+bool UdpBatchSender::sendGroups()
+{
+  mMessages.clear();
+  for (size_t i = 0; i < mGroups.size(); i++) {
+    Group& group = mGroups[i];
+
+    struct mmsghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_hdr.msg_iov = &mIovecs[group.first];
+    msg.msg_hdr.msg_iovlen = group.count;
+
+    if (group.count > 1) {
+      uint8_t *control = mControl.data() + i * CMSG_SPACE(sizeof(uint16_t));
+      memset(control, 0, CMSG_SPACE(sizeof(uint16_t)));
+      msg.msg_hdr.msg_control = control;
+      msg.msg_hdr.msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+
+      struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg.msg_hdr);
+      cmsg->cmsg_level = SOL_UDP;
+      cmsg->cmsg_type = UDP_SEGMENT;
+      cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+      memcpy(CMSG_DATA(cmsg), &group.segmentSize, sizeof(uint16_t));
+    }
+    mMessages.push_back(msg);
+  }
+
+  size_t index = 0;
+  while (index < mMessages.size()) {
+    int ret = sendmmsg(mSocket, &mMessages[index], mMessages.size() - index, 0);
+    mSyscallCount++;
+
+    if (ret > 0) {
+      for (int i = 0; i < ret; i++) {
+        mPacketCount += mGroups[index + i].count;
+      }
+      index += ret;
+      continue;
+    }
+
+    int error = errno;
+    if (error == EINTR) {
+      continue;
+    }
+
+    if (error == ENOSYS || ((error == EIO || error == EINVAL) && mMode == MODE_GSO)) {
+      // GSO はネットワークデバイスやチェックサムオフロードの設定によって送信時に失敗することがある
+      mMode = (mMode == MODE_GSO && error != ENOSYS) ? MODE_SENDMMSG : MODE_SENDTO;
+      fprintf(stderr, "UDP batch send failed (%s), falling back to %s.\n", strerror(error), getModeName(mMode));
+      size_t sent = index < mGroups.size() ? mGroups[index].first : mIovecs.size();
+      mIovecs.erase(mIovecs.begin(), mIovecs.begin() + sent);
+      return false;
+    }
+
+    if (error == EAGAIN || error == EWOULDBLOCK || error == ENOBUFS) {
+      // 送信バッファが一杯の場合、遅れて届くメディアには意味がないので残りは破棄する
+      for (size_t i = index; i < mGroups.size(); i++) {
+        mDropCount += mGroups[i].count;
+      }
+      break;
+    }
+
+    // ICMP で通知されたエラー (ECONNREFUSED など) は一度だけ返されるので、そのメッセージだけ破棄して続ける
+    mDropCount += mGroups[index].count;
+    index++;
+  }
+  return true;
+}
+
+/**
+ * パケットを 1 つずつ send で送信します。
+ */
+bool UdpBatchSender::sendEach()
+{
+  for (size_t i = 0; i < mIovecs.size(); i++) {
+    ssize_t ret;
+    do {
+      ret = send(mSocket, mIovecs[i].iov_base, mIovecs[i].iov_len, 0);
+      mSyscallCount++;
+    } while (ret < 0 && errno == EINTR);
+
+    if (ret >= 0) {
+      mPacketCount++;
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) {
+      mDropCount += mIovecs.size() - i;
+      break;
+    } else {
+      mDropCount++;
+    }
+  }
+  return true;
+}
+
+const char *UdpBatchSender::getModeName(Mode mode)
+{
+  switch (mode) {
+  case MODE_SENDTO:
+    return "sendto";
+  case MODE_SENDMMSG:
+    return "sendmmsg";
+  case MODE_GSO:
+    return "gso";
+  }
+  return "unknown";
+}
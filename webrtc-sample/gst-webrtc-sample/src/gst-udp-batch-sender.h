@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+/**
+ * 複数の UDP パケットをまとめて送信します。
+ *
+ * add で溜めたパケットを flush でまとめて送信します。
+ * sendto をパケットごとに呼び出す代わりに、sendmmsg で 1 回のシステムコールで送信し、
+ * さらにカーネルが UDP GSO (UDP_SEGMENT) に対応している場合は、同じサイズのパケットを
+ * 1 つの大きなバッファとして渡してカーネル内で分割させます。
+ *
+ * GSO や sendmmsg が使用できない場合は、自動的に次の方法に切り替えます。
+ * スレッドセーフではないので、1 つのスレッドから使用してください。
+ */
+class UdpBatchSender {
+public:
+  enum Mode {
+    MODE_SENDTO,
+    MODE_SENDMMSG,
+    MODE_GSO
+  };
+
+private:
+  // UDP_SEGMENT で 1 回に渡せるセグメントの最大数 (カーネルの UDP_MAX_SEGMENTS)
+  static const size_t MAX_GSO_SEGMENTS = 64;
+  // UDP_SEGMENT で 1 回に渡せるペイロードの最大サイズ
+  static const size_t MAX_GSO_SIZE = 65000;
+
+  struct Group {
+    size_t first;
+    size_t count;
+    uint16_t segmentSize;
+  };
+
+  int mSocket;
+  Mode mMode;
+  size_t mMaxPackets;
+
+  std::vector<uint8_t> mBuffer;
+  std::vector<size_t> mOffsets;
+  std::vector<size_t> mSizes;
+  std::vector<struct iovec> mIovecs;
+  std::vector<struct mmsghdr> mMessages;
+  std::vector<Group> mGroups;
+  std::vector<uint8_t> mControl;
+
+  uint64_t mPacketCount;
+  uint64_t mSyscallCount;
+  uint64_t mDropCount;
+
+  void buildGroups(bool useGso);
+  bool sendGroups();
+  bool sendEach();
+  void clear();
+
+public:
+  UdpBatchSender(size_t maxPackets = 256);
+  virtual ~UdpBatchSender();
+
+  UdpBatchSender(const UdpBatchSender&) = delete;
+  UdpBatchSender& operator=(const UdpBatchSender&) = delete;
+
+  /**
+   * 送信先を指定してソケットを作成します。
+   *
+   * @param host 送信先のホスト名または IP アドレス
+   * @param port 送信先のポート番号
+   * @param mode 使用する送信方法、使用できない場合はより単純な方法に切り替えます
+   * @return 成功した場合は true
+   */
+  bool open(const std::string& host, int port, Mode mode = MODE_GSO);
+  void close();
+
+  inline bool isOpened() const {
+    return mSocket >= 0;
+  }
+
+  // 実際に使用している送信方法
+  inline Mode getMode() const {
+    return mMode;
+  }
+
+  /**
+   * 送信するパケットを追加します。
+   *
+   * データはコピーされるので、呼び出し後に解放しても問題ありません。
+   * 溜めておけるパケット数を超えた場合は、その時点で flush します。
+   */
+  void add(const uint8_t *data, size_t size);
+
+  /**
+   * 溜めているパケットを送信します。
+   *
+   * 送信バッファが一杯で送信できなかったパケットは破棄します。
+   *
+   * @return 送信したパケット数
+   */
+  size_t flush();
+
+  inline size_t getPendingCount() const {
+    return mSizes.size();
+  }
+
+  inline uint64_t getPacketCount() const {
+    return mPacketCount;
+  }
+
+  inline uint64_t getSyscallCount() const {
+    return mSyscallCount;
+  }
+
+  inline uint64_t getDropCount() const {
+    return mDropCount;
+  }
+
+  static const char *getModeName(Mode mode);
+};
@@ -0,0 +1,325 @@
+#include "gst-video-feed.h"
+
+#include <gst/app/gstappsrc.h>
+
+// GOP として保持する最大サイズ、超えた場合は次のキーフレームまで保持しない
+#define VIDEO_FEED_MAX_GOP_BYTES (16 * 1024 * 1024)
+
+// GOP の送り直しと入力側へのキーフレーム要求の最小間隔 (マイクロ秒)
+#define VIDEO_FEED_KEY_FRAME_INTERVAL (1000 * 1000)
+
+VideoFeed::VideoFeed()
+{
+  mPipeline = nullptr;
+  mSink = nullptr;
+  mBusWatchId = 0;
+  mLoop = false;
+  mCaps = nullptr;
+  mGopBytes = 0;
+  mGopOverflow = false;
+  mLastKeyFrameRequestTime = 0;
+  mFrameCount = 0;
+  mReplayCount = 0;
+}
+
+VideoFeed::~VideoFeed()
+{
+  stop();
+
+  std::lock_guard<std::mutex> lock(mMutex);
+  for (auto itr = mSubscribers.begin(); itr != mSubscribers.end(); ++itr) {
+    Subscriber *subscriber = itr->get();
+    gst_pad_remove_probe(subscriber->pad, subscriber->probeId);
+    gst_object_unref(subscriber->pad);
+    gst_object_unref(subscriber->appsrc);
+  }
+  mSubscribers.clear();
+  clearGop();
+  if (mCaps) {
+    gst_caps_unref(mCaps);
+    mCaps = nullptr;
+  }
+}
+
+bool VideoFeed::start(const std::string& description, bool loop)
+{
+  stop();
+
+  GError *error = NULL;
+  GstElement *pipeline = gst_parse_launch(description.c_str(), &error);
+  if (error) {
+    g_printerr("Failed to parse video feed: %s.\n", error->message);
+    g_error_free(error);
+    if (pipeline) {
+      gst_object_unref(pipeline);
+    }
+    return false;
+  }
+
+  GstElement *sink = gst_bin_get_by_name(GST_BIN(pipeline), "feedsink");
+  if (!sink) {
+    g_printerr("Not found an appsink named feedsink.\n");
+    gst_object_unref(pipeline);
+    return false;
+  }
+
+  GstAppSinkCallbacks callbacks = { NULL, NULL, VideoFeed::onNewSample };
+  gst_app_sink_set_callbacks(GST_APP_SINK(sink), &callbacks, this, NULL);
+
+  GstBus *bus = gst_element_get_bus(pipeline);
+  mBusWatchId = gst_bus_add_watch(bus, VideoFeed::onBusMessage, this);
+  gst_object_unref(bus);
+
+  mPipeline = pipeline;
+  mSink = sink;
+  mLoop = loop;
+
+  gst_element_set_state(mPipeline, GST_STATE_PLAYING);
+  return true;
+}
+
+void VideoFeed::stop()
+{
+  if (mBusWatchId) {
+    g_source_remove(mBusWatchId);
+    mBusWatchId = 0;
+  }
+
+  if (mPipeline) {
+    gst_element_set_state(mPipeline, GST_STATE_NULL);
+    g_print("Video feed: %" G_GUINT64_FORMAT " frames, %" G_GUINT64_FORMAT " GOP replays\n", mFrameCount, mReplayCount);
+  }
+
+  std::lock_guard<std::mutex> lock(mMutex);
+  if (mSink) {
+    gst_object_unref(mSink);
+    mSink = nullptr;
+  }
+  if (mPipeline) {
+    gst_object_unref(mPipeline);
+    mPipeline = nullptr;
+  }
+}
+
+void VideoFeed::setCaps(GstCaps *caps)
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  if (mCaps && gst_caps_is_equal(mCaps, caps)) {
+    return;
+  }
+  gst_caps_replace(&mCaps, caps);
+
+  // コーデックの設定が変わると前の GOP は使えない
+  clearGop();
+
+  for (auto itr = mSubscribers.begin(); itr != mSubscribers.end(); ++itr) {
+    gst_app_src_set_caps(GST_APP_SRC((*itr)->appsrc), mCaps);
+  }
+}
+
+void VideoFeed::pushBuffer(GstBuffer *buffer)
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+  handleBuffer(buffer);
+}
+
+void VideoFeed::addSubscriber(GstElement *appsrc)
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  GstPad *pad = gst_element_get_static_pad(appsrc, "src");
+  if (!pad) {
+    return;
+  }
+
+  std::unique_ptr<Subscriber> subscriber(new Subscriber());
+  subscriber->appsrc = (GstElement *) gst_object_ref(appsrc);
+  subscriber->pad = pad;
+
+  // 下流から届くキーフレームの要求を受け取る
+  subscriber->probeId = gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_EVENT_UPSTREAM,
+      VideoFeed::onSubscriberEvent, this, NULL);
+
+  if (mCaps) {
+    gst_app_src_set_caps(GST_APP_SRC(appsrc), mCaps);
+  }
+  mSubscribers.push_back(std::move(subscriber));
+}
+
+void VideoFeed::removeSubscriber(GstElement *appsrc)
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  for (auto itr = mSubscribers.begin(); itr != mSubscribers.end(); ++itr) {
+    Subscriber *subscriber = itr->get();
+    if (subscriber->appsrc == appsrc) {
+      gst_pad_remove_probe(subscriber->pad, subscriber->probeId);
+      gst_object_unref(subscriber->pad);
+      gst_object_unref(subscriber->appsrc);
+      mSubscribers.erase(itr);
+      return;
+    }
+  }
+}
+
+void VideoFeed::replay(GstElement *appsrc)
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  for (auto itr = mSubscribers.begin(); itr != mSubscribers.end(); ++itr) {
+    Subscriber *subscriber = itr->get();
+    if (subscriber->appsrc == appsrc) {
+      replayGop(subscriber);
+      return;
+    }
+  }
+}
+
+size_t VideoFeed::getSubscriberCount()
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mSubscribers.size();
+}
+
+// private functions.
+
+void VideoFeed::handleBuffer(GstBuffer *buffer)
+{
+  mFrameCount++;
+
+  // キーフレームから GOP を保持し直す
+  if (!GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT)) {
+    clearGop();
+    mGopOverflow = false;
+  }
+
+  if (!mGopOverflow && (!mGop.empty() || !GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT))) {
+    mGopBytes += gst_buffer_get_size(buffer);
+    if (mGopBytes > VIDEO_FEED_MAX_GOP_BYTES) {
+      clearGop();
+      mGopOverflow = true;
+    } else {
+      mGop.push_back(gst_buffer_ref(buffer));
+    }
+  }
+
+  for (auto itr = mSubscribers.begin(); itr != mSubscribers.end(); ++itr) {
+    pushToSubscriber(itr->get(), buffer);
+  }
+}
+
+void VideoFeed::pushToSubscriber(Subscriber *subscriber, GstBuffer *buffer)
+{
+  // セッションごとにランニングタイムが異なるので、タイムスタンプは appsrc の do-timestamp で付け直す
+  // メモリはコピーせずに共有する
+  GstBuffer *copy = gst_buffer_copy(buffer);
+  GST_BUFFER_PTS(copy) = GST_CLOCK_TIME_NONE;
+  GST_BUFFER_DTS(copy) = GST_CLOCK_TIME_NONE;
+  gst_app_src_push_buffer(GST_APP_SRC(subscriber->appsrc), copy);
+}
+
+void VideoFeed::replayGop(Subscriber *subscriber)
+{
+  if (mGop.empty()) {
+    requestKeyFrame();
+    return;
+  }
+
+  for (auto itr = mGop.begin(); itr != mGop.end(); ++itr) {
+    pushToSubscriber(subscriber, *itr);
+  }
+  mReplayCount++;
+}
+
+void VideoFeed::requestKeyFrame()
+{
+  // RTSP の場合は rtpbin から送信元に PLI/FIR が送られる
+  gint64 now = g_get_monotonic_time();
+  if (!mSink || now - mLastKeyFrameRequestTime < VIDEO_FEED_KEY_FRAME_INTERVAL) {
+    return;
+  }
+  mLastKeyFrameRequestTime = now;
+
+  GstPad *pad = gst_element_get_static_pad(mSink, "sink");
+  if (pad) {
+    GstStructure *structure = gst_structure_new("GstForceKeyUnit", "all-headers", G_TYPE_BOOLEAN, TRUE, NULL);
+    gst_pad_push_event(pad, gst_event_new_custom(GST_EVENT_CUSTOM_UPSTREAM, structure));
+    gst_object_unref(pad);
+  }
+}
+
+void VideoFeed::clearGop()
+{
+  for (auto itr = mGop.begin(); itr != mGop.end(); ++itr) {
+    gst_buffer_unref(*itr);
+  }
+  mGop.clear();
+  mGopBytes = 0;
+}
+
+// callback functions.
+
+GstFlowReturn VideoFeed::onNewSample(GstAppSink *sink, gpointer userData)
+{
+  VideoFeed *self = (VideoFeed *) userData;
+  GstSample *sample = gst_app_sink_pull_sample(sink);
+  if (!sample) {
+    return GST_FLOW_OK;
+  }
+
+  GstCaps *caps = gst_sample_get_caps(sample);
+  if (caps) {
+    self->setCaps(caps);
+  }
+
+  GstBuffer *buffer = gst_sample_get_buffer(sample);
+  if (buffer) {
+    self->pushBuffer(buffer);
+  }
+  gst_sample_unref(sample);
+  return GST_FLOW_OK;
+}
+
+gboolean VideoFeed::onBusMessage(GstBus *bus, GstMessage *message, gpointer userData)
+{
+  VideoFeed *self = (VideoFeed *) userData;
+
+  switch (GST_MESSAGE_TYPE(message)) {
+  case GST_MESSAGE_EOS:
+    if (self->mLoop) {
+      gst_element_seek_simple(self->mPipeline, GST_FORMAT_TIME,
+          (GstSeekFlags) (GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT), 0);
+    } else {
+      g_print("Video feed reached the end of stream.\n");
+    }
+    break;
+  case GST_MESSAGE_ERROR: {
+    GError *error = NULL;
+    gst_message_parse_error(message, &error, NULL);
+    g_printerr("Video feed error: %s.\n", error->message);
+    g_error_free(error);
+    break;
+  }
+  default:
+    break;
+  }
+  return TRUE;
+}
+
+GstPadProbeReturn VideoFeed::onSubscriberEvent(GstPad *pad, GstPadProbeInfo *info, gpointer userData)
+{
+  GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+  if (GST_EVENT_TYPE(event) != GST_EVENT_CUSTOM_UPSTREAM ||
+      !gst_event_has_name(event, "GstForceKeyUnit")) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  VideoFeed *self = (VideoFeed *) userData;
+
+  // 接続済みのセッションに古い GOP を送り直すと表示済みのフレームが重複するので、
+  // 入力に新しいキーフレームを要求するだけにする
+  std::lock_guard<std::mutex> lock(self->mMutex);
+  self->requestKeyFrame();
+  return GST_PAD_PROBE_OK;
+}
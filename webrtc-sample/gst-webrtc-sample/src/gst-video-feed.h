@@ -0,0 +1,90 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <gst/gst.h>
+#include <gst/app/gstappsink.h>
+
+/**
+ * 符号化済みの映像ストリームを全てのセッションで共有します。
+ *
+ * 入力用のパイプライン (RTSP やファイル) を 1 つだけ動かして、appsink で受け取ったフレームを
+ * 各セッションのパイプラインの appsrc に渡します。デコードもエンコードも行わないので、
+ * セッションごとの処理はパケット化だけになります。
+ * アプリケーションが setCaps と pushBuffer で直接フレームを渡すこともできます。
+ * 画面やカメラのキャプチャでは未圧縮のフレームを渡し、デバイスを開くのを 1 回だけにします。
+ * 未圧縮のフレームは全てキーフレームとして扱われるので、保持する GOP は直前の 1 フレームになります。
+ *
+ * 途中から参加したセッションがすぐに復号できるように、直前のキーフレームからのフレーム (GOP) を保持しておき、
+ * セッションの接続が完了した時 (replay) に、そのセッションに送り直します。
+ * 接続前に送ったフレームは webrtcbin で捨てられるので、セッションの追加時には送りません。
+ * セッションから GstForceKeyUnit (受信側の PLI など) が届いた場合は、入力にキーフレームを要求するだけにします。
+ */
+class VideoFeed {
+private:
+  struct Subscriber {
+    GstElement *appsrc;
+    GstPad *pad;
+    gulong probeId;
+  };
+
+  std::mutex mMutex;
+  GstElement *mPipeline;
+  GstElement *mSink;
+  guint mBusWatchId;
+  bool mLoop;
+
+  GstCaps *mCaps;
+  std::vector<GstBuffer*> mGop;
+  gsize mGopBytes;
+  bool mGopOverflow;
+  gint64 mLastKeyFrameRequestTime;
+  std::vector<std::unique_ptr<Subscriber>> mSubscribers;
+
+  guint64 mFrameCount;
+  guint64 mReplayCount;
+
+  void handleBuffer(GstBuffer *buffer);
+  void pushToSubscriber(Subscriber *subscriber, GstBuffer *buffer);
+  void replayGop(Subscriber *subscriber);
+  void requestKeyFrame();
+  void clearGop();
+
+  static GstFlowReturn onNewSample(GstAppSink *sink, gpointer userData);
+  static gboolean onBusMessage(GstBus *bus, GstMessage *message, gpointer userData);
+  static GstPadProbeReturn onSubscriberEvent(GstPad *pad, GstPadProbeInfo *info, gpointer userData);
+
+public:
+  VideoFeed();
+  virtual ~VideoFeed();
+
+  VideoFeed(const VideoFeed&) = delete;
+  VideoFeed& operator=(const VideoFeed&) = delete;
+
+  /**
+   * 入力用のパイプラインを開始します。
+   *
+   * @param description gst_parse_launch の記述、feedsink という名前の appsink で終わる必要があります
+   * @param loop 最後まで再生した場合に先頭に戻る場合は true
+   * @return 開始できた場合は true
+   */
+  bool start(const std::string& description, bool loop);
+  void stop();
+
+  // アプリケーションから直接フレームを渡す場合のストリームの caps を設定します。
+  void setCaps(GstCaps *caps);
+
+  // アプリケーションから直接フレームを渡します。buffer の参照は呼び出し元に残ります。
+  void pushBuffer(GstBuffer *buffer);
+
+  // セッションの appsrc を追加します。GOP は接続後に replay で送ります。
+  void addSubscriber(GstElement *appsrc);
+  void removeSubscriber(GstElement *appsrc);
+
+  // 接続が完了したセッションの appsrc に、保持している GOP を送ります。
+  void replay(GstElement *appsrc);
+
+  size_t getSubscriberCount();
+};
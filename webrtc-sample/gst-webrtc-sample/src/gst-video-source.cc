@@ -0,0 +1,125 @@
+#include "gst-video-source.h"
+
+#include <gst/pbutils/pbutils.h>
+
+bool VideoSource::parseMode(const gchar *name, VideoSourceMode& mode)
+{
+  if (g_strcmp0(name, "test") == 0) {
+    mode = VIDEO_SOURCE_TEST;
+  } else if (g_strcmp0(name, "file") == 0) {
+    mode = VIDEO_SOURCE_FILE;
+  } else if (g_strcmp0(name, "screen") == 0) {
+    mode = VIDEO_SOURCE_SCREEN;
+  } else if (g_strcmp0(name, "v4l2") == 0) {
+    mode = VIDEO_SOURCE_V4L2;
+  } else if (g_strcmp0(name, "rtsp") == 0) {
+    mode = VIDEO_SOURCE_RTSP;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+const char *VideoSource::getModeName(VideoSourceMode mode)
+{
+  switch (mode) {
+  case VIDEO_SOURCE_TEST:
+    return "test";
+  case VIDEO_SOURCE_FILE:
+    return "file";
+  case VIDEO_SOURCE_SCREEN:
+    return "screen";
+  case VIDEO_SOURCE_V4L2:
+    return "v4l2";
+  case VIDEO_SOURCE_RTSP:
+    return "rtsp";
+  case VIDEO_SOURCE_APPSRC:
+    return "appsrc";
+  }
+  return "unknown";
+}
+
+bool VideoSource::parseCodec(const gchar *name, VideoCodec& codec)
+{
+  if (g_ascii_strcasecmp(name, "h264") == 0) {
+    codec = VIDEO_CODEC_H264;
+  } else if (g_ascii_strcasecmp(name, "vp8") == 0) {
+    codec = VIDEO_CODEC_VP8;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+const char *VideoSource::getCodecName(VideoCodec codec)
+{
+  switch (codec) {
+  case VIDEO_CODEC_RAW:
+    return "raw";
+  case VIDEO_CODEC_VP8:
+    return "VP8";
+  case VIDEO_CODEC_H264:
+    return "H264";
+  }
+  return "unknown";
+}
+
+VideoCodec VideoSource::getCodecFromCaps(const GstCaps *caps)
+{
+  if (!caps || gst_caps_get_size(caps) == 0) {
+    return VIDEO_CODEC_RAW;
+  }
+
+  const gchar *name = gst_structure_get_name(gst_caps_get_structure(caps, 0));
+  if (g_strcmp0(name, "video/x-vp8") == 0) {
+    return VIDEO_CODEC_VP8;
+  }
+  if (g_strcmp0(name, "video/x-h264") == 0) {
+    return VIDEO_CODEC_H264;
+  }
+  return VIDEO_CODEC_RAW;
+}
+
+VideoCodec VideoSource::probeCodec(const std::string& location)
+{
+  GError *error = NULL;
+  gchar *uri = gst_uri_is_valid(location.c_str()) ? g_strdup(location.c_str()) : gst_filename_to_uri(location.c_str(), &error);
+  if (!uri) {
+    g_printerr("Failed to convert %s to uri: %s.\n", location.c_str(), error->message);
+    g_error_free(error);
+    return VIDEO_CODEC_RAW;
+  }
+
+  GstDiscoverer *discoverer = gst_discoverer_new(5 * GST_SECOND, &error);
+  if (!discoverer) {
+    g_printerr("Failed to create discoverer: %s.\n", error->message);
+    g_error_free(error);
+    g_free(uri);
+    return VIDEO_CODEC_RAW;
+  }
+
+  VideoCodec codec = VIDEO_CODEC_RAW;
+  GstDiscovererInfo *info = gst_discoverer_discover_uri(discoverer, uri, &error);
+  if (error) {
+    g_printerr("Failed to discover %s: %s.\n", uri, error->message);
+    g_clear_error(&error);
+  }
+  if (info) {
+    GList *streams = gst_discoverer_info_get_video_streams(info);
+    if (streams) {
+      GstCaps *caps = gst_discoverer_stream_info_get_caps((GstDiscovererStreamInfo *) streams->data);
+      codec = getCodecFromCaps(caps);
+      if (caps) {
+        gst_caps_unref(caps);
+      }
+    } else {
+      g_printerr("No video stream in %s.\n", uri);
+    }
+    gst_discoverer_stream_info_list_free(streams);
+    gst_discoverer_info_unref(info);
+  }
+
+  g_object_unref(discoverer);
+  g_free(uri);
+  return codec;
+}
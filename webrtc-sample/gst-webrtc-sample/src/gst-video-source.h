@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+#include <gst/gst.h>
+
+#include "gst-webrtc-config.h"
+
+/**
+ * 映像ソースの種類やコーデックを扱う関数。
+ */
+class VideoSource {
+public:
+  // test, file, screen, v4l2, rtsp を VideoSourceMode に変換します。
+  static bool parseMode(const gchar *name, VideoSourceMode& mode);
+
+  static const char *getModeName(VideoSourceMode mode);
+
+  static const char *getCodecName(VideoCodec codec);
+
+  // caps のメディアタイプから VideoCodec を求めます。
+  static VideoCodec getCodecFromCaps(const GstCaps *caps);
+
+  // h264, vp8 を VideoCodec に変換します。
+  static bool parseCodec(const gchar *name, VideoCodec& codec);
+
+  /**
+   * ファイルや RTSP の最初の映像ストリームのコーデックを調べます。
+   *
+   * GstDiscoverer で開くので、セッションごとではなく設定時に一度だけ呼び出してください。
+   *
+   * @param location ファイルのパス、または URI (rtsp://...)
+   * @return コーデック、映像がない場合や調べられなかった場合は VIDEO_CODEC_RAW
+   */
+  static VideoCodec probeCodec(const std::string& location);
+};
@@ -0,0 +1,144 @@
+#include "gst-webrtc-audio.h"
+#include "gst-webrtc-stats.h"
+
+AudioEncoderController::AudioEncoderController()
+{
+  mEncoder = nullptr;
+  mPayloader = nullptr;
+  mAdaptiveFec = false;
+  mFecLossThreshold = 5;
+  mPacketLossPercentage = 0;
+  mInbandFec = false;
+}
+
+AudioEncoderController::~AudioEncoderController()
+{
+  detach();
+}
+
+void AudioEncoderController::attach(GstElement *pipeline)
+{
+  detach();
+
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  mEncoder = gst_bin_get_by_name(GST_BIN(pipeline), "audioenc");
+  mPayloader = gst_bin_get_by_name(GST_BIN(pipeline), "audiopay");
+  if (!mEncoder) {
+    return;
+  }
+
+  gboolean inbandFec = FALSE;
+  g_object_get(mEncoder, "packet-loss-percentage", &mPacketLossPercentage, "inband-fec", &inbandFec, NULL);
+  mInbandFec = inbandFec;
+
+  // opusenc の後ろは queue から先の音声のストリーミングスレッドで処理される
+  GstPad *pad = gst_element_get_static_pad(mEncoder, "src");
+  if (pad) {
+    mCpuMeter.attach(pad);
+    gst_object_unref(pad);
+  }
+}
+
+void AudioEncoderController::detach()
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  if (mCpuMeter.isAttached()) {
+    mCpuMeter.detach();
+  }
+
+  if (mEncoder) {
+    gst_object_unref(mEncoder);
+    mEncoder = nullptr;
+  }
+
+  if (mPayloader) {
+    gst_object_unref(mPayloader);
+    mPayloader = nullptr;
+  }
+}
+
+void AudioEncoderController::report()
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  if (mCpuMeter.isAttached()) {
+    g_print("Audio stream thread CPU usage: %.2f%%\n", mCpuMeter.getAverageUsage());
+  }
+}
+
+void AudioEncoderController::onStats(const GstStructure *stats)
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  if (!mEncoder) {
+    return;
+  }
+
+#ifdef DEBUG_BUILD
+  g_print("Audio stream thread CPU usage: %.2f%%\n", mCpuMeter.sampleUsage());
+#endif
+
+  if (!mAdaptiveFec) {
+    return;
+  }
+
+  guint ssrc = getPayloaderSsrc();
+  gdouble fractionLost = -1.0;
+  WebRTCStats::foreach(stats, [&](GstWebRTCStatsType type, const GstStructure *stat) {
+    if (type != GST_WEBRTC_STATS_REMOTE_INBOUND_RTP) {
+      return;
+    }
+    guint statSsrc = 0;
+    if (gst_structure_get_uint(stat, "ssrc", &statSsrc) && statSsrc == ssrc) {
+      gst_structure_get_double(stat, "fraction-lost", &fractionLost);
+    }
+  });
+
+  if (fractionLost < 0.0) {
+    return;
+  }
+
+  gint percentage = CLAMP((gint) (fractionLost * 100.0 + 0.5), 0, 100);
+  if (percentage != mPacketLossPercentage) {
+    mPacketLossPercentage = percentage;
+    g_object_set(mEncoder, "packet-loss-percentage", percentage, NULL);
+  }
+
+  // 閾値付近で頻繁に切り替わらないように、無効にする場合は閾値の半分を下回った時にする
+  bool inbandFec = mInbandFec;
+  if (!mInbandFec && (guint) percentage >= mFecLossThreshold) {
+    inbandFec = true;
+  } else if (mInbandFec && (guint) percentage * 2 < mFecLossThreshold) {
+    inbandFec = false;
+  }
+
+  if (inbandFec != mInbandFec) {
+    mInbandFec = inbandFec;
+    g_object_set(mEncoder, "inband-fec", (gboolean) inbandFec, NULL);
+    g_print("Audio inband FEC %s (packet loss %d%%).\n", inbandFec ? "enabled" : "disabled", percentage);
+  }
+}
+
+gdouble AudioEncoderController::getAverageCpuUsage()
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mCpuMeter.getAverageUsage();
+}
+
+// private functions.
+
+guint AudioEncoderController::getPayloaderSsrc()
+{
+  guint ssrc = 0;
+  if (mPayloader) {
+    GstStructure *stats = NULL;
+    g_object_get(mPayloader, "stats", &stats, NULL);
+    if (stats) {
+      gst_structure_get_uint(stats, "ssrc", &ssrc);
+      gst_structure_free(stats);
+    }
+  }
+  return ssrc;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <mutex>
+#include <gst/gst.h>
+
+#include "gst-thread-cpu-meter.h"
+
+/**
+ * 配信している音声のエンコーダ (opusenc) を制御します。
+ * 
+ * パイプラインの中の audioenc (opusenc) と audiopay (rtpopuspay) という名前のエレメントを使用します。
+ * 受信側から報告されるパケットロス率に合わせて、opusenc の packet-loss-percentage と
+ * inband-fec を切り替えます。また、音声のストリーミングスレッドの CPU 使用率を計測します。
+ */
+class AudioEncoderController {
+private:
+  std::mutex mMutex;
+  GstElement *mEncoder;
+  GstElement *mPayloader;
+  ThreadCpuMeter mCpuMeter;
+
+  bool mAdaptiveFec;
+  guint mFecLossThreshold;
+  gint mPacketLossPercentage;
+  bool mInbandFec;
+
+  guint getPayloaderSsrc();
+
+public:
+  AudioEncoderController();
+  virtual ~AudioEncoderController();
+
+  /**
+   * 受信側のパケットロス率に合わせて FEC を切り替えるかを設定します。
+   * 
+   * @param enabled 有効にする場合は true
+   * @param threshold inband-fec を有効にするパケットロス率 (%)
+   */
+  inline void setAdaptiveFec(bool enabled, guint threshold) {
+    mAdaptiveFec = enabled;
+    mFecLossThreshold = threshold;
+  }
+
+  void attach(GstElement *pipeline);
+  void detach();
+
+  // 音声のストリーミングスレッドの CPU 使用率を出力します。トラックの追加・削除では出力しないように、パイプラインの停止時に呼び出します。
+  void report();
+
+  // webrtcbin の get-stats で取得した統計情報を渡します。
+  void onStats(const GstStructure *stats);
+
+  // 音声のストリーミングスレッドの平均 CPU 使用率 (%)
+  gdouble getAverageCpuUsage();
+};
@@ -5,10 +5,6 @@ WebRTCDataChannel::WebRTCDataChannel(GstElement *webrtcbin)
   mWebRTCBin = webrtcbin;
   mDataChannel = nullptr;
   mListener = nullptr;
-  mOpenHandleId = 0;
-  mCloseHandleId = 0;
-  mMessageHandleId = 0;
-  mErrorHandleId = 0;
 }
 
 WebRTCDataChannel::~WebRTCDataChannel()
@@ -18,14 +14,27 @@ WebRTCDataChannel::~WebRTCDataChannel()
 
 void WebRTCDataChannel::connect(GstWebRTCDataChannel *dataChannel)
 {
-  mDataChannel = dataChannel;
+  disconnect();
+
+  // on-data-channel で渡されるデータチャンネルは参照を持たないので、ここで参照を保持します。
+  mDataChannel = (GstWebRTCDataChannel *) g_object_ref(dataChannel);
   setCallback();
 }
 
-void WebRTCDataChannel::connect(std::string& name)
+void WebRTCDataChannel::connect(std::string& name, GstWebRTCPriorityType priority)
 {
+  disconnect();
+
+  GstStructure *options = NULL;
+  if (priority != 0) {
+    options = gst_structure_new("options", "priority", GST_TYPE_WEBRTC_PRIORITY_TYPE, priority, NULL);
+  }
+
   // 送信用のデータチャンネルを作成
-  g_signal_emit_by_name(mWebRTCBin, "create-data-channel", name.c_str(), NULL, &mDataChannel);
+  g_signal_emit_by_name(mWebRTCBin, "create-data-channel", name.c_str(), options, &mDataChannel);
+  if (options) {
+    gst_structure_free(options);
+  }
   if (mDataChannel) {
     setCallback();
   } else {
@@ -35,28 +44,15 @@ void WebRTCDataChannel::connect(std::string& name)
 
 void WebRTCDataChannel::disconnect()
 {
-  if (mOpenHandleId) {
-    g_signal_handler_disconnect(G_OBJECT(mDataChannel), mOpenHandleId);
-    mOpenHandleId = 0;
-  }
-
-  if (mCloseHandleId) {
-    g_signal_handler_disconnect(G_OBJECT(mDataChannel), mCloseHandleId);
-    mCloseHandleId = 0;
-  }
-
-  if (mMessageHandleId) {
-    g_signal_handler_disconnect(G_OBJECT(mDataChannel), mMessageHandleId);
-    mMessageHandleId = 0;
-  }
-
-  if (mErrorHandleId) {
-    g_signal_handler_disconnect(G_OBJECT(mDataChannel), mErrorHandleId);
-    mErrorHandleId = 0;
-  }
+  mOpenHandler.disconnect();
+  mCloseHandler.disconnect();
+  mMessageHandler.disconnect();
+  mMessageDataHandler.disconnect();
+  mErrorHandler.disconnect();
 
   if (mDataChannel) {
     gst_webrtc_data_channel_close(mDataChannel);
+    g_object_unref(mDataChannel);
     mDataChannel = nullptr;
   }
 }
@@ -68,18 +64,38 @@ void WebRTCDataChannel::sendMessage(std::string& message)
   }
 }
 
+void WebRTCDataChannel::sendData(const std::string& data)
+{
+  if (mDataChannel) {
+    GBytes *bytes = g_bytes_new(data.data(), data.size());
+    gst_webrtc_data_channel_send_data(mDataChannel, bytes);
+    g_bytes_unref(bytes);
+  }
+}
+
+guint64 WebRTCDataChannel::getBufferedAmount()
+{
+  guint64 bufferedAmount = 0;
+  if (mDataChannel) {
+    g_object_get(mDataChannel, "buffered-amount", &bufferedAmount, NULL);
+  }
+  return bufferedAmount;
+}
+
 // private functions.
 
 void WebRTCDataChannel::setCallback()
 {
-  mErrorHandleId = g_signal_connect(mDataChannel, "on-error", 
+  mErrorHandler.connect(mDataChannel, "on-error", 
       G_CALLBACK(WebRTCDataChannel::onError), this);
-  mOpenHandleId = g_signal_connect(mDataChannel, "on-open", 
+  mOpenHandler.connect(mDataChannel, "on-open", 
       G_CALLBACK(WebRTCDataChannel::onOpen), this);
-  mCloseHandleId = g_signal_connect(mDataChannel, "on-close", 
+  mCloseHandler.connect(mDataChannel, "on-close", 
       G_CALLBACK(WebRTCDataChannel::onClose),  this);
-  mMessageHandleId = g_signal_connect(mDataChannel, "on-message-string", 
+  mMessageHandler.connect(mDataChannel, "on-message-string", 
       G_CALLBACK(WebRTCDataChannel::onMessageString), this);
+  mMessageDataHandler.connect(mDataChannel, "on-message-data", 
+      G_CALLBACK(WebRTCDataChannel::onMessageData), this);
 }
 
 // callback functions.
@@ -113,3 +129,13 @@ void WebRTCDataChannel::onMessageString(GObject *dc, gchar *message, gpointer us
     channel->mListener->onMessage(channel, msg);
   }
 }
+
+void WebRTCDataChannel::onMessageData(GObject *dc, GBytes *data, gpointer userData)
+{
+  WebRTCDataChannel *channel = (WebRTCDataChannel *) userData;
+  if (channel && channel->mListener && data) {
+    gsize size = 0;
+    const guint8 *bytes = (const guint8 *) g_bytes_get_data(data, &size);
+    channel->mListener->onMessageData(channel, bytes, size);
+  }
+}
@@ -6,6 +6,8 @@
 #define GST_USE_UNSTABLE_API
 #include <gst/webrtc/webrtc.h>
 
+#include "gst-signal-handler.h"
+
 class WebRTCDataChannel;
 
 class WebRTCDataChannelListener {
@@ -13,6 +15,7 @@ public:
   virtual void onConnected(WebRTCDataChannel *channel) {}
   virtual void onDisconnected(WebRTCDataChannel *channel) {}
   virtual void onMessage(WebRTCDataChannel *channel, std::string& message) {}
+  virtual void onMessageData(WebRTCDataChannel *channel, const guint8 *data, gsize size) {}
 };
 
 class WebRTCDataChannel {
@@ -21,10 +24,11 @@ private:
   GstWebRTCDataChannel *mDataChannel;
   WebRTCDataChannelListener *mListener;
 
-  gint mOpenHandleId;
-  gint mCloseHandleId;
-  gint mMessageHandleId;
-  gint mErrorHandleId;
+  SignalHandler mOpenHandler;
+  SignalHandler mCloseHandler;
+  SignalHandler mMessageHandler;
+  SignalHandler mMessageDataHandler;
+  SignalHandler mErrorHandler;
 
   void setCallback();
 
@@ -32,17 +36,35 @@ private:
   static void onOpen(GObject *dc, gpointer userData);
   static void onClose(GObject *dc, gpointer userData);
   static void onMessageString(GObject *dc, gchar *message, gpointer userData);
+  static void onMessageData(GObject *dc, GBytes *data, gpointer userData);
 
 public:
-  WebRTCDataChannel(GstElement *webrtcbin);
+  WebRTCDataChannel(GstElement *webrtcbin = nullptr);
   virtual ~WebRTCDataChannel();
 
   inline void setListener(WebRTCDataChannelListener *listener) {
     mListener = listener;
   }
 
-  void connect(std::string& name);
+  // プールから再利用する場合に接続先の webrtcbin を差し替えます。
+  inline void setWebRTCBin(GstElement *webrtcbin) {
+    mWebRTCBin = webrtcbin;
+  }
+
+  /**
+   * 送信用のデータチャンネルを作成します。
+   *
+   * @param name データチャンネルの名前
+   * @param priority SCTP の送信の優先度、0 の場合は指定しません
+   */
+  void connect(std::string& name, GstWebRTCPriorityType priority = (GstWebRTCPriorityType) 0);
   void connect(GstWebRTCDataChannel *dataChannel);
   void disconnect();
   void sendMessage(std::string& message);
+
+  // バイナリのメッセージを送信します。
+  void sendData(const std::string& data);
+
+  // 送信バッファに溜まっているバイト数を取得します。
+  guint64 getBufferedAmount();
 };
@@ -1,4 +1,5 @@
 #include "gst-webrtc-main.h"
+#include "gst-signaling-message.h"
 
 static gchar *get_string_from_json_object(JsonObject *object)
 {
@@ -13,262 +14,1003 @@ static gchar *get_string_from_json_object(JsonObject *object)
 
 WebRTCMain::WebRTCMain()
 {
+  mListener = nullptr;
+  mTransport = nullptr;
   mClient = nullptr;
-  mPipeline = nullptr;
+  mRelaying = false;
+  mDraining = false;
+  mDrained = false;
+  mRejectWhileDraining = true;
+  mDrainTimerId = 0;
+  mVideoCodec = VIDEO_CODEC_VP8;
+  mVideoPassthrough = false;
+  mVideoShared = false;
 }
 
 WebRTCMain::~WebRTCMain()
 {
-  stopPipeline();
+  mListener = nullptr;
+  cancelIdles();
+
+  if (mDrainTimerId) {
+    g_source_remove(mDrainTimerId);
+    mDrainTimerId = 0;
+  }
+
+  stopAllPipelines();
+  disconnectSignallingServer();
+
+  if (mTransport) {
+    mTransport->setListener(nullptr);
+    mTransport = nullptr;
+  }
+
+  if (mClient) {
+    delete mClient;
+    mClient = nullptr;
+  }
+}
+
+void WebRTCMain::setConfig(WebRTCConfig& config)
+{
+  mConfig = config;
+
+  if (!mConfig.recordDir.empty()) {
+    g_mkdir_with_parents(mConfig.recordDir.c_str(), 0755);
+  }
+
+  if (!mConfig.traceDir.empty()) {
+    g_mkdir_with_parents(mConfig.traceDir.c_str(), 0755);
+  }
+
+  if (mConfig.iceSinglePort) {
+    mPortAllocator.setRange(mConfig.icePortMin, mConfig.icePortMax);
+  }
+
+  mAdmission.setLimits(mConfig.admission);
+
+  // 入力が VP8/H.264 の場合は、入力を 1 つだけ開いて、全てのセッションでデコードせずに共有する
+  mVideoFeed.stop();
+  mVideoCodec = VIDEO_CODEC_VP8;
+  mVideoPassthrough = false;
+  mVideoShared = false;
+  if (mConfig.videoSource == VIDEO_SOURCE_APPSRC) {
+    if (mConfig.videoSourceCodec == VIDEO_CODEC_RAW) {
+      g_printerr("appsrc requires an encoded video codec, using VP8.\n");
+    } else {
+      mVideoCodec = mConfig.videoSourceCodec;
+    }
+    mVideoPassthrough = true;
+  } else if (mConfig.videoSource == VIDEO_SOURCE_FILE || mConfig.videoSource == VIDEO_SOURCE_RTSP) {
+    VideoCodec codec = VideoSource::probeCodec(mConfig.videoSourceLocation);
+    if (codec != VIDEO_CODEC_RAW) {
+      // ファイルは最後まで再生したら先頭に戻る
+      bool loop = mConfig.videoSource == VIDEO_SOURCE_FILE;
+      if (mVideoFeed.start(createVideoFeedDescription(codec), loop)) {
+        mVideoCodec = codec;
+        mVideoPassthrough = true;
+      }
+    }
+    g_print("Video source %s: %s.\n", mConfig.videoSourceLocation.c_str(),
+        mVideoPassthrough ? VideoSource::getCodecName(mVideoCodec) : "decode and encode to VP8");
+  } else if (mConfig.videoSource == VIDEO_SOURCE_SCREEN || mConfig.videoSource == VIDEO_SOURCE_V4L2) {
+    // デバイスは 1 つのプロセスからしか開けないので、キャプチャを 1 つだけ動かして未圧縮のフレームを共有する
+    if (mVideoFeed.start(createCaptureFeedDescription(), false)) {
+      mVideoShared = true;
+    } else {
+      g_printerr("Failed to start %s capture.\n", VideoSource::getModeName(mConfig.videoSource));
+    }
+  }
+  mVideoShared = mVideoShared || mVideoPassthrough;
+}
+
+void WebRTCMain::startDrain(guint timeout, bool rejectNewPlayers)
+{
+  mRejectWhileDraining = rejectNewPlayers;
+  if (mDraining) {
+    return;
+  }
+  mDraining = true;
+
+  g_print("Draining %zu sessions.\n", mPipelines.size());
+
+  if (timeout > 0) {
+    mDrainTimerId = g_timeout_add_seconds(timeout, WebRTCMain::onDrainTimeout, this);
+  }
+  checkDrained();
+}
+
+void WebRTCMain::setTransport(SignalingTransport *transport)
+{
   disconnectSignallingServer();
+
+  if (mTransport) {
+    mTransport->setListener(nullptr);
+  }
+
+  mTransport = transport;
+  if (mTransport) {
+    mTransport->setListener(this);
+  }
 }
 
 void WebRTCMain::connectSignallingServer(std::string& url, std::string& origin)
 {
   disconnectSignallingServer();
 
-  mClient = new WebsocketClient();
-  mClient->setListener(this);
-  mClient->connectAsync(url, origin);
+  // トランスポートが設定されていない場合には WebsocketClient を使用する
+  // 再接続時には WebsocketClient を使い回す
+  if (!mTransport) {
+    if (!mClient) {
+      mClient = new WebsocketClient();
+    }
+    setTransport(mClient);
+  }
+  mTransport->connectAsync(url, origin);
 }
 
 void WebRTCMain::disconnectSignallingServer()
 {
-  if (mClient) {
-    delete mClient;
-    mClient = nullptr;
+  if (mTransport) {
+    mTransport->disconnect();
   }
 }
 
 // private functions.
 
-void WebRTCMain::startPipeline()
+WebRTCPipeline *WebRTCMain::findPipeline(std::string& peerId)
+{
+  auto itr = mPipelines.find(peerId);
+  if (itr == mPipelines.end()) {
+    return nullptr;
+  }
+  return itr->second;
+}
+
+std::string WebRTCMain::createPipelineDescription(std::string& peerId, bool isDegraded)
 {
-  stopPipeline();
+  bool isRecording = !mConfig.recordDir.empty();
 
   // webrtcbin エレメント名前は固定にしておく必要があります
   // webrtcbin name=webrtcbin を変更する場合には、呼び出している箇所も全て変更する必要があります。
-  std::string bin = "webrtcbin name=webrtcbin bundle-policy=max-bundle latency=100 stun-server=stun://stun.l.google.com:19302 \
-        videotestsrc is-live=true \
-         ! videoconvert \
+  std::string bin = "webrtcbin name=webrtcbin bundle-policy=max-bundle latency=100 ";
+
+  // ホスト候補だけを使う場合は STUN への問い合わせを待たないようにする
+  if (!mConfig.stunServer.empty() && mConfig.iceCandidatePolicy != ICE_CANDIDATE_POLICY_HOST) {
+    bin += "stun-server=" + mConfig.stunServer + " ";
+  }
+  if (!mConfig.turnServer.empty() && mConfig.iceCandidatePolicy != ICE_CANDIDATE_POLICY_HOST) {
+    bin += "turn-server=\"" + mConfig.turnServer + "\" ";
+  }
+  if (mConfig.iceCandidatePolicy == ICE_CANDIDATE_POLICY_RELAY) {
+    bin += "ice-transport-policy=relay ";
+  }
+
+  bin += createVideoDescription(isRecording, isDegraded);
+  if (!mConfig.audioOnDemand) {
+    bin += createAudioDescription(isRecording);
+  }
+
+  if (isRecording) {
+    bin += createRecorderDescription();
+  }
+
+  return bin;
+}
+
+/**
+ * 映像の記述を作成します。
+ * 
+ * isDegraded が true の場合は、AdmissionController で品質を下げて受け入れたセッションなので、ビットレートを下げます。
+ * エンコードせずに送信する場合は、ソースの符号化済みのストリームをそのままパケット化します。
+ */
+std::string WebRTCMain::createVideoDescription(bool isRecording, bool isDegraded)
+{
+  std::string bin = createVideoSourceDescription(isDegraded);
+  if (isVideoFallbackEnabled()) {
+    return bin + createVideoFallbackDescription(isDegraded);
+  }
+  if (isRecording) {
+    // エンコード済みの映像を録画用に分岐させる
+    bin += "! tee name=videotee \
+        videotee. \
+         ! queue ";
+  }
+  if (mVideoCodec == VIDEO_CODEC_H264) {
+    // SPS/PPS をキーフレームごとに送って、途中から受信しても復号できるようにする
+    bin += "! rtph264pay config-interval=-1 aggregate-mode=zero-latency \
+         ! application/x-rtp,media=video,encoding-name=H264,payload=96 ";
+  } else {
+    bin += "! rtpvp8pay \
+         ! application/x-rtp,media=video,encoding-name=VP8,payload=96 ";
+  }
+  if (mConfig.pacing) {
+    // 送信間隔を空けるために待つので、エンコーダとは別のスレッドにする
+    bin += "! queue name=videopacer ";
+  }
+  bin += createRelayDescription("video");
+  bin += "! webrtcbin. ";
+  return bin;
+}
+
+/**
+ * 映像ソースから符号化済みのストリームまでの記述を作成します。
+ * 
+ * 映像ソースの名前 (videosrc) は WebRTCPipeline で変化のないフレームを破棄するためと、
+ * VideoFeed から符号化済みのフレームを受け取る appsrc を探すために使用します。
+ * ファイルはリアルタイムのソースではないので、clocksync でタイムスタンプに合わせて送信します。
+ */
+std::string WebRTCMain::createVideoSourceDescription(bool isDegraded)
+{
+  std::string location = mConfig.videoSourceLocation;
+  std::string bin;
+
+  // 符号化済みの映像は VideoFeed から受け取る
+  if (mVideoPassthrough) {
+    return "appsrc name=videosrc is-live=true do-timestamp=true format=time ";
+  }
+
+  // 画面とカメラは VideoFeed から未圧縮のフレームを受け取り、セッションごとにエンコードする
+  // エンコーダが遅れた場合は古いフレームを捨てて、appsrc にフレームが溜まり続けないようにする
+  if (mVideoShared) {
+    bin = "appsrc name=videosrc is-live=true do-timestamp=true format=time \
+         ! queue leaky=downstream max-size-buffers=2 max-size-bytes=0 max-size-time=0 \
+         ! videoconvert ";
+    bin += "! queue ";
+    bin += createVideoEncoderDescription(isDegraded);
+    return bin;
+  }
+
+  switch (mConfig.videoSource) {
+  case VIDEO_SOURCE_FILE:
+    bin = "filesrc location=\"" + location + "\" \
+         ! decodebin \
+         ! video/x-raw \
+         ! clocksync \
+         ! videoconvert ";
+    break;
+  case VIDEO_SOURCE_RTSP:
+    bin = "rtspsrc location=\"" + location + "\" latency=200 \
+         ! decodebin \
+         ! video/x-raw \
+         ! videoconvert ";
+    break;
+  case VIDEO_SOURCE_TEST:
+  default:
+    bin = "videotestsrc name=videosrc is-live=true \
+         ! videoconvert ";
+    break;
+  }
+
+  bin += "! queue ";
+  bin += createVideoEncoderDescription(isDegraded);
+  return bin;
+}
+
+/**
+ * 映像のエンコーダの記述を作成します。
+ * 
+ * vp8enc の名前は SessionAccounting で CPU 使用率を計測するために使用します。
+ */
+std::string WebRTCMain::createVideoEncoderDescription(bool isDegraded)
+{
+  guint bitrate = isDegraded ? mConfig.degradedVideoBitrate : mConfig.videoBitrate;
+  return "! vp8enc name=videoenc target-bitrate=" + std::to_string(bitrate) + " deadline=1 ";
+}
+
+/**
+ * H.264 をそのまま送信する分岐と、VP8 に変換して送信する分岐を持つ映像の記述を作成します。
+ * 
+ * offer には H.264 (payload 96) と VP8 (payload 98) の両方を記述し、
+ * WebRTCPipeline が answer で選ばれた方の valve (passthroughvalve, transcodevalve) を開きます。
+ * 選ばれるまではどちらの valve も閉じているので、デコーダもエンコーダも動きません。
+ */
+std::string WebRTCMain::createVideoFallbackDescription(bool isDegraded)
+{
+  std::string bin = "! tee name=videotee \
+        videotee. \
+         ! valve name=passthroughvalve drop=true \
          ! queue \
-         ! vp8enc target-bitrate=10240000 deadline=1 \
-         ! rtpvp8pay \
-         ! application/x-rtp,media=video,encoding-name=VP8,payload=96 \
-         ! webrtcbin. \
-        audiotestsrc is-live=true \
-         ! audioconvert \
-         ! audioresample \
+         ! rtph264pay config-interval=-1 aggregate-mode=zero-latency pt=96 \
+         ! videofunnel. \
+        videotee. \
+         ! valve name=transcodevalve drop=true \
          ! queue \
-         ! opusenc \
-         ! rtpopuspay \
-         ! application/x-rtp,media=audio,encoding-name=OPUS,payload=97 \
-         ! webrtcbin. ";
+         ! decodebin \
+         ! videoconvert \
+         ! queue ";
+  bin += createVideoEncoderDescription(isDegraded);
+  bin += "! rtpvp8pay pt=98 \
+         ! videofunnel. \
+        funnel name=videofunnel \
+         ! application/x-rtp,media=video ";
+  bin += createRelayDescription("video");
+  bin += "! webrtcbin. ";
+  return bin;
+}
+
+/**
+ * VideoFeed で使用する入力用のパイプラインの記述を作成します。
+ * 
+ * H.264 は h264parse で SPS/PPS をキーフレームごとに挿入し、途中から受信しても復号できるようにします。
+ * ファイルは appsink で再生速度に合わせます。
+ */
+std::string WebRTCMain::createVideoFeedDescription(VideoCodec codec)
+{
+  std::string location = mConfig.videoSourceLocation;
+  bool isFile = mConfig.videoSource == VIDEO_SOURCE_FILE;
+  std::string bin;
+
+  if (isFile) {
+    bin = "filesrc location=\"" + location + "\" \
+         ! parsebin ";
+  } else {
+    bin = "rtspsrc location=\"" + location + "\" latency=200 ";
+    bin += codec == VIDEO_CODEC_H264 ? "! rtph264depay " : "! rtpvp8depay ";
+  }
 
-  mPipeline = new WebRTCPipeline();
-  mPipeline->setListener(this);
-  mPipeline->startPipeline(bin);
+  if (codec == VIDEO_CODEC_H264) {
+    bin += "! video/x-h264 \
+         ! h264parse config-interval=-1 \
+         ! video/x-h264,stream-format=byte-stream,alignment=au ";
+  } else {
+    bin += "! video/x-vp8 ";
+  }
+
+  bin += "! appsink name=feedsink ";
+  bin += isFile ? "sync=true " : "sync=false ";
+  return bin;
 }
 
-void WebRTCMain::stopPipeline()
+/**
+ * 画面とカメラのキャプチャを VideoFeed で共有するための入力用のパイプラインの記述を作成します。
+ * 
+ * 色空間の変換はここで 1 回だけ行い、各セッションの videoconvert は何もしないようにします。
+ */
+std::string WebRTCMain::createCaptureFeedDescription()
 {
-  if (mPipeline) {
-    delete mPipeline;
-    mPipeline = nullptr;
+  std::string location = mConfig.videoSourceLocation;
+  std::string bin;
+
+  if (mConfig.videoSource == VIDEO_SOURCE_SCREEN) {
+    // use-damage で変化した領域だけを X サーバから取得する
+    bin = "ximagesrc use-damage=true show-pointer=true ";
+    if (!location.empty()) {
+      bin += "display-name=" + location + " ";
+    }
+    bin += "! video/x-raw,framerate=" + std::to_string(mConfig.screenFramerate) + "/1 ";
+  } else {
+    // カーネルのバッファを dmabuf でそのまま受け取り、ユーザ空間へのコピーを行わない
+    bin = "v4l2src io-mode=dmabuf ";
+    if (!location.empty()) {
+      bin += "device=" + location + " ";
+    }
   }
+
+  bin += "! videoconvert \
+         ! video/x-raw,format=I420 \
+         ! appsink name=feedsink sync=false ";
+  return bin;
+}
+
+bool WebRTCMain::isVideoFallbackEnabled() const
+{
+  return mVideoPassthrough && mVideoCodec == VIDEO_CODEC_H264 && mConfig.videoTranscodeFallback;
 }
 
 /**
- * Websocket で送られてきた ICE or SDP の情報を webrtcbin に渡します。
+ * 音声の記述を作成します。
  * 
- * ICE 情報が格納された JSON オブジェクトのフォーマットは下記の通りです。
- * <pre>
- * {
- *   "type": "ice",
- *   "data": {
- *     "candidate": ...,
- *     "sdpMLineIndex": ...,
- *      ...
- *   }
- * }
- * </pre>
+ * 音声ソースが opus の 48kHz と同じ場合には、audioresample を通さずに opusenc に渡します。
+ * opusenc と rtpopuspay の名前は AudioEncoderController で使用します。
+ */
+std::string WebRTCMain::createAudioDescription(bool isRecording)
+{
+  std::string bin = createAudioTrackDescription(isRecording);
+  bin += createRelayDescription("audio");
+  bin += "! webrtcbin. ";
+  return bin;
+}
+
+/**
+ * 音声のソースから RTP のペイローダーまでの記述を作成します。
  * 
- * SDP 情報が格納された JSON オブジェクトのフォーマットは下記の通りです。
- * <pre>
- * {
- *   "type": "sdp",  
- *   "data": {
- *     "type": "answer",
- *     "sdp": "o=- [....]"
- *   }
- * }
- * </pre>
+ * WebRTCPipeline::addTrack で追加する場合は、この記述をそのまま bin にします。
+ */
+std::string WebRTCMain::createAudioTrackDescription(bool isRecording)
+{
+  std::string bin = "audiotestsrc is-live=true \
+         ! audio/x-raw,rate=" + std::to_string(mConfig.audioSourceRate) + " \
+         ! audioconvert ";
+  if (mConfig.audioSourceRate != 48000) {
+    bin += "! audioresample ";
+  }
+  bin += "! queue \
+         ! opusenc name=audioenc";
+  bin += " bitrate=" + std::to_string(mConfig.audioBitrate);
+  bin += " frame-size=" + std::to_string(mConfig.audioFrameSize);
+  bin += " complexity=" + std::to_string(mConfig.audioComplexity);
+  bin += mConfig.audioDtx ? " dtx=true" : " dtx=false";
+  bin += mConfig.audioInbandFec ? " inband-fec=true " : " inband-fec=false ";
+  if (isRecording) {
+    bin += "! tee name=audiotee \
+        audiotee. \
+         ! queue ";
+  }
+  bin += "! rtpopuspay name=audiopay";
+  bin += mConfig.audioDtx ? " dtx=true " : " ";
+  bin += "! application/x-rtp,media=audio,encoding-name=OPUS,payload=97 ";
+  return bin;
+}
 
- * @param data_json_object ICE or SDP 情報が格納された JSON オブジェクト
+/**
+ * webrtcbin に渡す RTP を分岐させて、RtpRelay で転送するための記述を作成します。
+ * 
+ * 転送用のキューは leaky にしてあるので、転送先への送信が詰まっても配信側は止まりません。
+ * シンクの名前 (videorelay, audiorelay) は WebRTCPipeline で RtpRelay を設定するために使用します。
+ * 転送するのは 1 セッションだけですが、転送中のセッションが終了した時に引き継げるように全てのセッションで分岐させておきます。
  */
-void WebRTCMain::praseSdpAndIce(std::string& message)
+std::string WebRTCMain::createRelayDescription(const std::string& media)
 {
-  const gchar *text = message.c_str();
+  if (mConfig.rtpRelayPort == 0) {
+    return "";
+  }
+  return "! tee name=" + media + "rtptee \
+        " + media + "rtptee. \
+         ! queue leaky=downstream max-size-buffers=0 max-size-bytes=0 max-size-time=200000000 \
+         ! fakesink name=" + media + "relay sync=false async=false \
+        " + media + "rtptee. ";
+}
 
-  JsonParser *json_parser = json_parser_new();
-  if (!json_parser_load_from_data(json_parser, text, -1, NULL)) {
-    g_error("Unknown message \"%s\", ignoring.", text);
-    return;
+/**
+ * エンコード済みの映像・音声を再エンコードせずに WebM に分割して保存するための記述を作成します。
+ * 
+ * 録画用のキューは leaky にしてあるので、ディスクへの書き込みが詰まっても配信側は止まりません。
+ * recorder エレメント名は WebRTCPipeline で保存先の設定と、終了時に EOS を送るために使用します。
+ */
+std::string WebRTCMain::createRecorderDescription()
+{
+  // WebM には H.264 を格納できないので、H.264 の場合は Matroska で保存する
+  bool isWebM = mVideoCodec != VIDEO_CODEC_H264;
+
+  guint64 segmentTime = (guint64) mConfig.recordSegmentDuration * GST_SECOND;
+  guint64 queueTime = (guint64) MAX(mConfig.recordQueueTime, 1) * GST_MSECOND;
+  std::string queue = "queue leaky=downstream max-size-buffers=0 max-size-bytes=0 max-size-time=" + std::to_string(queueTime) + " ";
+
+  std::string bin = "splitmuxsink name=recorder async-finalize=true";
+  bin += isWebM ? " muxer-factory=webmmux" : " muxer-factory=matroskamux";
+  bin += " max-size-time=" + std::to_string(segmentTime);
+  bin += " max-files=" + std::to_string(mConfig.recordMaxFiles) + " ";
+  bin += "videotee. ! " + queue;
+  // RTP 用の H.264 は byte-stream なので、matroskamux が受け付ける avc に変換する
+  // 変換しないと not-negotiated になり、送信と共有している tee が止まる
+  if (!isWebM) {
+    bin += "! h264parse ! video/x-h264,stream-format=avc,alignment=au ";
+  }
+  bin += "! recorder.video ";
+  // 音声を後から追加する場合は映像だけを録画する
+  if (!mConfig.audioOnDemand) {
+    bin += "audiotee. ! " + queue + "! recorder.audio_0 ";
   }
 
-  JsonNode *root_json = json_parser_get_root(json_parser);
-  if (!JSON_NODE_HOLDS_OBJECT(root_json)) {
-    g_error("Received message without json.\n\n");
-    g_object_unref(G_OBJECT(json_parser));
-    return;
+  return bin;
+}
+
+/**
+ * 録画の保存先を作成します。
+ * 
+ * ピア ID はシグナリングサーバから送られてくる値なので、英数字と - _ 以外は _ に置き換えてファイル名に使います。
+ */
+std::string WebRTCMain::createRecordLocation(std::string& peerId)
+{
+  std::string name = peerId.empty() ? "session" : peerId;
+  for (size_t i = 0; i < name.size(); i++) {
+    if (!g_ascii_isalnum(name[i]) && name[i] != '-' && name[i] != '_') {
+      name[i] = '_';
+    }
   }
-  JsonObject *root_json_object = json_node_get_object(root_json);
 
-  if (!json_object_has_member(root_json_object, "type")) {
-    g_error("Received message without type field.\n\n");
-    g_object_unref(G_OBJECT(json_parser));
-    return;
+  gint64 now = g_get_real_time() / G_USEC_PER_SEC;
+  bool isWebM = mVideoCodec != VIDEO_CODEC_H264;
+  gchar *location = g_strdup_printf("%s/%s-%" G_GINT64_FORMAT "-%%05d.%s",
+      mConfig.recordDir.c_str(), name.c_str(), now, isWebM ? "webm" : "mkv");
+  std::string result(location);
+  g_free(location);
+  return result;
+}
+
+void WebRTCMain::startPipeline(std::string& peerId)
+{
+  stopPipeline(peerId);
+
+  // 空いているポートがない場合は、他のセッションのポートを使わないように受け入れない
+  guint port = 0;
+  if (mConfig.iceSinglePort) {
+    port = mPortAllocator.acquire();
+    if (port == 0) {
+      g_printerr("No free ICE port in %u-%u.\n", mConfig.icePortMin, mConfig.icePortMax);
+      std::string reason("ports");
+      sendAdmissionMessage(peerId, ADMISSION_REJECT, reason);
+      return;
+    }
   }
-  const gchar *type_string = json_object_get_string_member(root_json_object, "type");
 
-  if (!json_object_has_member(root_json_object, "data")) {
-    g_error("Received message without data field.\n\n");
-    g_object_unref(G_OBJECT(json_parser));
-    return;
+  // リソースの上限を超える場合は、セッションを開始せずに接続先に通知する
+  AdmissionDecision decision = ADMISSION_ACCEPT;
+  if (mAdmission.isEnabled()) {
+    std::string reason;
+    decision = mAdmission.decide(getAdmissionUsage(), reason);
+    sendAdmissionMessage(peerId, decision, reason);
+    if (decision == ADMISSION_REJECT) {
+      if (port != 0) {
+        mPortAllocator.release(port);
+      }
+      return;
+    }
   }
 
-  JsonObject *data_json_object = json_object_get_object_member(root_json_object, "data");
+  std::string bin = createPipelineDescription(peerId, decision == ADMISSION_DEGRADE);
 
-  if (g_strcmp0 (type_string, "sdp") == 0) {
-    parseSdp(data_json_object);
-  } else if (g_strcmp0 (type_string, "ice") == 0) {
-    parseIce(data_json_object);
+  WebRTCPipeline *pipeline = mPipelinePool.acquire();
+  pipeline->setPeerId(peerId);
+  pipeline->setListener(this);
+  pipeline->setStatsInterval(mConfig.statsInterval);
+  pipeline->setIceCandidatePolicy(mConfig.iceCandidatePolicy);
+  pipeline->setIceTcp(mConfig.iceTcp);
+  pipeline->setAllocatedPort(port);
+  if (port != 0) {
+    pipeline->setIcePortRange(port, port);
+  } else {
+    pipeline->setIcePortRange(mConfig.icePortMin, mConfig.icePortMax);
+  }
+  pipeline->setTraceOutput(mConfig.tracePrint, mConfig.traceDir);
+  pipeline->setRecordLocation(mConfig.recordDir.empty() ? std::string() : createRecordLocation(peerId));
+  pipeline->setMemoryReport(mConfig.memoryReport);
+  pipeline->setSdpMinimize(mConfig.sdpMinimize);
+  if (mConfig.pacing) {
+    guint64 bitrate = decision == ADMISSION_DEGRADE ? mConfig.degradedVideoBitrate : mConfig.videoBitrate;
+    pipeline->setPacing(bitrate, mConfig.pacingBurst, mConfig.pacingMaxDelay);
+  } else {
+    pipeline->setPacing(0, 0, 0);
+  }
+  pipeline->setFrameSkip(mConfig.videoSource == VIDEO_SOURCE_SCREEN ? mConfig.screenKeepAlive : 0);
+  pipeline->setRtpRelay(mConfig.rtpRelayHost, mConfig.rtpRelayPort, mConfig.rtpRelayMode);
+  pipeline->getRpc().setCompressThreshold(mConfig.rpcCompressThreshold);
+  pipeline->setDataChannelPriority((GstWebRTCPriorityType) mConfig.dataChannelPriority);
+  pipeline->getDataScheduler().setLinkBandwidth(mConfig.linkBandwidth, mConfig.dataChannelMinBitrate);
+  for (guint i = 0; i < DATA_CHANNEL_CLASS_COUNT; i++) {
+    pipeline->getDataScheduler().setWeight((DataChannelClass) i, mConfig.dataChannelWeights[i]);
+  }
+  registerRpcMethods(pipeline);
+  pipeline->getAudioController().setAdaptiveFec(mConfig.audioAdaptiveFec, mConfig.audioFecLossThreshold);
+  if (isVideoFallbackEnabled()) {
+    std::string preferences = "application/x-rtp,media=video,encoding-name=H264,payload=96,clock-rate=90000,"
+        "packetization-mode=(string)1,profile-level-id=(string)" + mConfig.h264ProfileLevelId + ";"
+        "application/x-rtp,media=video,encoding-name=VP8,payload=98,clock-rate=90000";
+    pipeline->setVideoCodecPreferences(preferences);
+    pipeline->setPayloadValves({ { 96, "passthroughvalve" }, { 98, "transcodevalve" } });
   } else {
-    g_print("Received unknown type. %s\n", type_string);
+    pipeline->setVideoCodecPreferences("");
+    pipeline->setPayloadValves({});
+  }
+  mPipelines[peerId] = pipeline;
+  pipeline->startPipeline(bin);
+
+  if (mConfig.rtpRelayPort != 0 && !mRelaying) {
+    mRelaying = pipeline->startRtpRelay();
+    if (mRelaying) {
+      mRelayPeerId = peerId;
+    }
+  }
+
+  if (mVideoShared) {
+    GstElement *source = pipeline->getElementByName("videosrc");
+    if (source) {
+      mVideoFeed.addSubscriber(source);
+      gst_object_unref(source);
+    }
   }
-  
-  g_object_unref(G_OBJECT(json_parser));
 }
 
-void WebRTCMain::parseSdp(JsonObject *data_json_object)
+void WebRTCMain::stopPipeline(std::string& peerId)
 {
-  if (!json_object_has_member(data_json_object, "type")) {
-    g_error ("Received SDP message without type field\n");
+  auto itr = mPipelines.find(peerId);
+  if (itr == mPipelines.end()) {
     return;
   }
-  const gchar *sdp_type_string = json_object_get_string_member(data_json_object, "type");
 
-  if (!json_object_has_member(data_json_object, "sdp")) {
-    g_error ("Received SDP message without SDP string\n");
-    return;
+  WebRTCPipeline *pipeline = itr->second;
+  mPipelines.erase(itr);
+
+  if (mVideoShared) {
+    GstElement *source = pipeline->getElementByName("videosrc");
+    if (source) {
+      mVideoFeed.removeSubscriber(source);
+      gst_object_unref(source);
+    }
+  }
+
+  pipeline->stopPipeline();
+  pipeline->setListener(nullptr);
+
+  // 転送していたセッションが終了した場合は、残っているセッションから転送を引き継ぐ
+  if (mRelaying && mRelayPeerId == peerId) {
+    mRelaying = false;
+    mRelayPeerId.clear();
+    for (auto next = mPipelines.begin(); next != mPipelines.end() && !mRelaying; ++next) {
+      if (next->second->startRtpRelay()) {
+        mRelaying = true;
+        mRelayPeerId = next->first;
+        g_print("RTP relay handed over to \"%s\".\n", mRelayPeerId.c_str());
+      }
+    }
   }
-  const gchar *sdp_string = json_object_get_string_member(data_json_object, "sdp");
 
-  if (g_strcmp0(sdp_type_string, "answer") == 0) {
-    mPipeline->onAnswerReceived(sdp_string);
-  } else if (g_strcmp0(sdp_type_string, "offer") == 0) {
-    mPipeline->onOfferReceived(sdp_string);
+  if (pipeline->getAllocatedPort() != 0) {
+    mPortAllocator.release(pipeline->getAllocatedPort());
+    pipeline->setAllocatedPort(0);
   }
+
+#ifdef DEBUG_BUILD
+  g_print("WebRTCPipeline allocations: %zu/%zu, WebRTCDataChannel allocations: %zu\n",
+      mPipelinePool.getAllocationCount(), mPipelinePool.getAcquireCount(),
+      pipeline->getDataChannelAllocationCount());
+#endif
+
+  checkDrained();
+
+  mPipelinePool.release(pipeline);
 }
 
-void WebRTCMain::parseIce(JsonObject *data_json_object)
+void WebRTCMain::stopAllPipelines()
 {
-  if (!json_object_has_member(data_json_object, "sdpMLineIndex")) {
-    g_error("Received ICE message without mline index\n\n");
-    return;
+  while (!mPipelines.empty()) {
+    std::string peerId = mPipelines.begin()->first;
+    stopPipeline(peerId);
   }
-  guint mline_index = json_object_get_int_member(data_json_object, "sdpMLineIndex");
+}
 
-  if (!json_object_has_member(data_json_object, "candidate")) {
-    g_error("Received ICE message without ICE candidate string\n\n");
+/**
+ * ドレイン中に全てのセッションが終了していれば、WebRTCMainListener に通知します。
+ */
+void WebRTCMain::checkDrained()
+{
+  if (!mDraining || mDrained || !mPipelines.empty()) {
     return;
   }
-  const gchar *candidate_string = json_object_get_string_member(data_json_object, "candidate");
+  mDrained = true;
+
+  if (mDrainTimerId) {
+    g_source_remove(mDrainTimerId);
+    mDrainTimerId = 0;
+  }
 
-  mPipeline->onIceReceived(mline_index, candidate_string);
+  if (mListener) {
+    mListener->onDrained(this);
+  }
 }
 
-// WebsocketClientListener implements.
+/**
+ * 配信中の全てのセッションが使用しているリソースを合計します。
+ */
+AdmissionUsage WebRTCMain::getAdmissionUsage()
+{
+  AdmissionUsage usage;
+  for (auto itr = mPipelines.begin(); itr != mPipelines.end(); ++itr) {
+    SessionAccounting& accounting = itr->second->getAccounting();
+    usage.sessions++;
+    usage.cpu += accounting.getCpuUsage();
+    usage.memory += accounting.getQueuedBytes();
+    usage.bandwidth += accounting.getBitrate();
+  }
+  return usage;
+}
 
-void WebRTCMain::onConnected(WebsocketClient *client)
+/**
+ * 受け入れの判定結果を接続先に通知します。
+ * 
+ * <pre>
+ * {
+ *   "type": "admission",
+ *   "data": {
+ *     "decision": "accept" | "degrade" | "reject",
+ *     "reason": "sessions" | "cpu" | "memory" | "bandwidth"
+ *   }
+ * }
+ * </pre>
+ */
+void WebRTCMain::sendAdmissionMessage(std::string& peerId, AdmissionDecision decision, std::string& reason)
 {
+  const char *name = AdmissionController::getDecisionName(decision);
+  if (decision != ADMISSION_ACCEPT) {
+    g_print("Admission %s for peer \"%s\": %s\n", name, peerId.c_str(), reason.c_str());
+  }
+
+  JsonObject *admission_json = json_object_new();
+  json_object_set_string_member(admission_json, "type", "admission");
+
+  JsonObject *admission_data_json = json_object_new();
+  json_object_set_string_member(admission_data_json, "decision", name);
+  if (!reason.empty()) {
+    json_object_set_string_member(admission_data_json, "reason", reason.c_str());
+  }
+  json_object_set_object_member(admission_json, "data", admission_data_json);
+
+  gchar *json_string = get_string_from_json_object(admission_json);
+  if (json_string) {
+    std::string message(json_string);
+    sendSignalingMessage(peerId, message);
+    g_free(json_string);
+  }
+
+  json_object_unref(admission_json);
+}
+
+size_t WebRTCMain::sendSignalingMessage(std::string& peerId, std::string& message)
+{
+  if (!mTransport) {
+    return 0;
+  }
+  return mTransport->sendMessage(peerId, message);
+}
+
+size_t WebRTCMain::sendSignalingMessage(WebRTCPipeline *pipeline, std::string& message)
+{
+  std::string peerId = pipeline->getPeerId();
+  return sendSignalingMessage(peerId, message);
+}
+
+/**
+ * Websocket で送られてきた ICE or SDP の情報を webrtcbin に渡します。
+ * 
+ * メッセージのフォーマットは SignalingMessage を参照してください。
+ */
+void WebRTCMain::praseSdpAndIce(WebRTCPipeline *pipeline, std::string& message, size_t size)
+{
+  SignalingPayload payload;
+  if (!SignalingMessage::decode(message, payload)) {
+    g_printerr("Unknown message \"%s\", ignoring.\n", message.c_str());
+    return;
+  }
+
+  if (payload.type == "sdp" || payload.type == "ice") {
+    pipeline->countSignalingMessage(false, payload.type == "sdp", size);
+  }
+
+  if (payload.type == "sdp") {
+    if (payload.sdpType == "answer") {
+      pipeline->onAnswerReceived(payload.sdp.c_str());
+    } else if (payload.sdpType == "offer") {
+      pipeline->onOfferReceived(payload.sdp.c_str());
+    }
+  } else if (payload.type == "ice") {
+    pipeline->onIceReceived(payload.sdpMLineIndex, payload.candidate.c_str());
+  } else {
+    g_print("Received unknown type. %s\n", payload.type.c_str());
+  }
+}
 
+// SignalingTransportListener implements.
+
+void WebRTCMain::onConnected(SignalingTransport *transport)
+{
+  if (mListener) {
+    mListener->onSignalingConnected(this);
+  }
 }
 
-void WebRTCMain::onDisconnected(WebsocketClient *client)
+void WebRTCMain::onDisconnected(SignalingTransport *transport)
 {
 
 }
 
-void WebRTCMain::onMessage(WebsocketClient *client, std::string& message)
+void WebRTCMain::onMessage(SignalingTransport *transport, std::string& peerId, std::string& message, size_t size)
 {
   const char *text = message.c_str();
   if (g_strcmp0(text, "playerConnected") == 0) {
-    startPipeline();
+    if (mDraining) {
+      // 後継のプロセスに引き継いでいる場合は、後継のプロセスがこの接続先を受け付ける
+      if (mRejectWhileDraining) {
+        std::string reason("draining");
+        sendAdmissionMessage(peerId, ADMISSION_REJECT, reason);
+      }
+      return;
+    }
+
+    gint64 timestamp = g_get_monotonic_time();
+    startPipeline(peerId);
+
+    WebRTCPipeline *pipeline = findPipeline(peerId);
+    if (pipeline) {
+      pipeline->getTrace().mark("player-connected", timestamp);
+    }
   } else if (g_strcmp0(text, "playerDisconnected") == 0) {
-    stopPipeline();
+    stopPipeline(peerId);
   } else {
-    praseSdpAndIce(message);
+    WebRTCPipeline *pipeline = findPipeline(peerId);
+    if (pipeline) {
+      praseSdpAndIce(pipeline, message, size);
+    } else {
+      g_printerr("Received message for unknown peer \"%s\", ignoring.\n", peerId.c_str());
+    }
+  }
+}
+
+/**
+ * 他のスレッドから、メインスレッドで行う処理を追加します。
+ * 
+ * request は処理の後か、破棄時に取り消された時に delete されます。
+ * 処理を行うコールバックでは、最初に finishIdle を呼び出してください。
+ */
+void WebRTCMain::postIdle(IdleRequest *request, GSourceFunc func)
+{
+  // コールバックは finishIdle でロックを取るので、ID を記録する前に実行されることはない
+  std::lock_guard<std::mutex> lock(mIdleMutex);
+  request->main = this;
+  request->sourceId = g_idle_add_full(G_PRIORITY_DEFAULT_IDLE, func, request, WebRTCMain::onIdleRequestDestroy);
+  mIdleSourceIds.insert(request->sourceId);
+}
+
+void WebRTCMain::finishIdle(IdleRequest *request)
+{
+  std::lock_guard<std::mutex> lock(mIdleMutex);
+  mIdleSourceIds.erase(request->sourceId);
+}
+
+// まだ実行されていない処理を取り消す、request は GSource の破棄時に delete される
+void WebRTCMain::cancelIdles()
+{
+  std::lock_guard<std::mutex> lock(mIdleMutex);
+  for (auto itr = mIdleSourceIds.begin(); itr != mIdleSourceIds.end(); ++itr) {
+    g_source_remove(*itr);
   }
+  mIdleSourceIds.clear();
+}
+
+// callback functions.
+
+void WebRTCMain::onIdleRequestDestroy(gpointer userData)
+{
+  delete (IdleRequest *) userData;
+}
+
+gboolean WebRTCMain::onSetAudioIdle(gpointer userData)
+{
+  SetAudioRequest *data = (SetAudioRequest *) userData;
+  data->main->finishIdle(data);
+  // セッションが既に終了している場合は何もしない
+  data->main->setAudioEnabled(data->peerId, data->enabled);
+  return G_SOURCE_REMOVE;
+}
+
+gboolean WebRTCMain::onPeerConnectedIdle(gpointer userData)
+{
+  PeerConnectedRequest *data = (PeerConnectedRequest *) userData;
+  data->main->finishIdle(data);
+
+  // 接続前に送ったフレームは捨てられているので、接続が完了してから GOP を送る
+  // セッションが既に終了している場合は何もしない
+  WebRTCPipeline *pipeline = data->main->findPipeline(data->peerId);
+  if (pipeline) {
+    GstElement *source = pipeline->getElementByName("videosrc");
+    if (source) {
+      data->main->mVideoFeed.replay(source);
+      gst_object_unref(source);
+    }
+  }
+  return G_SOURCE_REMOVE;
+}
+
+gboolean WebRTCMain::onDrainTimeout(gpointer userData)
+{
+  WebRTCMain *main = (WebRTCMain *) userData;
+  main->mDrainTimerId = 0;
+
+  g_print("Drain timed out, stopping %zu sessions.\n", main->mPipelines.size());
+  main->stopAllPipelines();
+  return G_SOURCE_REMOVE;
 }
 
 // WebRTCPipelineListener implements.
 
 void WebRTCMain::onSendSdp(WebRTCPipeline *pipeline, gint type, gchar *sdp_string)
 {
-  JsonObject *sdp = json_object_new();
-
+  const char *sdp_type = NULL;
   if (type == GST_WEBRTC_SDP_TYPE_OFFER) {
-    json_object_set_string_member(sdp, "type", "offer");
+    sdp_type = "offer";
   } else if (type == GST_WEBRTC_SDP_TYPE_ANSWER) {
-    json_object_set_string_member(sdp, "type", "answer");
+    sdp_type = "answer";
   } else {
     g_assert_not_reached();
   }
 
-  json_object_set_string_member(sdp, "sdp", sdp_string);
+  std::string message;
+  if (SignalingMessage::encodeSdp(sdp_type, sdp_string, message)) {
+    // 受信側と同じく、宛先指定の封筒を含めたトランスポートでのバイト数を数える
+    pipeline->countSignalingMessage(true, true, sendSignalingMessage(pipeline, message));
+  }
+}
 
-  JsonObject *sdp_json = json_object_new();
-  json_object_set_string_member(sdp_json, "type", "sdp");
-  json_object_set_object_member(sdp_json, "data", sdp);
+void WebRTCMain::onSendIceCandidate(WebRTCPipeline *pipeline, guint mlineindex, gchar *candidate)
+{
+  std::string message;
+  if (SignalingMessage::encodeIce(mlineindex, candidate, message)) {
+    pipeline->countSignalingMessage(true, false, sendSignalingMessage(pipeline, message));
+  }
+}
 
-  gchar *json_string = get_string_from_json_object(sdp_json);
-  if (json_string) {
-    if (mClient) {
-      std::string message(json_string);
-      mClient->sendMessage(message);
-    }
-    g_free(json_string);
+void WebRTCMain::onAddStream(WebRTCPipeline *pipeline, GstPad *pad)
+{
+  // TODO 相手からの映像・音声のストリームが送られてきた時の処理を行う
+}
+
+void WebRTCMain::onPeerConnected(WebRTCPipeline *pipeline)
+{
+  if (!mVideoShared) {
+    return;
   }
 
-  json_object_unref(sdp_json);
+  // webrtcbin のスレッドで呼ばれるので、パイプラインと VideoFeed の操作はメインスレッドで行う
+  PeerConnectedRequest *data = new PeerConnectedRequest();
+  data->peerId = pipeline->getPeerId();
+  postIdle(data, WebRTCMain::onPeerConnectedIdle);
 }
 
-void WebRTCMain::onSendIceCandidate(WebRTCPipeline *pipeline, guint mlineindex, gchar *candidate)
+/**
+ * データチャンネルの RPC で呼び出せるメソッドを登録します。
+ * 
+ * ハンドラはデータチャンネルのスレッドで呼び出されるので、メインスレッドで処理が必要な場合は g_idle_add などで渡してください。
+ */
+void WebRTCMain::registerRpcMethods(WebRTCPipeline *pipeline)
 {
-  JsonObject *ice_json = json_object_new();
-  json_object_set_string_member(ice_json, "type", "ice");
+  RpcEndpoint& rpc = pipeline->getRpc();
 
-  JsonObject *ice_data_json = json_object_new();
-  json_object_set_int_member(ice_data_json, "sdpMLineIndex", mlineindex);
-  json_object_set_string_member(ice_data_json, "candidate", candidate);
-  json_object_set_object_member(ice_json, "data", ice_data_json);
+  rpc.registerMethod(RPC_METHOD_ECHO, [](const std::string& request, std::string& response) -> guint32 {
+    response = request;
+    return RPC_STATUS_OK;
+  });
 
-  gchar *json_string = get_string_from_json_object(ice_json);
-  if (json_string) {
-    if (mClient) {
-      std::string message(json_string);
-      mClient->sendMessage(message);
+  rpc.registerMethod(RPC_METHOD_GET_TIME, [](const std::string& request, std::string& response) -> guint32 {
+    response = std::to_string(g_get_real_time());
+    return RPC_STATUS_OK;
+  });
+
+  std::string peerId = pipeline->getPeerId();
+  rpc.registerMethod(RPC_METHOD_SET_AUDIO, [this, peerId](const std::string& request, std::string& response) -> guint32 {
+    if (request != "0" && request != "1") {
+      return RPC_STATUS_BAD_REQUEST;
     }
-    g_free(json_string);
-  }
+    if (!mConfig.audioOnDemand) {
+      response = "audio-on-demand is disabled";
+      return RPC_STATUS_APPLICATION;
+    }
+
+    // パイプラインの変更はメインスレッドで行う
+    SetAudioRequest *data = new SetAudioRequest();
+    data->peerId = peerId;
+    data->enabled = request == "1";
+    postIdle(data, WebRTCMain::onSetAudioIdle);
 
-  json_object_unref(ice_json);
+    response = request;
+    return RPC_STATUS_OK;
+  });
 }
 
-void WebRTCMain::onAddStream(WebRTCPipeline *pipeline, GstPad *pad)
+bool WebRTCMain::setAudioEnabled(std::string& peerId, bool enabled)
 {
-  // TODO 相手からの映像・音声のストリームが送られてきた時の処理を行う
+  WebRTCPipeline *pipeline = findPipeline(peerId);
+  if (!pipeline || !mConfig.audioOnDemand) {
+    return false;
+  }
+
+  std::string name("audiotrack");
+  if (pipeline->hasTrack(name) == enabled) {
+    return true;
+  }
+  if (enabled) {
+    return pipeline->addTrack(name, createAudioTrackDescription(false));
+  }
+  return pipeline->removeTrack(name);
 }
 
 void WebRTCMain::onDataChannelConnected(WebRTCPipeline *pipeline)
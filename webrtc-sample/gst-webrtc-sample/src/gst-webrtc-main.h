@@ -1,37 +1,193 @@
 #pragma once
 
+#include <map>
+#include <mutex>
+#include <set>
 #include <json-glib/json-glib.h>
 
+#include "gst-admission-controller.h"
+#include "gst-object-pool.h"
+#include "gst-port-allocator.h"
+#include "gst-signaling-transport.h"
+#include "gst-video-feed.h"
+#include "gst-video-source.h"
+#include "gst-webrtc-config.h"
 #include "gst-webrtc-pipeline.h"
 #include "gst-websocket-client.h"
 
-class WebRTCMain : public WebsocketClientListener, WebRTCPipelineListener {
+// データチャンネルの RPC で提供するメソッド ID
+enum RpcMethod {
+  // リクエストをそのまま返す
+  RPC_METHOD_ECHO = 1,
+  // サーバの時刻 (g_get_real_time, マイクロ秒) を 10 進数の文字列で返す
+  RPC_METHOD_GET_TIME = 2,
+  // リクエストが "1" の場合は音声のトラックを追加、"0" の場合は削除する (--audio-on-demand の場合のみ)
+  RPC_METHOD_SET_AUDIO = 3
+};
+
+class WebRTCMain;
+
+class WebRTCMainListener {
+public:
+  // シグナリングサーバに接続した場合
+  virtual void onSignalingConnected(WebRTCMain *main) {}
+  // ドレイン中に全てのセッションが終了した場合、または期限を過ぎた場合
+  virtual void onDrained(WebRTCMain *main) {}
+};
+
+class WebRTCMain : public SignalingTransportListener, WebRTCPipelineListener {
 private:
+  // 他のスレッドからメインスレッドに渡す処理、破棄時に取り消せるように GSource の ID を持つ
+  struct IdleRequest {
+    WebRTCMain *main;
+    guint sourceId;
+    virtual ~IdleRequest() {}
+  };
+
+  // RPC のスレッドからメインスレッドに渡す音声の切り替え
+  struct SetAudioRequest : IdleRequest {
+    std::string peerId;
+    bool enabled;
+  };
+
+  struct PeerConnectedRequest : IdleRequest {
+    std::string peerId;
+  };
+
+  std::mutex mIdleMutex;
+  std::set<guint> mIdleSourceIds;
+
+  WebRTCConfig mConfig;
+  WebRTCMainListener *mListener;
+  SignalingTransport *mTransport;
   WebsocketClient *mClient;
-  WebRTCPipeline *mPipeline;
 
-  void startPipeline();
-  void stopPipeline();
-  void praseSdpAndIce(std::string& message);
-  void parseSdp(JsonObject *data_json_object);
-  void parseIce(JsonObject *data_json_object);
+  // ピア ID ごとのパイプライン
+  // 宛先指定を行わないトランスポートでは、ピア ID が空文字のパイプラインが 1 つだけになります。
+  std::map<std::string, WebRTCPipeline*> mPipelines;
+  ObjectPool<WebRTCPipeline> mPipelinePool;
+  UdpPortAllocator mPortAllocator;
+  AdmissionController mAdmission;
+
+  // RTP を転送しているセッションのピア ID、同じ内容を重複して転送しないように 1 セッションだけが転送する
+  std::string mRelayPeerId;
+  bool mRelaying;
+
+  // 送信する映像のコーデック、入力が VP8/H.264 の場合はエンコードせずにそのまま送信する
+  VideoCodec mVideoCodec;
+  bool mVideoPassthrough;
+  // 映像ソースを VideoFeed で全てのセッションと共有する (符号化済みの入力と、画面・カメラのキャプチャ)
+  bool mVideoShared;
+  VideoFeed mVideoFeed;
+
+  bool mDraining;
+  bool mDrained;
+  bool mRejectWhileDraining;
+  guint mDrainTimerId;
+
+  WebRTCPipeline *findPipeline(std::string& peerId);
+  std::string createPipelineDescription(std::string& peerId, bool isDegraded);
+  std::string createVideoDescription(bool isRecording, bool isDegraded);
+  std::string createVideoSourceDescription(bool isDegraded);
+  std::string createVideoEncoderDescription(bool isDegraded);
+  std::string createVideoFallbackDescription(bool isDegraded);
+  std::string createVideoFeedDescription(VideoCodec codec);
+  std::string createCaptureFeedDescription();
+  bool isVideoFallbackEnabled() const;
+  std::string createAudioDescription(bool isRecording);
+  std::string createAudioTrackDescription(bool isRecording);
+  std::string createRelayDescription(const std::string& media);
+  std::string createRecorderDescription();
+  std::string createRecordLocation(std::string& peerId);
+  void startPipeline(std::string& peerId);
+  void stopPipeline(std::string& peerId);
+  void stopAllPipelines();
+  AdmissionUsage getAdmissionUsage();
+  void sendAdmissionMessage(std::string& peerId, AdmissionDecision decision, std::string& reason);
+  size_t sendSignalingMessage(std::string& peerId, std::string& message);
+  size_t sendSignalingMessage(WebRTCPipeline *pipeline, std::string& message);
+  void registerRpcMethods(WebRTCPipeline *pipeline);
+  void checkDrained();
+
+  void postIdle(IdleRequest *request, GSourceFunc func);
+  void finishIdle(IdleRequest *request);
+  void cancelIdles();
+
+  static gboolean onDrainTimeout(gpointer userData);
+  static void onIdleRequestDestroy(gpointer userData);
+  static gboolean onSetAudioIdle(gpointer userData);
+  static gboolean onPeerConnectedIdle(gpointer userData);
+  void praseSdpAndIce(WebRTCPipeline *pipeline, std::string& message, size_t size);
 
 public:
   WebRTCMain();
   virtual ~WebRTCMain();
 
+  void setConfig(WebRTCConfig& config);
+
+  inline void setListener(WebRTCMainListener *listener) {
+    mListener = listener;
+  }
+
+  /**
+   * ドレインを開始します。
+   * 
+   * 新しい playerConnected ではセッションを開始せず、配信中のセッションはそのまま終了するまで続けます。
+   * 全てのセッションが終了するか、timeout 秒を過ぎた時点で残りのセッションを終了して、
+   * WebRTCMainListener::onDrained を呼び出します。
+   * 
+   * @param timeout セッションの終了を待つ最大時間 (秒)、0 の場合は無制限
+   * @param rejectNewPlayers 新しい接続先に reject を通知する場合は true、
+   *                         後継のプロセスが新しい接続先を受け付けている場合は false
+   */
+  void startDrain(guint timeout, bool rejectNewPlayers);
+
+  inline bool isDraining() const {
+    return mDraining;
+  }
+
+  /**
+   * 符号化済みの映像を全てのセッションに渡す VideoFeed。
+   *
+   * 映像ソースが appsrc の場合は、アプリケーションが setCaps と pushBuffer でフレームを渡します。
+   */
+  inline VideoFeed& getVideoFeed() {
+    return mVideoFeed;
+  }
+
+  /**
+   * 接続中のセッションの音声のトラックを追加・削除します。
+   *
+   * 設定の audioOnDemand が有効な場合に、パイプラインを作り直さずに再ネゴシエーションで切り替えます。
+   * メインスレッドから呼び出してください。
+   */
+  bool setAudioEnabled(std::string& peerId, bool enabled);
+
+  inline size_t getSessionCount() const {
+    return mPipelines.size();
+  }
+
+  /**
+   * シグナリングに使用するトランスポートを設定します。
+   * 
+   * 設定されたトランスポートの所有権は移りません。
+   * 設定されていない場合には connectSignallingServer で WebsocketClient を作成します。
+   */
+  void setTransport(SignalingTransport *transport);
+
   void connectSignallingServer(std::string& url, std::string& origin);
   void disconnectSignallingServer();
 
-  // WebsocketClientListener implements.
-  virtual void onConnected(WebsocketClient *client);
-  virtual void onDisconnected(WebsocketClient *client);
-  virtual void onMessage(WebsocketClient *client, std::string& message);
+  // SignalingTransportListener implements.
+  virtual void onConnected(SignalingTransport *transport);
+  virtual void onDisconnected(SignalingTransport *transport);
+  virtual void onMessage(SignalingTransport *transport, std::string& peerId, std::string& message, size_t size);
 
   // WebRTCPipelineListener implements.
   virtual void onSendSdp(WebRTCPipeline *pipeline, gint type, gchar *sdp_string);
   virtual void onSendIceCandidate(WebRTCPipeline *pipeline, guint mlineindex, gchar *candidate);
   virtual void onAddStream(WebRTCPipeline *pipeline, GstPad *pad);
+  virtual void onPeerConnected(WebRTCPipeline *pipeline);
   virtual void onDataChannelConnected(WebRTCPipeline *pipeline);
   virtual void onDataChannelDisconnected(WebRTCPipeline *pipeline);
   virtual void onDataChannel(WebRTCPipeline *pipeline, std::string& message);
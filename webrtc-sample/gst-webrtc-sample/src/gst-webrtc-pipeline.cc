@@ -1,8 +1,10 @@
 #include "gst-webrtc-pipeline.h"
+#include "gst-sdp-minimizer.h"
 #include <gst/gst.h>
 #include <gst/sdp/sdp.h>
 #define GST_USE_UNSTABLE_API
 #include <gst/webrtc/webrtc.h>
+#include <stdio.h>
 
 WebRTCPipeline::WebRTCPipeline()
 {
@@ -10,11 +12,57 @@ WebRTCPipeline::WebRTCPipeline()
   mPipeline = nullptr;
   mWebRTCBin = nullptr;
   mSendDataChannel = nullptr;
-  mNegotiationNeededHandleId = 0;
-  mSendIceCandidateHandleId = 0;
-  mIceGatheringStateNotifyHandleId = 0;
-  mIncomingStreamHandleId = 0;
-  mDataChannelHandleId = 0;
+  mStatsInterval = 1000;
+  mStatsTimerId = 0;
+  mStatsPromise = nullptr;
+  mIceCandidatePolicy = ICE_CANDIDATE_POLICY_ALL;
+  mIcePortMin = 0;
+  mIcePortMax = 0;
+  mAllocatedPort = 0;
+  mIceTcp = true;
+  mRtpRelayPort = 0;
+  mRtpRelayMode = UdpBatchSender::MODE_GSO;
+  mFrameSkipKeepAlive = 0;
+  mPacingBitrate = 0;
+  mPacingBurst = 0;
+  mPacingMaxDelay = 0;
+  mTracePrint = false;
+  mMemoryReport = false;
+  mDataChannelPriority = (GstWebRTCPriorityType) 0;
+  mConnected = false;
+  mFirstRtpSent = false;
+  mOfferPending = false;
+  mNegotiationRequested = false;
+  mNegotiationRequestTime = 0;
+  mNegotiationTimerId = 0;
+  mSdpMinimize = false;
+  mNegotiationCount = 0;
+  mSignalingReportPending = false;
+
+  // RPC のレスポンスやリクエストは送信用のデータチャンネルで送る
+  // 大きなメッセージが小さなメッセージや映像の送信を遅らせないように、スケジューラを通す
+  mRpc.setSender([this](const std::string& data) {
+    DataChannelClass klass = data.size() >= DATA_CHANNEL_BULK_SIZE ?
+        DATA_CHANNEL_CLASS_BULK : DATA_CHANNEL_CLASS_RPC;
+    if (!mDataScheduler.enqueue(klass, true, data)) {
+      g_printerr("Data channel %s queue is full, dropped %" G_GSIZE_FORMAT " bytes.\n",
+          DataChannelScheduler::getClassName(klass), data.size());
+    }
+  });
+
+  mDataScheduler.setSender([this](bool isBinary, const std::string& data) {
+    if (!mSendDataChannel) {
+      return;
+    }
+    if (isBinary) {
+      mSendDataChannel->sendData(data);
+    } else {
+      std::string message = data;
+      mSendDataChannel->sendMessage(message);
+    }
+  }, [this]() -> guint64 {
+    return mSendDataChannel ? mSendDataChannel->getBufferedAmount() : 0;
+  });
 }
 
 WebRTCPipeline::~WebRTCPipeline()
@@ -26,6 +74,29 @@ void WebRTCPipeline::startPipeline(std::string& bin)
 {
   GError *error = NULL;
 
+  // プールから再利用された場合に備えて、前回のパイプラインを破棄しておく
+  stopPipeline();
+
+  mTrace.reset();
+  mTrace.mark("start-pipeline");
+  mConnected = false;
+  mFirstRtpSent = false;
+  {
+    std::lock_guard<std::mutex> lock(mNegotiationMutex);
+    stopNegotiationTimer();
+    mOfferPending = false;
+    mNegotiationRequested = false;
+    mNegotiationRequestTime = 0;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mSignalingMutex);
+    mSignalingBytes = SignalingBytes();
+    mSignalingTotal = SignalingBytes();
+    mNegotiationCount = 0;
+    mSignalingReportPending = false;
+  }
+  mTracks.clear();
+
   mPipeline = gst_parse_launch(bin.c_str(), &error);
 
   if (error) {
@@ -42,77 +113,117 @@ void WebRTCPipeline::startPipeline(std::string& bin)
     return;
   }
 
+  applyIceAgentSettings();
+  applyVideoCodecPreferences();
+  applyRecordLocation();
+
   // 送信専用に設定
   GArray *transceivers = NULL;
   g_signal_emit_by_name(mWebRTCBin, "get-transceivers", &transceivers);
   if (transceivers) {
-    GstWebRTCRTPTransceiver *trans = g_array_index(transceivers, GstWebRTCRTPTransceiver *, 0);
-    trans->direction = GST_WEBRTC_RTP_TRANSCEIVER_DIRECTION_SENDONLY;
+    // データチャンネルだけのパイプラインにはトランシーバーがない
+    if (transceivers->len > 0) {
+      GstWebRTCRTPTransceiver *trans = g_array_index(transceivers, GstWebRTCRTPTransceiver *, 0);
+      trans->direction = GST_WEBRTC_RTP_TRANSCEIVER_DIRECTION_SENDONLY;
+    }
     g_array_unref(transceivers);
   }
 
   // 接続するためのネゴシエーションを行うためのコールバックを設定
-  mNegotiationNeededHandleId = g_signal_connect(mWebRTCBin, "on-negotiation-needed", 
+  mNegotiationNeededHandler.connect(mWebRTCBin, "on-negotiation-needed", 
       G_CALLBACK(WebRTCPipeline::onNegotiationNeeded), this);
-  mSendIceCandidateHandleId = g_signal_connect(mWebRTCBin, "on-ice-candidate", 
+  mSendIceCandidateHandler.connect(mWebRTCBin, "on-ice-candidate", 
       G_CALLBACK(WebRTCPipeline::onSendIceCandidate), this);
-  mIceGatheringStateNotifyHandleId = g_signal_connect(mWebRTCBin, "notify::ice-gathering-state", 
+  mIceGatheringStateNotifyHandler.connect(mWebRTCBin, "notify::ice-gathering-state", 
       G_CALLBACK(WebRTCPipeline::onIceGatheringStateNotify), this);
+  mIceConnectionStateNotifyHandler.connect(mWebRTCBin, "notify::ice-connection-state", 
+      G_CALLBACK(WebRTCPipeline::onIceConnectionStateNotify), this);
+  mConnectionStateNotifyHandler.connect(mWebRTCBin, "notify::connection-state", 
+      G_CALLBACK(WebRTCPipeline::onConnectionStateNotify), this);
+
+  // 接続後に最初の RTP パケットが webrtcbin に入った時刻を記録する
+  addFirstRtpProbes();
+
+  attachFrameSkipper();
+  attachPacer();
+
+  // バッファプールは PLAYING にした後のネゴシエーションで決まるので、先にプローブを設定しておく
+  if (mMemoryReport) {
+    mMemoryAccounting.attach(mPipeline);
+  }
 
   gst_element_set_state(mPipeline, GST_STATE_READY);
 
   // 映像受信用のコールバック
-  mIncomingStreamHandleId = g_signal_connect(mWebRTCBin, "pad-added", 
+  mIncomingStreamHandler.connect(mWebRTCBin, "pad-added", 
       G_CALLBACK(WebRTCPipeline::onIncomingStream), this);
 
   // 受信用データチャンネルのコールバック
-  mDataChannelHandleId = g_signal_connect(mWebRTCBin, "on-data-channel", 
+  mDataChannelHandler.connect(mWebRTCBin, "on-data-channel", 
       G_CALLBACK(WebRTCPipeline::onDataChannel), this);
 
   // 送信用データチャンネルを作成
   std::string name("send-channel");
-  mSendDataChannel = new WebRTCDataChannel(mWebRTCBin);
+  mSendDataChannel = mDataChannelPool.acquire();
+  mSendDataChannel->setWebRTCBin(mWebRTCBin);
   mSendDataChannel->setListener(this);
-  mSendDataChannel->connect(name);
+  mSendDataChannel->connect(name, mDataChannelPriority);
 
   // パイプラインの再生を開始
   gst_element_set_state(GST_ELEMENT(mPipeline), GST_STATE_PLAYING);
+  mTrace.mark("pipeline-playing");
+
+  mAudioController.attach(mPipeline);
+  mAccounting.attach(mPipeline);
+
+  // 統計情報を定期的に取得
+  if (mStatsInterval > 0) {
+    mStatsTimerId = g_timeout_add(mStatsInterval, WebRTCPipeline::onStatsTimer, this);
+  }
 }
 
 void WebRTCPipeline::stopPipeline()
 {
-  if (mNegotiationNeededHandleId) {
-    g_signal_handler_disconnect(G_OBJECT(mWebRTCBin), mNegotiationNeededHandleId);
-    mNegotiationNeededHandleId = 0;
+  if (mStatsTimerId) {
+    g_source_remove(mStatsTimerId);
+    mStatsTimerId = 0;
   }
-
-  if (mSendIceCandidateHandleId) {
-    g_signal_handler_disconnect(G_OBJECT(mWebRTCBin), mSendIceCandidateHandleId);
-    mSendIceCandidateHandleId = 0;
+  cancelStats();
+  {
+    std::lock_guard<std::mutex> lock(mNegotiationMutex);
+    stopNegotiationTimer();
+    mOfferPending = false;
+    mNegotiationRequested = false;
   }
 
-  if (mIceGatheringStateNotifyHandleId) {
-    g_signal_handler_disconnect(G_OBJECT(mWebRTCBin), mIceGatheringStateNotifyHandleId);
-    mIceGatheringStateNotifyHandleId = 0;
-  }
+  mAudioController.report();
+  mAudioController.detach();
+  mAccounting.detach();
 
-  if (mIncomingStreamHandleId) {
-    g_signal_handler_disconnect(G_OBJECT(mWebRTCBin), mIncomingStreamHandleId);
-    mIncomingStreamHandleId = 0;
-  }
+  mNegotiationNeededHandler.disconnect();
+  mSendIceCandidateHandler.disconnect();
+  mIceGatheringStateNotifyHandler.disconnect();
+  mIncomingStreamHandler.disconnect();
+  mDataChannelHandler.disconnect();
+  mIceConnectionStateNotifyHandler.disconnect();
+  mConnectionStateNotifyHandler.disconnect();
 
-  if (mDataChannelHandleId) {
-    g_signal_handler_disconnect(G_OBJECT(mWebRTCBin), mDataChannelHandleId);
-    mDataChannelHandleId = 0;
-  }
+  // データチャンネルを閉じるので、レスポンスを待っている RPC は終了させる
+  mRpc.cancelAll();
+  mDataScheduler.reset();
 
   if (mSendDataChannel) {
-    delete mSendDataChannel;
+    releaseDataChannel(mSendDataChannel);
     mSendDataChannel = nullptr;
   }
 
+  for (auto itr = mExtraDataChannels.begin(); itr != mExtraDataChannels.end(); ++itr) {
+    releaseDataChannel(itr->second);
+  }
+  mExtraDataChannels.clear();
+
   for (auto itr = mReceiveDataChannels.begin(); itr != mReceiveDataChannels.end(); ++itr) {
-    delete *itr;
+    releaseDataChannel(*itr);
   }
   mReceiveDataChannels.clear();
 
@@ -122,16 +233,196 @@ void WebRTCPipeline::stopPipeline()
   }
 
   if (mPipeline) {
+    flushTrace();
+    {
+      std::lock_guard<std::mutex> lock(mSignalingMutex);
+      mSignalingTotal.add(mSignalingBytes);
+      mSignalingBytes = SignalingBytes();
+      mSignalingReportPending = false;
+      g_print("Signaling total for %s: %u negotiations, sent %" G_GUINT64_FORMAT " bytes, received %" G_GUINT64_FORMAT " bytes, sdp minimized by %" G_GUINT64_FORMAT " bytes\n",
+          mPeerId.c_str(), mNegotiationCount,
+          mSignalingTotal.sdpSent + mSignalingTotal.iceSent,
+          mSignalingTotal.sdpReceived + mSignalingTotal.iceReceived,
+          mSignalingTotal.sdpSaved);
+    }
+    if (mMemoryAccounting.isAttached()) {
+      mMemoryAccounting.report(mPeerId);
+    }
+    finalizeRecorder();
     gst_element_set_state(GST_ELEMENT(mPipeline), GST_STATE_NULL);
     g_clear_object(&mPipeline);
     mPipeline = nullptr;
   }
+
+  // ストリーミングスレッドが止まってから送信用のソケットを閉じる
+  // プローブはストリーミングスレッドから集計先のエントリを使うので、停止してから解放する
+  mMemoryAccounting.detach();
+  mVideoRelay.detach();
+  mAudioRelay.detach();
+  mFrameSkipper.detach();
+  mVideoPacer.detach();
+}
+
+GstElement *WebRTCPipeline::getElementByName(const gchar *name)
+{
+  if (!mPipeline) {
+    return nullptr;
+  }
+  return gst_bin_get_by_name(GST_BIN(mPipeline), name);
+}
+
+bool WebRTCPipeline::addTrack(const std::string& name, const std::string& description)
+{
+  if (!mPipeline || !mWebRTCBin) {
+    return false;
+  }
+
+  GstElement *existing = gst_bin_get_by_name(GST_BIN(mPipeline), name.c_str());
+  if (existing) {
+    g_printerr("Track %s already exists.\n", name.c_str());
+    gst_object_unref(existing);
+    return false;
+  }
+
+  GError *error = NULL;
+  GstElement *bin = gst_parse_bin_from_description(description.c_str(), TRUE, &error);
+  if (error) {
+    g_printerr("Failed to parse track %s: %s.\n", name.c_str(), error->message);
+    g_error_free(error);
+    if (bin) {
+      gst_object_unref(bin);
+    }
+    return false;
+  }
+  gst_object_set_name(GST_OBJECT(bin), name.c_str());
+
+  // 削除したトラックを追加し直す場合は、inactive にしてあるトランシーバーを使う
+  GstPad *sinkpad = NULL;
+  auto itr = mTracks.find(name);
+  if (itr != mTracks.end()) {
+    std::string padName = "sink_" + std::to_string(itr->second);
+    sinkpad = gst_element_get_request_pad(mWebRTCBin, padName.c_str());
+  }
+  if (!sinkpad) {
+    sinkpad = gst_element_get_request_pad(mWebRTCBin, "sink_%u");
+  }
+  GstPad *srcpad = gst_element_get_static_pad(bin, "src");
+  if (!sinkpad || !srcpad) {
+    g_printerr("Could not link track %s to webrtcbin.\n", name.c_str());
+    if (sinkpad) {
+      gst_element_release_request_pad(mWebRTCBin, sinkpad);
+      gst_object_unref(sinkpad);
+    }
+    if (srcpad) {
+      gst_object_unref(srcpad);
+    }
+    gst_object_unref(bin);
+    return false;
+  }
+
+  guint mline = 0;
+  gchar *padName = gst_pad_get_name(sinkpad);
+  sscanf(padName, "sink_%u", &mline);
+  g_free(padName);
+  mTracks[name] = mline;
+
+  gst_bin_add(GST_BIN(mPipeline), bin);
+  gst_pad_link(srcpad, sinkpad);
+  setTransceiverDirection(mline, GST_WEBRTC_RTP_TRANSCEIVER_DIRECTION_SENDONLY);
+
+  // offer に RTP の caps を記述するので、caps が流れてきてから再ネゴシエーションを行う
+  gst_pad_add_probe(srcpad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, WebRTCPipeline::onTrackCapsProbe, this, NULL);
+  gst_element_sync_state_with_parent(bin);
+
+  gst_object_unref(srcpad);
+  gst_object_unref(sinkpad);
+
+  mAudioController.attach(mPipeline);
+  g_print("Added track %s (mline %u).\n", name.c_str(), mline);
+  return true;
+}
+
+bool WebRTCPipeline::removeTrack(const std::string& name)
+{
+  auto itr = mTracks.find(name);
+  if (!mPipeline || itr == mTracks.end()) {
+    return false;
+  }
+
+  GstElement *bin = gst_bin_get_by_name(GST_BIN(mPipeline), name.c_str());
+  if (!bin) {
+    return false;
+  }
+
+  // 先に止めておけば、接続を外した後に not-linked でエラーにならない
+  gst_element_set_state(bin, GST_STATE_NULL);
+
+  GstPad *srcpad = gst_element_get_static_pad(bin, "src");
+  if (srcpad) {
+    GstPad *sinkpad = gst_pad_get_peer(srcpad);
+    if (sinkpad) {
+      gst_pad_unlink(srcpad, sinkpad);
+      gst_element_release_request_pad(mWebRTCBin, sinkpad);
+      gst_object_unref(sinkpad);
+    }
+    gst_object_unref(srcpad);
+  }
+
+  mAudioController.detach();
+  gst_bin_remove(GST_BIN(mPipeline), bin);
+  gst_object_unref(bin);
+  mAudioController.attach(mPipeline);
+
+  setTransceiverDirection(itr->second, GST_WEBRTC_RTP_TRANSCEIVER_DIRECTION_INACTIVE);
+  g_print("Removed track %s (mline %u).\n", name.c_str(), itr->second);
+
+  requestNegotiation();
+  return true;
+}
+
+bool WebRTCPipeline::hasTrack(const std::string& name)
+{
+  if (!mPipeline || mTracks.find(name) == mTracks.end()) {
+    return false;
+  }
+  GstElement *bin = gst_bin_get_by_name(GST_BIN(mPipeline), name.c_str());
+  if (!bin) {
+    return false;
+  }
+  gst_object_unref(bin);
+  return true;
+}
+
+WebRTCDataChannel *WebRTCPipeline::addDataChannel(const std::string& label, GstWebRTCPriorityType priority)
+{
+  if (!mWebRTCBin || mExtraDataChannels.find(label) != mExtraDataChannels.end()) {
+    return nullptr;
+  }
+
+  std::string name = label;
+  WebRTCDataChannel *channel = mDataChannelPool.acquire();
+  channel->setWebRTCBin(mWebRTCBin);
+  channel->setListener(this);
+  channel->connect(name, priority);
+  mExtraDataChannels[label] = channel;
+  return channel;
+}
+
+bool WebRTCPipeline::removeDataChannel(const std::string& label)
+{
+  auto itr = mExtraDataChannels.find(label);
+  if (itr == mExtraDataChannels.end()) {
+    return false;
+  }
+  releaseDataChannel(itr->second);
+  mExtraDataChannels.erase(itr);
+  return true;
 }
 
 void WebRTCPipeline::sendMessage(std::string& message)
 {
   if (mSendDataChannel) {
-    mSendDataChannel->sendMessage(message);
+    mDataScheduler.enqueue(DATA_CHANNEL_CLASS_CONTROL, false, message);
   }
 }
 
@@ -139,6 +430,8 @@ void WebRTCPipeline::onOfferReceived(const gchar *sdpString)
 {
   GstSDPMessage *sdp = NULL;
 
+  mTrace.mark("remote-offer");
+
   int ret = gst_sdp_message_new(&sdp);
   g_assert_cmphex(ret, ==, GST_SDP_OK);
 
@@ -155,6 +448,8 @@ void WebRTCPipeline::onAnswerReceived(const gchar *sdpString)
 {
   GstSDPMessage *sdp = NULL;
 
+  mTrace.mark("remote-answer");
+
   int ret = gst_sdp_message_new(&sdp);
   g_assert_cmphex(ret, ==, GST_SDP_OK);
 
@@ -172,10 +467,49 @@ void WebRTCPipeline::onIceReceived(guint mlineIndex, const gchar *candidateStrin
   g_signal_emit_by_name(mWebRTCBin, "add-ice-candidate", mlineIndex, candidateString);
 }
 
+/**
+ * 送信する RTP を UdpBatchSender で転送するように、転送用のシンクに RtpRelay を設定します。
+ */
+bool WebRTCPipeline::startRtpRelay()
+{
+  if (mRtpRelayPort == 0 || !mPipeline) {
+    return false;
+  }
+
+  GstElement *videoRelay = gst_bin_get_by_name(GST_BIN(mPipeline), "videorelay");
+  if (videoRelay) {
+    if (!mVideoRelay.isAttached()) {
+      mVideoRelay.attach(videoRelay, mRtpRelayHost, mRtpRelayPort, mRtpRelayMode);
+    }
+    gst_object_unref(videoRelay);
+  }
+
+  GstElement *audioRelay = gst_bin_get_by_name(GST_BIN(mPipeline), "audiorelay");
+  if (audioRelay) {
+    if (!mAudioRelay.isAttached()) {
+      mAudioRelay.attach(audioRelay, mRtpRelayHost, mRtpRelayPort + 2, mRtpRelayMode);
+    }
+    gst_object_unref(audioRelay);
+  }
+  return mVideoRelay.isAttached() || mAudioRelay.isAttached();
+}
+
+void WebRTCPipeline::countSignalingMessage(bool sent, bool isSdp, gsize bytes)
+{
+  std::lock_guard<std::mutex> lock(mSignalingMutex);
+  if (sent) {
+    (isSdp ? mSignalingBytes.sdpSent : mSignalingBytes.iceSent) += bytes;
+  } else {
+    (isSdp ? mSignalingBytes.sdpReceived : mSignalingBytes.iceReceived) += bytes;
+  }
+}
+
 // private functions.
 
 void WebRTCPipeline::onAnswerReceived(GstSDPMessage *sdp)
 {
+  selectVideoPayload(sdp);
+
   GstWebRTCSessionDescription *answer = gst_webrtc_session_description_new(GST_WEBRTC_SDP_TYPE_ANSWER, sdp);
   if (answer) {
     GstPromise *promise = gst_promise_new();
@@ -184,6 +518,141 @@ void WebRTCPipeline::onAnswerReceived(GstSDPMessage *sdp)
     gst_promise_unref(promise);
     gst_webrtc_session_description_free(answer);
   }
+
+  // webrtcbin の処理は順番に行われるので、answer の設定に続けて次の offer を作成してもよい
+  completeNegotiation();
+}
+
+void WebRTCPipeline::requestNegotiation()
+{
+  {
+    std::lock_guard<std::mutex> lock(mNegotiationMutex);
+    if (mOfferPending) {
+      mNegotiationRequested = true;
+      return;
+    }
+    mOfferPending = true;
+    mNegotiationRequestTime = g_get_monotonic_time();
+    startNegotiationTimer();
+  }
+  createOffer();
+}
+
+void WebRTCPipeline::completeNegotiation()
+{
+  bool again = false;
+  gint64 requestTime = 0;
+  {
+    std::lock_guard<std::mutex> lock(mNegotiationMutex);
+    requestTime = mNegotiationRequestTime;
+    again = mNegotiationRequested;
+    mOfferPending = again;
+    mNegotiationRequested = false;
+    mNegotiationRequestTime = again ? g_get_monotonic_time() : 0;
+    stopNegotiationTimer();
+    if (again) {
+      startNegotiationTimer();
+    }
+  }
+
+  if (requestTime > 0) {
+    g_print("Renegotiated %s in %.1f ms.\n", mPeerId.c_str(), (g_get_monotonic_time() - requestTime) / 1000.0);
+  }
+  reportSignaling();
+  if (again) {
+    createOffer();
+  }
+}
+
+/**
+ * offer を作成できなかった場合や answer が届かなかった場合に、待っているネゴシエーションを取り消します。
+ *
+ * 取り消した後の on-negotiation-needed や requestNegotiation で、改めてネゴシエーションを行えるようになります。
+ */
+void WebRTCPipeline::abortNegotiation(const char *reason)
+{
+  std::lock_guard<std::mutex> lock(mNegotiationMutex);
+  if (!mOfferPending) {
+    return;
+  }
+  g_printerr("Negotiation with %s aborted: %s.\n", mPeerId.c_str(), reason);
+  stopNegotiationTimer();
+  mOfferPending = false;
+  mNegotiationRequested = false;
+  mNegotiationRequestTime = 0;
+  mTrace.mark("negotiation-aborted");
+}
+
+// mNegotiationMutex をロックした状態で呼び出す
+void WebRTCPipeline::startNegotiationTimer()
+{
+  if (mNegotiationTimerId == 0) {
+    mNegotiationTimerId = g_timeout_add(NEGOTIATION_TIMEOUT, WebRTCPipeline::onNegotiationTimeout, this);
+  }
+}
+
+// mNegotiationMutex をロックした状態で呼び出す
+void WebRTCPipeline::stopNegotiationTimer()
+{
+  if (mNegotiationTimerId) {
+    g_source_remove(mNegotiationTimerId);
+    mNegotiationTimerId = 0;
+  }
+}
+
+void WebRTCPipeline::createOffer()
+{
+  GstPromise *promise = gst_promise_new_with_change_func(WebRTCPipeline::onOfferCreated, this, NULL);
+  g_signal_emit_by_name(mWebRTCBin, "create-offer", NULL, promise);
+}
+
+/**
+ * ネゴシエーションが終わった時に呼び出して、前回の出力から送受信したバイト数を出力します。
+ *
+ * ICE の候補は answer の後にも届くので、接続が完了するまでは出力を遅らせて、
+ * 最初のネゴシエーションの候補が次のネゴシエーションの分にならないようにします。
+ * 接続後に届いた候補は次のネゴシエーションの分になります。
+ */
+void WebRTCPipeline::reportSignaling()
+{
+  std::lock_guard<std::mutex> lock(mSignalingMutex);
+  mNegotiationCount++;
+  if (!mConnected) {
+    mSignalingReportPending = true;
+    return;
+  }
+  printSignaling();
+}
+
+// mSignalingMutex をロックした状態で呼び出す
+void WebRTCPipeline::printSignaling()
+{
+  mSignalingReportPending = false;
+  g_print("Signaling for %s (negotiation %u): sent %" G_GUINT64_FORMAT " bytes (sdp %" G_GUINT64_FORMAT ", ice %" G_GUINT64_FORMAT "), "
+      "received %" G_GUINT64_FORMAT " bytes (sdp %" G_GUINT64_FORMAT ", ice %" G_GUINT64_FORMAT "), sdp minimized by %" G_GUINT64_FORMAT " bytes\n",
+      mPeerId.c_str(), mNegotiationCount,
+      mSignalingBytes.sdpSent + mSignalingBytes.iceSent, mSignalingBytes.sdpSent, mSignalingBytes.iceSent,
+      mSignalingBytes.sdpReceived + mSignalingBytes.iceReceived, mSignalingBytes.sdpReceived, mSignalingBytes.iceReceived,
+      mSignalingBytes.sdpSaved);
+  mSignalingTotal.add(mSignalingBytes);
+  mSignalingBytes = SignalingBytes();
+}
+
+void WebRTCPipeline::setTransceiverDirection(guint mline, GstWebRTCRTPTransceiverDirection direction)
+{
+  GArray *transceivers = NULL;
+  g_signal_emit_by_name(mWebRTCBin, "get-transceivers", &transceivers);
+  if (!transceivers) {
+    return;
+  }
+  for (guint i = 0; i < transceivers->len; i++) {
+    GstWebRTCRTPTransceiver *trans = g_array_index(transceivers, GstWebRTCRTPTransceiver *, i);
+    if (trans->mline == mline) {
+      g_object_set(trans, "direction", direction, NULL);
+      break;
+    }
+  }
+  g_array_unref(transceivers);
 }
 
 void WebRTCPipeline::onOfferReceived(GstSDPMessage *sdp)
@@ -205,6 +674,15 @@ void WebRTCPipeline::sendSdp(GstWebRTCSessionDescription *desc)
 {
   if (mListener) {
     gchar *sdp_string = gst_sdp_message_as_text(desc->sdp);
+    if (mSdpMinimize) {
+      gchar *minimized = SdpMinimizer::minimize(desc->sdp);
+      {
+        std::lock_guard<std::mutex> lock(mSignalingMutex);
+        mSignalingBytes.sdpSaved += strlen(sdp_string) - MIN(strlen(minimized), strlen(sdp_string));
+      }
+      g_free(sdp_string);
+      sdp_string = minimized;
+    }
     mListener->onSendSdp(this, desc->type, sdp_string);
     g_free(sdp_string);
   }
@@ -212,8 +690,18 @@ void WebRTCPipeline::sendSdp(GstWebRTCSessionDescription *desc)
 
 void WebRTCPipeline::sendIceCandidate(guint mlineindex, gchar *candidate)
 {
+  if (!isCandidateAllowed(candidate)) {
+    return;
+  }
+
   if (mListener) {
-    mListener->onSendIceCandidate(this, mlineindex, candidate);
+    if (mSdpMinimize) {
+      std::string compact;
+      SdpMinimizer::compactCandidate(candidate, compact);
+      mListener->onSendIceCandidate(this, mlineindex, (gchar *) compact.c_str());
+    } else {
+      mListener->onSendIceCandidate(this, mlineindex, candidate);
+    }
   }
 }
 
@@ -226,21 +714,348 @@ void WebRTCPipeline::addStream(GstPad *pad)
 
 void WebRTCPipeline::createReceiveDataChannel(GstWebRTCDataChannel *dataChannel)
 {
-  WebRTCDataChannel *channel = new WebRTCDataChannel(mWebRTCBin);
+  WebRTCDataChannel *channel = mDataChannelPool.acquire();
   if (channel) {
+    channel->setWebRTCBin(mWebRTCBin);
     channel->setListener(this);
     channel->connect(dataChannel);
     mReceiveDataChannels.push_back(channel);
   }
 }
 
+/**
+ * 録画中の場合は、最後のファイルを閉じるために録画用の入力に EOS を送ります。
+ * 
+ * ファイルが閉じられるまで待ちますが、ディスクが詰まっている場合でも
+ * 停止処理が止まらないように最大待ち時間を設けています。
+ */
+void WebRTCPipeline::applyRecordLocation()
+{
+  if (mRecordLocation.empty()) {
+    return;
+  }
+  GstElement *recorder = gst_bin_get_by_name(GST_BIN(mPipeline), "recorder");
+  if (recorder) {
+    g_object_set(recorder, "location", mRecordLocation.c_str(), NULL);
+    gst_object_unref(recorder);
+  }
+}
+
+void WebRTCPipeline::finalizeRecorder()
+{
+  GstElement *recorder = gst_bin_get_by_name(GST_BIN(mPipeline), "recorder");
+  if (!recorder) {
+    return;
+  }
+
+  // バスは読み出していないので、前のファイルを閉じた時のメッセージが残っている
+  GstBus *bus = gst_element_get_bus(mPipeline);
+  gst_bus_set_flushing(bus, TRUE);
+  gst_bus_set_flushing(bus, FALSE);
+
+  GstIterator *itr = gst_element_iterate_sink_pads(recorder);
+  GValue item = G_VALUE_INIT;
+  while (gst_iterator_next(itr, &item) == GST_ITERATOR_OK) {
+    GstPad *pad = GST_PAD(g_value_get_object(&item));
+    gst_pad_send_event(pad, gst_event_new_eos());
+    g_value_reset(&item);
+  }
+  g_value_unset(&item);
+  gst_iterator_free(itr);
+
+  // EOS の直前に次のファイルに切り替わった場合は、閉じた後に新しいファイルが開かれるので、それが閉じるまで待つ
+  bool closed = false;
+  GstClockTime timeout = 2 * GST_SECOND;
+  GstClockTime start = gst_util_get_timestamp();
+  while (gst_util_get_timestamp() - start < timeout) {
+    GstMessage *msg = gst_bus_timed_pop_filtered(bus, 100 * GST_MSECOND, GST_MESSAGE_ELEMENT);
+    if (!msg) {
+      if (closed) {
+        break;
+      }
+      continue;
+    }
+    if (gst_message_has_name(msg, "splitmuxsink-fragment-opened")) {
+      closed = false;
+    } else if (gst_message_has_name(msg, "splitmuxsink-fragment-closed")) {
+      closed = true;
+    }
+    gst_message_unref(msg);
+  }
+  gst_object_unref(bus);
+  gst_object_unref(recorder);
+}
+
+/**
+ * 応答を待っている get-stats の promise を中断し、onStatsReceived が終わるまで待ちます。
+ *
+ * 中断した場合は、この関数の中で onStatsReceived が呼び出されます。
+ * 既に応答があった場合は、ストリーミングスレッドで onStatsReceived が終わるのを待ちます。
+ */
+void WebRTCPipeline::cancelStats()
+{
+  GstPromise *promise = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(mStatsMutex);
+    if (mStatsPromise) {
+      promise = gst_promise_ref(mStatsPromise);
+    }
+  }
+  if (!promise) {
+    return;
+  }
+  gst_promise_interrupt(promise);
+  gst_promise_unref(promise);
+
+  std::unique_lock<std::mutex> lock(mStatsMutex);
+  mStatsCondition.wait(lock, [this]() { return mStatsPromise == nullptr; });
+}
+
+void WebRTCPipeline::handleStats(const GstStructure *stats)
+{
+  mAudioController.onStats(stats);
+  mAccounting.onStats(stats);
+  mDataScheduler.onStats(stats);
+}
+
+void WebRTCPipeline::addFirstRtpProbes()
+{
+  GstIterator *itr = gst_element_iterate_sink_pads(mWebRTCBin);
+  GValue item = G_VALUE_INIT;
+  while (gst_iterator_next(itr, &item) == GST_ITERATOR_OK) {
+    GstPad *pad = GST_PAD(g_value_get_object(&item));
+    gst_pad_add_probe(pad, (GstPadProbeType) (GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST),
+        WebRTCPipeline::onFirstRtpProbe, this, NULL);
+    g_value_reset(&item);
+  }
+  g_value_unset(&item);
+  gst_iterator_free(itr);
+}
+
+void WebRTCPipeline::applyVideoCodecPreferences()
+{
+  if (mVideoCodecPreferences.empty()) {
+    return;
+  }
+
+  GstCaps *caps = gst_caps_from_string(mVideoCodecPreferences.c_str());
+  if (!caps) {
+    g_printerr("Invalid video codec preferences %s.\n", mVideoCodecPreferences.c_str());
+    return;
+  }
+
+  // 映像の送信用の記述が先にあるので、最初のトランシーバーが映像になる
+  GstWebRTCRTPTransceiver *trans = NULL;
+  g_signal_emit_by_name(mWebRTCBin, "get-transceiver", 0, &trans);
+  if (trans) {
+    g_object_set(trans, "codec-preferences", caps, NULL);
+    gst_object_unref(trans);
+  }
+  gst_caps_unref(caps);
+}
+
+void WebRTCPipeline::selectVideoPayload(const GstSDPMessage *sdp)
+{
+  for (guint i = 0; i < gst_sdp_message_medias_len(sdp); i++) {
+    const GstSDPMedia *media = gst_sdp_message_get_media(sdp, i);
+    if (g_strcmp0(gst_sdp_media_get_media(media), "video") != 0) {
+      continue;
+    }
+
+    if (gst_sdp_media_get_port(media) == 0) {
+      g_printerr("Video was rejected by %s.\n", mPeerId.c_str());
+      return;
+    }
+    if (mPayloadValves.empty()) {
+      return;
+    }
+
+    for (guint j = 0; j < gst_sdp_media_formats_len(media); j++) {
+      guint pt = (guint) g_ascii_strtoull(gst_sdp_media_get_format(media, j), NULL, 10);
+      auto itr = mPayloadValves.find(pt);
+      if (itr == mPayloadValves.end()) {
+        continue;
+      }
+
+      GstElement *valve = gst_bin_get_by_name(GST_BIN(mPipeline), itr->second.c_str());
+      if (!valve) {
+        continue;
+      }
+      g_print("Video payload %u (%s) selected by %s.\n", pt, itr->second.c_str(), mPeerId.c_str());
+      g_object_set(valve, "drop", FALSE, NULL);
+
+      // 途中から流れ始めるので、上流にキーフレームを要求する
+      GstPad *pad = gst_element_get_static_pad(valve, "sink");
+      if (pad) {
+        GstStructure *structure = gst_structure_new("GstForceKeyUnit", "all-headers", G_TYPE_BOOLEAN, TRUE, NULL);
+        gst_pad_push_event(pad, gst_event_new_custom(GST_EVENT_CUSTOM_UPSTREAM, structure));
+        gst_object_unref(pad);
+      }
+      gst_object_unref(valve);
+      return;
+    }
+
+    g_printerr("No supported video payload in the answer from %s.\n", mPeerId.c_str());
+    return;
+  }
+}
+
+void WebRTCPipeline::attachPacer()
+{
+  if (mPacingBitrate == 0) {
+    return;
+  }
+
+  GstElement *queue = gst_bin_get_by_name(GST_BIN(mPipeline), "videopacer");
+  if (!queue) {
+    return;
+  }
+  GstPad *pad = gst_element_get_static_pad(queue, "src");
+  if (pad) {
+    mVideoPacer.attach(pad, mPacingBitrate, mPacingBurst, mPacingMaxDelay);
+    gst_object_unref(pad);
+  }
+  gst_object_unref(queue);
+}
+
+void WebRTCPipeline::attachFrameSkipper()
+{
+  if (mFrameSkipKeepAlive == 0) {
+    return;
+  }
+
+  GstElement *source = gst_bin_get_by_name(GST_BIN(mPipeline), "videosrc");
+  if (!source) {
+    return;
+  }
+  GstPad *pad = gst_element_get_static_pad(source, "src");
+  if (pad) {
+    mFrameSkipper.attach(pad, mFrameSkipKeepAlive);
+    gst_object_unref(pad);
+  }
+  gst_object_unref(source);
+}
+
+/**
+ * webrtcbin の ICE エージェントに、使用する UDP ポートの範囲と TCP の使用有無を設定します。
+ * 
+ * ファイアウォールで開けるポートを固定したい場合に使用します。
+ * webrtcbin の ICE エージェントが取得できる GStreamer 1.20 以降でのみ有効です。
+ */
+void WebRTCPipeline::applyIceAgentSettings()
+{
+  if (mIcePortMin == 0 && mIcePortMax == 0 && mIceTcp) {
+    return;
+  }
+
+#if GST_CHECK_VERSION(1, 20, 0)
+  GObject *ice = NULL;
+  g_object_get(mWebRTCBin, "ice-agent", &ice, NULL);
+  if (ice) {
+    if (mIcePortMin != 0 || mIcePortMax != 0) {
+      g_object_set(ice, "min-rtp-port", mIcePortMin, "max-rtp-port", mIcePortMax, NULL);
+    }
+    if (!mIceTcp) {
+      g_object_set(ice, "ice-tcp", FALSE, NULL);
+    }
+    g_object_unref(ice);
+  }
+#else
+  g_printerr("ICE port range and ICE-TCP settings require GStreamer 1.20 or later, ignoring.\n");
+#endif
+}
+
+/**
+ * ICE 候補の種類が送信を許可されているかを確認します。
+ * 
+ * ICE 候補の文字列のフォーマットは下記の通りです。
+ * <pre>
+ * candidate:1 1 UDP 2015363327 192.168.0.10 54321 typ host
+ * </pre>
+ */
+bool WebRTCPipeline::isCandidateAllowed(const gchar *candidate)
+{
+  const gchar *expected = NULL;
+  switch (mIceCandidatePolicy) {
+  case ICE_CANDIDATE_POLICY_HOST:
+    expected = "host";
+    break;
+  case ICE_CANDIDATE_POLICY_SRFLX:
+    expected = "srflx";
+    break;
+  case ICE_CANDIDATE_POLICY_RELAY:
+    expected = "relay";
+    break;
+  default:
+    return true;
+  }
+
+  const gchar *typ = candidate ? strstr(candidate, " typ ") : NULL;
+  if (!typ) {
+    return false;
+  }
+  typ += strlen(" typ ");
+
+  size_t length = strlen(expected);
+  return strncmp(typ, expected, length) == 0 && (typ[length] == ' ' || typ[length] == '\0');
+}
+
+void WebRTCPipeline::flushTrace()
+{
+  std::string name = mPeerId.empty() ? "session" : mPeerId;
+
+  if (mTracePrint) {
+    mTrace.print(name);
+  }
+
+  if (!mTraceDir.empty()) {
+    gchar *filename = g_strdup_printf("%s-%" G_GINT64_FORMAT ".json", name.c_str(), g_get_real_time());
+    gchar *path = g_build_filename(mTraceDir.c_str(), filename, NULL);
+    mTrace.dump(path, name);
+    g_free(path);
+    g_free(filename);
+  }
+}
+
+void WebRTCPipeline::releaseDataChannel(WebRTCDataChannel *channel)
+{
+  // 切断して状態をリセットしてからプールに戻す
+  channel->disconnect();
+  channel->setListener(nullptr);
+  channel->setWebRTCBin(nullptr);
+  mDataChannelPool.release(channel);
+}
+
 // callback static functions.
 
 void WebRTCPipeline::onNegotiationNeeded(GstElement *webrtcbin, gpointer userData)
 {
   WebRTCPipeline *pipeline = (WebRTCPipeline *) userData;
-  GstPromise *promise = gst_promise_new_with_change_func(WebRTCPipeline::onOfferCreated, userData, NULL);
-  g_signal_emit_by_name(pipeline->mWebRTCBin, "create-offer", NULL, promise);
+  pipeline->mTrace.mark("negotiation-needed");
+
+  // answer を待っている間の通知は、送信済みの offer に含まれているか answer の後に再度通知される
+  {
+    std::lock_guard<std::mutex> lock(pipeline->mNegotiationMutex);
+    if (pipeline->mOfferPending) {
+      return;
+    }
+    pipeline->mOfferPending = true;
+    pipeline->startNegotiationTimer();
+  }
+  pipeline->createOffer();
+}
+
+// 追加したトラックの caps が決まった場合
+GstPadProbeReturn WebRTCPipeline::onTrackCapsProbe(GstPad *pad, GstPadProbeInfo *info, gpointer userData)
+{
+  GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+  if (GST_EVENT_TYPE(event) != GST_EVENT_CAPS) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  WebRTCPipeline *pipeline = (WebRTCPipeline *) userData;
+  pipeline->requestNegotiation();
+  return GST_PAD_PROBE_REMOVE;
 }
 
 // offer が作成された場合
@@ -248,14 +1063,35 @@ void WebRTCPipeline::onOfferCreated(GstPromise *promise, gpointer userData)
 {
   WebRTCPipeline *pipeline = (WebRTCPipeline *) userData;
 
-  g_assert_cmphex(gst_promise_wait(promise), ==, GST_PROMISE_RESULT_REPLIED);
+  // 停止中やエラーの場合は offer を送れないので、次のネゴシエーションができるように待つのをやめる
+  if (gst_promise_wait(promise) != GST_PROMISE_RESULT_REPLIED) {
+    gst_promise_unref(promise);
+    pipeline->abortNegotiation("create-offer was not replied");
+    return;
+  }
 
   GstWebRTCSessionDescription *offer = NULL;
 
   const GstStructure *reply = gst_promise_get_reply(promise);
-  gst_structure_get(reply, "offer", GST_TYPE_WEBRTC_SESSION_DESCRIPTION, &offer, NULL);
+  if (reply) {
+    gst_structure_get(reply, "offer", GST_TYPE_WEBRTC_SESSION_DESCRIPTION, &offer, NULL);
+  }
   gst_promise_unref(promise);
 
+  if (!offer) {
+    pipeline->abortNegotiation("create-offer returned no offer");
+    return;
+  }
+
+  // 待っている間に停止して webrtcbin が解放された場合
+  if (!pipeline->mWebRTCBin) {
+    gst_webrtc_session_description_free(offer);
+    pipeline->abortNegotiation("pipeline was stopped");
+    return;
+  }
+
+  pipeline->mTrace.mark("offer-created");
+
   promise = gst_promise_new();
   g_signal_emit_by_name(pipeline->mWebRTCBin, "set-local-description", offer, promise);
   gst_promise_interrupt(promise);
@@ -278,16 +1114,76 @@ void WebRTCPipeline::onAnswerCreated(GstPromise *promise, gpointer userData)
   gst_structure_get(reply, "answer", GST_TYPE_WEBRTC_SESSION_DESCRIPTION, &answer, NULL);
   gst_promise_unref(promise);
 
+  pipeline->mTrace.mark("answer-created");
+
   promise = gst_promise_new();
   g_signal_emit_by_name(pipeline->mWebRTCBin, "set-local-description", answer, promise);
   gst_promise_interrupt(promise);
   gst_promise_unref(promise);
 
   pipeline->sendSdp(answer);
+  pipeline->reportSignaling();
 
   gst_webrtc_session_description_free(answer);
 }
 
+// answer が届かないまま NEGOTIATION_TIMEOUT が経過した場合
+gboolean WebRTCPipeline::onNegotiationTimeout(gpointer userData)
+{
+  WebRTCPipeline *pipeline = (WebRTCPipeline *) userData;
+  {
+    std::lock_guard<std::mutex> lock(pipeline->mNegotiationMutex);
+    // 同時に stopNegotiationTimer が呼ばれた場合は何もしない
+    if (pipeline->mNegotiationTimerId == 0) {
+      return G_SOURCE_REMOVE;
+    }
+    pipeline->mNegotiationTimerId = 0;
+  }
+  pipeline->abortNegotiation("no answer received");
+  return G_SOURCE_REMOVE;
+}
+
+gboolean WebRTCPipeline::onStatsTimer(gpointer userData)
+{
+  WebRTCPipeline *pipeline = (WebRTCPipeline *) userData;
+  if (pipeline->mWebRTCBin) {
+    GstPromise *promise = nullptr;
+    {
+      std::lock_guard<std::mutex> lock(pipeline->mStatsMutex);
+      // 前回の応答を待っている間は取得しない
+      if (pipeline->mStatsPromise) {
+        return G_SOURCE_CONTINUE;
+      }
+      promise = gst_promise_new_with_change_func(WebRTCPipeline::onStatsReceived, userData, NULL);
+      pipeline->mStatsPromise = gst_promise_ref(promise);
+    }
+    g_signal_emit_by_name(pipeline->mWebRTCBin, "get-stats", NULL, promise);
+  }
+  return G_SOURCE_CONTINUE;
+}
+
+// 統計情報が取得できた場合
+void WebRTCPipeline::onStatsReceived(GstPromise *promise, gpointer userData)
+{
+  WebRTCPipeline *pipeline = (WebRTCPipeline *) userData;
+
+  if (gst_promise_wait(promise) == GST_PROMISE_RESULT_REPLIED) {
+    const GstStructure *stats = gst_promise_get_reply(promise);
+    pipeline->handleStats(stats);
+  }
+
+  // stopPipeline は mStatsPromise が空になるまで待つので、これ以降は pipeline を使わない
+  {
+    std::lock_guard<std::mutex> lock(pipeline->mStatsMutex);
+    if (pipeline->mStatsPromise == promise) {
+      gst_promise_unref(pipeline->mStatsPromise);
+      pipeline->mStatsPromise = nullptr;
+    }
+    pipeline->mStatsCondition.notify_all();
+  }
+  gst_promise_unref(promise);
+}
+
 void WebRTCPipeline::onSendIceCandidate(GstElement *webrtcbin, guint mlineindex, gchar *candidate, gpointer userData)
 {
   WebRTCPipeline *pipeline = (WebRTCPipeline *) userData;
@@ -296,6 +1192,7 @@ void WebRTCPipeline::onSendIceCandidate(GstElement *webrtcbin, guint mlineindex,
 
 void WebRTCPipeline::onIceGatheringStateNotify(GstElement *webrtcbin, GParamSpec *pspec, gpointer userData)
 {
+  WebRTCPipeline *pipeline = (WebRTCPipeline *) userData;
   GstWebRTCICEGatheringState ice_gather_state;
   const gchar *new_state = "unknown";
 
@@ -309,11 +1206,67 @@ void WebRTCPipeline::onIceGatheringStateNotify(GstElement *webrtcbin, GParamSpec
     break;
   case GST_WEBRTC_ICE_GATHERING_STATE_COMPLETE:
     new_state = "complete";
+    pipeline->mTrace.mark("ice-gathering-complete");
     break;
   }
   g_print("ICE gathering state changed to %s.\n", new_state);
 }
 
+void WebRTCPipeline::onIceConnectionStateNotify(GstElement *webrtcbin, GParamSpec *pspec, gpointer userData)
+{
+  WebRTCPipeline *pipeline = (WebRTCPipeline *) userData;
+  GstWebRTCICEConnectionState state;
+
+  g_object_get(webrtcbin, "ice-connection-state", &state, NULL);
+  if (state == GST_WEBRTC_ICE_CONNECTION_STATE_CONNECTED) {
+    pipeline->mTrace.mark("ice-connected");
+
+    gint64 elapsed = pipeline->mTrace.getElapsed("ice-connected");
+    g_print("ICE connected in %.1f ms.\n", elapsed / 1000.0);
+  } else if (state == GST_WEBRTC_ICE_CONNECTION_STATE_FAILED) {
+    pipeline->mTrace.mark("ice-failed");
+  }
+}
+
+// DTLS のハンドシェイクが終わると connection-state が connected になる
+void WebRTCPipeline::onConnectionStateNotify(GstElement *webrtcbin, GParamSpec *pspec, gpointer userData)
+{
+  WebRTCPipeline *pipeline = (WebRTCPipeline *) userData;
+  GstWebRTCPeerConnectionState state;
+
+  g_object_get(webrtcbin, "connection-state", &state, NULL);
+  if (state == GST_WEBRTC_PEER_CONNECTION_STATE_CONNECTED) {
+    pipeline->mTrace.mark("dtls-connected");
+    pipeline->mConnected = true;
+    {
+      std::lock_guard<std::mutex> lock(pipeline->mSignalingMutex);
+      if (pipeline->mSignalingReportPending) {
+        pipeline->printSignaling();
+      }
+    }
+    if (pipeline->mListener) {
+      pipeline->mListener->onPeerConnected(pipeline);
+    }
+  } else if (state == GST_WEBRTC_PEER_CONNECTION_STATE_FAILED) {
+    pipeline->mTrace.mark("connection-failed");
+  }
+}
+
+GstPadProbeReturn WebRTCPipeline::onFirstRtpProbe(GstPad *pad, GstPadProbeInfo *info, gpointer userData)
+{
+  WebRTCPipeline *pipeline = (WebRTCPipeline *) userData;
+
+  // 接続前に webrtcbin に入ったパケットは送信されないので数えない
+  if (!pipeline->mConnected) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  if (!pipeline->mFirstRtpSent.exchange(true)) {
+    pipeline->mTrace.mark("first-rtp");
+  }
+  return GST_PAD_PROBE_REMOVE;
+}
+
 // 新規ストリームの追加
 void WebRTCPipeline::onIncomingStream(GstElement *webrtcbin, GstPad *pad, gpointer userData)
 {
@@ -355,4 +1308,9 @@ void WebRTCPipeline::onMessage(WebRTCDataChannel *channel, std::string& message)
   if (mListener) {
     mListener->onDataChannel(this, message);
   }
+}
+
+void WebRTCPipeline::onMessageData(WebRTCDataChannel *channel, const guint8 *data, gsize size)
+{
+  mRpc.receive(data, size);
 }
\ No newline at end of file
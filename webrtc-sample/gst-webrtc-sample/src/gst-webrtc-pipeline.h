@@ -1,11 +1,32 @@
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
 #include <string>
 #include <vector>
 #include <gst/gst.h>
+#include <gst/sdp/sdp.h>
 #include <json-glib/json-glib.h>
 
+#include "gst-data-channel-scheduler.h"
+#include "gst-frame-skipper.h"
+#include "gst-memory-accounting.h"
+#include "gst-object-pool.h"
+#include "gst-rpc-endpoint.h"
+#include "gst-rtp-pacer.h"
+#include "gst-rtp-relay.h"
+#include "gst-session-accounting.h"
+#include "gst-signal-handler.h"
+#include "gst-signaling-message.h"
+#include "gst-webrtc-config.h"
+#include "gst-webrtc-audio.h"
 #include "gst-webrtc-data-channel.h"
+#include "gst-webrtc-trace.h"
+
+// offer を送信してから answer が届くまで待つ時間 (ミリ秒)
+#define NEGOTIATION_TIMEOUT 10000
 
 class WebRTCPipeline;
 
@@ -14,6 +35,8 @@ public:
   virtual void onSendSdp(WebRTCPipeline *pipeline, gint type, gchar *sdp_string) {}
   virtual void onSendIceCandidate(WebRTCPipeline *pipeline, guint mlineindex, gchar *candidate) {}
   virtual void onAddStream(WebRTCPipeline *pipeline, GstPad *pad) {}
+  // DTLS のハンドシェイクが終わり、メディアを送信できるようになった時に呼ばれる
+  virtual void onPeerConnected(WebRTCPipeline *pipeline) {}
 
   virtual void onDataChannelConnected(WebRTCPipeline *pipeline) {}
   virtual void onDataChannelDisconnected(WebRTCPipeline *pipeline) {}
@@ -25,14 +48,100 @@ private:
   GstElement *mPipeline;
   GstElement *mWebRTCBin;
   WebRTCPipelineListener *mListener;
+  std::string mPeerId;
   WebRTCDataChannel *mSendDataChannel;
   std::vector<WebRTCDataChannel*> mReceiveDataChannels;
-  
-  gint mNegotiationNeededHandleId;
-  gint mSendIceCandidateHandleId;
-  gint mIceGatheringStateNotifyHandleId;
-  gint mIncomingStreamHandleId;
-  gint mDataChannelHandleId;
+  ObjectPool<WebRTCDataChannel> mDataChannelPool;
+
+  SignalHandler mNegotiationNeededHandler;
+  SignalHandler mSendIceCandidateHandler;
+  SignalHandler mIceGatheringStateNotifyHandler;
+  SignalHandler mIncomingStreamHandler;
+  SignalHandler mDataChannelHandler;
+  SignalHandler mIceConnectionStateNotifyHandler;
+  SignalHandler mConnectionStateNotifyHandler;
+
+  IceCandidatePolicy mIceCandidatePolicy;
+  guint mIcePortMin;
+  guint mIcePortMax;
+  guint mAllocatedPort;
+  bool mIceTcp;
+
+  SessionTrace mTrace;
+  bool mTracePrint;
+  std::string mTraceDir;
+  std::string mRecordLocation;
+  std::atomic<bool> mConnected;
+  std::atomic<bool> mFirstRtpSent;
+
+  // offer を送信して answer を待っている間に次のネゴシエーションが必要になった場合は、answer の後に行う
+  // answer が届かない場合は、タイムアウトで待つのをやめて次のネゴシエーションができるようにする
+  std::mutex mNegotiationMutex;
+  bool mOfferPending;
+  bool mNegotiationRequested;
+  gint64 mNegotiationRequestTime;
+  guint mNegotiationTimerId;
+
+  // シグナリングで送受信したバイト数 (ネゴシエーションごとの分とセッション全体の分)
+  // 最初のネゴシエーションは ICE の候補が answer の後にも届くので、接続が完了してから出力する
+  bool mSdpMinimize;
+  std::mutex mSignalingMutex;
+  SignalingBytes mSignalingBytes;
+  SignalingBytes mSignalingTotal;
+  guint mNegotiationCount;
+  bool mSignalingReportPending;
+
+  // 実行中に追加したトラックの bin の名前と webrtcbin の mline
+  // 削除した後もトランシーバーは残るので、同じ名前で追加する場合は同じ mline を使う
+  std::map<std::string, guint> mTracks;
+  std::map<std::string, WebRTCDataChannel*> mExtraDataChannels;
+
+  std::string mRtpRelayHost;
+  guint mRtpRelayPort;
+  UdpBatchSender::Mode mRtpRelayMode;
+  RtpRelay mVideoRelay;
+  RtpRelay mAudioRelay;
+
+  std::string mVideoCodecPreferences;
+  std::map<guint, std::string> mPayloadValves;
+
+  guint mFrameSkipKeepAlive;
+  FrameSkipper mFrameSkipper;
+
+  guint64 mPacingBitrate;
+  guint mPacingBurst;
+  guint mPacingMaxDelay;
+  RtpPacer mVideoPacer;
+
+  RpcEndpoint mRpc;
+  DataChannelScheduler mDataScheduler;
+  GstWebRTCPriorityType mDataChannelPriority;
+
+  AudioEncoderController mAudioController;
+  SessionAccounting mAccounting;
+  MemoryAccounting mMemoryAccounting;
+  bool mMemoryReport;
+  guint mStatsInterval;
+  guint mStatsTimerId;
+
+  // get-stats の応答を待っている promise、応答はストリーミングスレッドで処理されるので、停止時には完了を待つ
+  std::mutex mStatsMutex;
+  std::condition_variable mStatsCondition;
+  GstPromise *mStatsPromise;
+
+  void releaseDataChannel(WebRTCDataChannel *channel);
+  void applyRecordLocation();
+  void finalizeRecorder();
+  void handleStats(const GstStructure *stats);
+  void cancelStats();
+  void addFirstRtpProbes();
+  void attachFrameSkipper();
+  void attachPacer();
+  void applyVideoCodecPreferences();
+  void selectVideoPayload(const GstSDPMessage *sdp);
+  void applyIceAgentSettings();
+  bool isCandidateAllowed(const gchar *candidate);
+  void flushTrace();
 
   void createReceiveDataChannel(GstWebRTCDataChannel *dataChannel);
   void sendSdp(GstWebRTCSessionDescription *desc);
@@ -40,14 +149,30 @@ private:
   void addStream(GstPad *pad);
   void onOfferReceived(GstSDPMessage *sdp);
   void onAnswerReceived(GstSDPMessage *sdp);
+  void requestNegotiation();
+  void completeNegotiation();
+  void abortNegotiation(const char *reason);
+  void startNegotiationTimer();
+  void stopNegotiationTimer();
+  void createOffer();
+  void reportSignaling();
+  void printSignaling();
+  void setTransceiverDirection(guint mline, GstWebRTCRTPTransceiverDirection direction);
 
   static void onNegotiationNeeded(GstElement *webrtcbin, gpointer userData);
   static void onSendIceCandidate(GstElement *webrtcbin, guint mlineindex, gchar *candidate, gpointer userData);
   static void onIceGatheringStateNotify(GstElement *webrtcbin, GParamSpec *pspec, gpointer userData);
+  static void onIceConnectionStateNotify(GstElement *webrtcbin, GParamSpec *pspec, gpointer userData);
+  static void onConnectionStateNotify(GstElement *webrtcbin, GParamSpec *pspec, gpointer userData);
+  static GstPadProbeReturn onFirstRtpProbe(GstPad *pad, GstPadProbeInfo *info, gpointer userData);
+  static GstPadProbeReturn onTrackCapsProbe(GstPad *pad, GstPadProbeInfo *info, gpointer userData);
   static void onIncomingStream(GstElement *webrtcbin, GstPad *pad, gpointer userData);
   static void onDataChannel(GstElement *webrtcbin, GObject *dataChannel, gpointer userData);
   static void onOfferCreated(GstPromise *promise, gpointer userData);
   static void onAnswerCreated(GstPromise *promise, gpointer userData);
+  static gboolean onNegotiationTimeout(gpointer userData);
+  static gboolean onStatsTimer(gpointer userData);
+  static void onStatsReceived(GstPromise *promise, gpointer userData);
 
 public:
   WebRTCPipeline();
@@ -57,10 +182,258 @@ public:
     mListener = listener;
   }
 
+  // シグナリングで接続先を識別するためのピア ID
+  inline void setPeerId(std::string& peerId) {
+    mPeerId = peerId;
+  }
+
+  inline const std::string& getPeerId() const {
+    return mPeerId;
+  }
+
+  // webrtcbin から統計情報を取得する間隔 (ミリ秒)、0 の場合は取得しません。
+  inline void setStatsInterval(guint interval) {
+    mStatsInterval = interval;
+  }
+
+  /**
+   * データチャンネルのバイナリメッセージで行う RPC。
+   * 
+   * 受信用のデータチャンネルで受け取ったリクエストを処理して、送信用のデータチャンネルでレスポンスを返します。
+   */
+  inline RpcEndpoint& getRpc() {
+    return mRpc;
+  }
+
+  /**
+   * 送信用のデータチャンネルの送信順と送信量を決めるスケジューラ。
+   *
+   * sendMessage は control、RPC は DATA_CHANNEL_BULK_SIZE 未満なら rpc、それ以上は bulk として送信します。
+   */
+  inline DataChannelScheduler& getDataScheduler() {
+    return mDataScheduler;
+  }
+
+  // 送信用のデータチャンネルの SCTP の優先度を設定します。0 の場合は指定しません。
+  inline void setDataChannelPriority(GstWebRTCPriorityType priority) {
+    mDataChannelPriority = priority;
+  }
+
+  inline AudioEncoderController& getAudioController() {
+    return mAudioController;
+  }
+
+  // セッションが使用しているリソース、統計情報の取得間隔ごとに更新されます。
+  inline SessionAccounting& getAccounting() {
+    return mAccounting;
+  }
+
+  // セッション終了時に要素ごとのメモリ使用量を出力する場合は true
+  inline void setMemoryReport(bool enabled) {
+    mMemoryReport = enabled;
+  }
+
+  inline MemoryAccounting& getMemoryAccounting() {
+    return mMemoryAccounting;
+  }
+
+  /**
+   * 接続先に通知する ICE 候補の種類を設定します。
+   * 
+   * STUN/TURN サーバの指定は webrtcbin の記述で行います。
+   */
+  inline void setIceCandidatePolicy(IceCandidatePolicy policy) {
+    mIceCandidatePolicy = policy;
+  }
+
+  // ICE で使用する UDP ポートの範囲を設定します。0 の場合は指定しません。
+  inline void setIcePortRange(guint min, guint max) {
+    mIcePortMin = min;
+    mIcePortMax = max;
+  }
+
+  inline guint getIcePortMin() const {
+    return mIcePortMin;
+  }
+
+  inline guint getIcePortMax() const {
+    return mIcePortMax;
+  }
+
+  /**
+   * UdpPortAllocator から割り当てたポートを設定します。割り当てていない場合は 0 です。
+   * 
+   * セッションの終了時に WebRTCMain が解放するために保持するだけで、ICE の設定には setIcePortRange を使用します。
+   */
+  inline void setAllocatedPort(guint port) {
+    mAllocatedPort = port;
+  }
+
+  inline guint getAllocatedPort() const {
+    return mAllocatedPort;
+  }
+
+  // TCP の ICE 候補を使用するかを設定します。使用しない場合は TCP のソケットを作成しません。
+  inline void setIceTcp(bool enabled) {
+    mIceTcp = enabled;
+  }
+
+  /**
+   * 送信する RTP の転送先を設定します。
+   * 
+   * パイプラインに videorelay, audiorelay という名前のシンクがある場合に、
+   * 映像は port、音声は port + 2 に転送します。port が 0 の場合は転送しません。
+   * 転送は startRtpRelay を呼び出した時に開始します。
+   */
+  inline void setRtpRelay(const std::string& host, guint port, UdpBatchSender::Mode mode) {
+    mRtpRelayHost = host;
+    mRtpRelayPort = port;
+    mRtpRelayMode = mode;
+  }
+
+  /**
+   * offer に記述する映像のコーデックを caps で指定します。空の場合は送信する RTP の caps から決まります。
+   *
+   * 複数の構造体を ; で区切って指定すると、受信側が answer で選べるようになります。
+   */
+  inline void setVideoCodecPreferences(const std::string& caps) {
+    mVideoCodecPreferences = caps;
+  }
+
+  /**
+   * answer で選ばれたペイロードタイプに合わせて開く valve を設定します。
+   *
+   * answer の映像のペイロードタイプの中で最初に一致したものの valve を開き、それ以外は閉じたままにします。
+   * valve は drop=true で作成しておく必要があります。
+   */
+  inline void setPayloadValves(const std::map<guint, std::string>& valves) {
+    mPayloadValves = valves;
+  }
+
+  // パイプラインの中の要素を名前で取得します。不要になったら gst_object_unref で解放してください。
+  GstElement *getElementByName(const gchar *name);
+
+  /**
+   * 接続中のセッションに映像・音声のトラックを追加します。
+   *
+   * description は gst-launch 形式で、最後のエレメントの src パッドから RTP を出力する記述にします。
+   * bin にして webrtcbin の新しい sink パッドに接続し、caps が決まった時点で再ネゴシエーションを行います。
+   * ICE と DTLS の接続はそのまま使うので、パイプラインを作り直すより短い時間で配信を始められます。
+   *
+   * @param name bin の名前、パイプラインの中で一意にしてください
+   * @return 同じ名前のトラックがある場合や記述が不正な場合は false
+   */
+  bool addTrack(const std::string& name, const std::string& description);
+
+  /**
+   * addTrack で追加したトラックを削除して再ネゴシエーションを行います。
+   *
+   * m-line は SDP から削除できないので、トランシーバーは inactive にして残します。
+   */
+  bool removeTrack(const std::string& name);
+
+  bool hasTrack(const std::string& name);
+
+  /**
+   * 送信用のデータチャンネルを追加します。
+   *
+   * SCTP の接続は send-channel と共有するので、再ネゴシエーションは行いません。
+   * 受信したメッセージは send-channel と同じようにリスナーに通知されます。
+   *
+   * @return 同じ名前のデータチャンネルがある場合やパイプラインが開始していない場合は nullptr
+   */
+  WebRTCDataChannel *addDataChannel(const std::string& label, GstWebRTCPriorityType priority = (GstWebRTCPriorityType) 0);
+  bool removeDataChannel(const std::string& label);
+
+  /**
+   * 変化のない映像フレームをエンコーダに渡さないようにします。
+   *
+   * パイプラインに videosrc という名前の映像ソースがある場合に、その src パッドで前のフレームと比較します。
+   * keepAliveInterval (ミリ秒) ごとには変化がなくてもフレームを渡します。0 の場合は比較しません。
+   */
+  inline void setFrameSkip(guint keepAliveInterval) {
+    mFrameSkipKeepAlive = keepAliveInterval;
+  }
+
+  /**
+   * 映像の RTP パケットの送信間隔を目標ビットレートに合わせて空けます。
+   *
+   * パイプラインに videopacer という名前の queue がある場合に、その src パッドで送信を待たせます。
+   *
+   * @param bitrate 映像の目標ビットレート (bps)、0 の場合は間隔を空けません
+   * @param burstTime 間隔を空けずに送信できる量 (ミリ秒)
+   * @param maxDelay 1 パケットを待たせる最大時間 (ミリ秒)
+   */
+  inline void setPacing(guint64 bitrate, guint burstTime, guint maxDelay) {
+    mPacingBitrate = bitrate;
+    mPacingBurst = burstTime;
+    mPacingMaxDelay = maxDelay;
+  }
+
+  /**
+   * シグナリングで送信する SDP と ICE の候補から、相手が使わない記述を削除するかを設定します。
+   *
+   * 削除する記述は SdpMinimizer を参照してください。
+   */
+  inline void setSdpMinimize(bool minimize) {
+    mSdpMinimize = minimize;
+  }
+
+  /**
+   * シグナリングで送受信したメッセージのバイト数を加算します。
+   *
+   * ネゴシエーションが終わるたびに、そのネゴシエーションで送受信したバイト数を出力します。
+   * 最初のネゴシエーションは、ICE の候補の交換が終わる接続の完了まで出力を遅らせます。
+   *
+   * @param sent 送信した場合は true、受信した場合は false
+   * @param isSdp SDP の場合は true、ICE の候補の場合は false
+   * @param bytes 宛先指定の封筒を含めた、トランスポートで送受信したバイト数
+   */
+  void countSignalingMessage(bool sent, bool isSdp, gsize bytes);
+
+  inline SessionTrace& getTrace() {
+    return mTrace;
+  }
+
+  /**
+   * セッション終了時のトレースの出力先を設定します。
+   * 
+   * @param print 各イベントの経過時間を出力する場合は true
+   * @param dir Chrome のトレース形式の JSON を保存するフォルダ、空の場合は保存しません
+   */
+  inline void setTraceOutput(bool print, std::string& dir) {
+    mTracePrint = print;
+    mTraceDir = dir;
+  }
+
+  /**
+   * 録画の保存先を設定します。
+   * 
+   * パイプラインに recorder という名前の splitmuxsink がある場合に、location に設定します。
+   * gst_parse_launch の記述に含めないので、ファイル名に引用符などが含まれていても問題ありません。
+   */
+  inline void setRecordLocation(const std::string& location) {
+    mRecordLocation = location;
+  }
+
   void startPipeline(std::string& bin);
+
+  /**
+   * setRtpRelay で設定した転送先に、送信する RTP の転送を開始します。
+   * 
+   * 複数のセッションが同じ転送先に重複して送信しないように、WebRTCMain が 1 セッションだけで呼び出します。
+   * 転送はパイプラインの停止時に終了します。
+   *
+   * @return 転送を開始した場合、または既に転送している場合は true
+   */
+  bool startRtpRelay();
   void stopPipeline();
   void sendMessage(std::string& message);
 
+  inline size_t getDataChannelAllocationCount() const {
+    return mDataChannelPool.getAllocationCount();
+  }
+
   void onOfferReceived(const gchar *sdp);
   void onAnswerReceived(const gchar *sdp);
   void onIceReceived(guint mlineIndex, const gchar *candidateString);
@@ -69,4 +442,5 @@ public:
   virtual void onConnected(WebRTCDataChannel *channel);
   virtual void onDisconnected(WebRTCDataChannel *channel);
   virtual void onMessage(WebRTCDataChannel *channel, std::string& message);
+  virtual void onMessageData(WebRTCDataChannel *channel, const guint8 *data, gsize size);
 };
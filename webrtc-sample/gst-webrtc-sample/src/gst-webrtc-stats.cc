@@ -0,0 +1,31 @@
+#include "gst-webrtc-stats.h"
+
+struct ForeachData {
+  WebRTCStats::Callback *callback;
+};
+
+static gboolean foreach_stat(GQuark fieldId, const GValue *value, gpointer userData)
+{
+  ForeachData *data = (ForeachData *) userData;
+
+  if (!GST_VALUE_HOLDS_STRUCTURE(value)) {
+    return TRUE;
+  }
+
+  const GstStructure *stat = gst_value_get_structure(value);
+  GstWebRTCStatsType type;
+  if (gst_structure_get(stat, "type", GST_TYPE_WEBRTC_STATS_TYPE, &type, NULL)) {
+    (*data->callback)(type, stat);
+  }
+  return TRUE;
+}
+
+void WebRTCStats::foreach(const GstStructure *stats, Callback callback)
+{
+  if (!stats) {
+    return;
+  }
+
+  ForeachData data = { &callback };
+  gst_structure_foreach(stats, foreach_stat, &data);
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <functional>
+#include <gst/gst.h>
+#define GST_USE_UNSTABLE_API
+#include <gst/webrtc/webrtc.h>
+
+/**
+ * webrtcbin の get-stats で取得した統計情報を扱うためのユーティリティ。
+ */
+class WebRTCStats {
+public:
+  typedef std::function<void(GstWebRTCStatsType type, const GstStructure *stat)> Callback;
+
+  // 統計情報に含まれる各項目を種類と一緒に callback に渡します。
+  static void foreach(const GstStructure *stats, Callback callback);
+};
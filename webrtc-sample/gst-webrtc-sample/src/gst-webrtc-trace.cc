@@ -0,0 +1,163 @@
+#include "gst-webrtc-trace.h"
+#include <algorithm>
+#include <json-glib/json-glib.h>
+
+SessionTrace::SessionTrace(size_t capacity)
+{
+  mEvents.resize(capacity > 0 ? capacity : 1);
+  mHead = 0;
+  mCount = 0;
+}
+
+SessionTrace::~SessionTrace()
+{
+}
+
+void SessionTrace::reset()
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+  mHead = 0;
+  mCount = 0;
+}
+
+void SessionTrace::mark(const char *name)
+{
+  mark(name, g_get_monotonic_time());
+}
+
+void SessionTrace::mark(const char *name, gint64 timestamp)
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+  mEvents[mHead].name = name;
+  mEvents[mHead].timestamp = timestamp;
+  mHead = (mHead + 1) % mEvents.size();
+  if (mCount < mEvents.size()) {
+    mCount++;
+  }
+}
+
+gint64 SessionTrace::getElapsed(const char *name)
+{
+  std::vector<Event> events = getEvents();
+  if (events.empty()) {
+    return -1;
+  }
+
+  for (auto itr = events.begin(); itr != events.end(); ++itr) {
+    if (g_strcmp0(itr->name, name) == 0) {
+      return itr->timestamp - events.front().timestamp;
+    }
+  }
+  return -1;
+}
+
+/**
+ * Chrome のトレース形式の JSON を作成します。
+ * 
+ * <pre>
+ * {
+ *   "traceEvents": [
+ *     { "name": "player-connected", "ph": "i", "s": "p", "ts": ..., "pid": 1, "tid": 1 },
+ *     { "name": "offer-created", "ph": "X", "ts": ..., "dur": ..., "pid": 1, "tid": 1 },
+ *     ...
+ *   ]
+ * }
+ * </pre>
+ * 
+ * 各イベントは、直前のイベントからの区間としても出力します。
+ */
+std::string SessionTrace::toChromeTraceJson(const std::string& sessionName)
+{
+  std::vector<Event> events = getEvents();
+
+  JsonArray *array = json_array_new();
+  for (size_t i = 0; i < events.size(); i++) {
+    JsonObject *instant = json_object_new();
+    json_object_set_string_member(instant, "name", events[i].name);
+    json_object_set_string_member(instant, "cat", sessionName.c_str());
+    json_object_set_string_member(instant, "ph", "i");
+    json_object_set_string_member(instant, "s", "p");
+    json_object_set_int_member(instant, "ts", events[i].timestamp);
+    json_object_set_int_member(instant, "pid", 1);
+    json_object_set_int_member(instant, "tid", 1);
+    json_array_add_object_element(array, instant);
+
+    if (i > 0) {
+      JsonObject *span = json_object_new();
+      json_object_set_string_member(span, "name", events[i].name);
+      json_object_set_string_member(span, "cat", sessionName.c_str());
+      json_object_set_string_member(span, "ph", "X");
+      json_object_set_int_member(span, "ts", events[i - 1].timestamp);
+      json_object_set_int_member(span, "dur", events[i].timestamp - events[i - 1].timestamp);
+      json_object_set_int_member(span, "pid", 1);
+      json_object_set_int_member(span, "tid", 1);
+      json_array_add_object_element(array, span);
+    }
+  }
+
+  JsonObject *root_object = json_object_new();
+  json_object_set_array_member(root_object, "traceEvents", array);
+
+  JsonNode *root = json_node_init_object(json_node_alloc(), root_object);
+  JsonGenerator *generator = json_generator_new();
+  json_generator_set_root(generator, root);
+  gchar *text = json_generator_to_data(generator, NULL);
+  g_object_unref(generator);
+  json_node_free(root);
+  json_object_unref(root_object);
+
+  std::string json(text ? text : "");
+  g_free(text);
+  return json;
+}
+
+bool SessionTrace::dump(const std::string& path, const std::string& sessionName)
+{
+  std::string json = toChromeTraceJson(sessionName);
+
+  GError *error = NULL;
+  if (!g_file_set_contents(path.c_str(), json.c_str(), json.size(), &error)) {
+    g_printerr("Failed to write trace %s: %s\n", path.c_str(), error->message);
+    g_error_free(error);
+    return false;
+  }
+  return true;
+}
+
+void SessionTrace::print(const std::string& sessionName)
+{
+  std::vector<Event> events = getEvents();
+  if (events.empty()) {
+    return;
+  }
+
+  GString *text = g_string_new(NULL);
+  g_string_append_printf(text, "Session trace [%s]:", sessionName.c_str());
+  for (auto itr = events.begin(); itr != events.end(); ++itr) {
+    g_string_append_printf(text, " %s=+%.1fms", itr->name,
+        (itr->timestamp - events.front().timestamp) / 1000.0);
+  }
+  g_print("%s\n", text->str);
+  g_string_free(text, TRUE);
+}
+
+// private functions.
+
+std::vector<SessionTrace::Event> SessionTrace::getEvents()
+{
+  std::vector<Event> events;
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    events.reserve(mCount);
+    size_t start = (mHead + mEvents.size() - mCount) % mEvents.size();
+    for (size_t i = 0; i < mCount; i++) {
+      events.push_back(mEvents[(start + i) % mEvents.size()]);
+    }
+  }
+
+  // 別スレッドから記録されたイベントは前後することがあるので、時刻順に並べ替える
+  std::stable_sort(events.begin(), events.end(), [](const Event& a, const Event& b) {
+    return a.timestamp < b.timestamp;
+  });
+  return events;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <vector>
+#include <glib.h>
+
+/**
+ * セッションの接続処理の各段階の時刻を記録するトレース。
+ * 
+ * 単調増加の時刻 (g_get_monotonic_time) をリングバッファに記録します。
+ * イベント名には文字列リテラルを使用するので、記録時にメモリ確保は発生しません。
+ * 記録した内容は Chrome のトレース形式 (chrome://tracing, Perfetto) の JSON で出力できます。
+ */
+class SessionTrace {
+private:
+  struct Event {
+    const char *name;
+    gint64 timestamp;
+  };
+
+  std::mutex mMutex;
+  std::vector<Event> mEvents;
+  size_t mHead;
+  size_t mCount;
+
+  std::vector<Event> getEvents();
+
+public:
+  SessionTrace(size_t capacity = 64);
+  virtual ~SessionTrace();
+
+  void reset();
+
+  // name には文字列リテラルなど、トレースより長く生存する文字列を渡す必要があります。
+  void mark(const char *name);
+  void mark(const char *name, gint64 timestamp);
+
+  // 最初に記録したイベントから name のイベントまでの時間 (マイクロ秒)、記録されていない場合は -1
+  gint64 getElapsed(const char *name);
+
+  std::string toChromeTraceJson(const std::string& sessionName);
+  bool dump(const std::string& path, const std::string& sessionName);
+
+  // 各イベントの経過時間を 1 行で出力します。
+  void print(const std::string& sessionName);
+};
@@ -1,20 +1,30 @@
 #include "gst-websocket-client.h"
+#include "gst-signaling-envelope.h"
 
 WebsocketClient::WebsocketClient() {
+  mSession = nullptr;
   mConnection = nullptr;
-  mListener = nullptr;
-  mDisconnectHandleId = 0;
-  mMessageHandleId = 0;
+  mTargetedRouting = false;
+  mCompression = false;
 }
 
 WebsocketClient::~WebsocketClient()
 {
   disconnect();
+
+  if (mSession) {
+    soup_session_abort(mSession);
+    g_object_unref(mSession);
+    mSession = nullptr;
+  }
 }
 
 void WebsocketClient::connectAsync(std::string& url, std::string& origin)
 {
   std::vector<std::string> protocols;
+  if (mTargetedRouting) {
+    protocols.push_back(WEBSOCKET_TARGETED_PROTOCOL);
+  }
   this->connectAsync(url, origin, protocols);
 }
 
@@ -27,7 +37,8 @@ void WebsocketClient::connectAsync(std::string& url, std::string& origin, std::v
 void WebsocketClient::connectAsync(std::string& url, std::string& origin, std::vector<std::string>& protocols, std::string& userAgent, bool isLogger)
 {
   SoupMessage *message;
-  SoupSession *session;
+
+  disconnect();
 
   const gchar *t_protocols[protocols.size() + 1];
   for(size_t i = 0; i < protocols.size(); i++) {
@@ -35,35 +46,35 @@ void WebsocketClient::connectAsync(std::string& url, std::string& origin, std::v
   }
   t_protocols[protocols.size()] = NULL;
 
-  session = soup_session_new_with_options(SOUP_SESSION_USER_AGENT, userAgent.c_str(), NULL);
-  g_object_set(G_OBJECT(session), SOUP_SESSION_SSL_STRICT, FALSE, NULL);
+  // 再接続時にはセッションを使い回す
+  if (!mSession) {
+    mSession = soup_session_new_with_options(SOUP_SESSION_USER_AGENT, userAgent.c_str(), NULL);
+    g_object_set(G_OBJECT(mSession), SOUP_SESSION_SSL_STRICT, FALSE, NULL);
 
-  if (isLogger) {
-    SoupLogger *logger = soup_logger_new(SOUP_LOGGER_LOG_BODY, -1);
-    soup_session_add_feature(session, SOUP_SESSION_FEATURE(logger));
-    g_object_unref(logger);
+    if (isLogger) {
+      SoupLogger *logger = soup_logger_new(SOUP_LOGGER_LOG_BODY, -1);
+      soup_session_add_feature(mSession, SOUP_SESSION_FEATURE(logger));
+      g_object_unref(logger);
+    }
+  } else {
+    g_object_set(G_OBJECT(mSession), SOUP_SESSION_USER_AGENT, userAgent.c_str(), NULL);
   }
+  applyCompression();
 
   message = soup_message_new(SOUP_METHOD_GET, url.c_str());
 
-  soup_session_websocket_connect_async(session, message, origin.c_str(), 
+  soup_session_websocket_connect_async(mSession, message, origin.c_str(), 
       (gchar **) t_protocols, NULL, 
       (GAsyncReadyCallback) WebsocketClient::onServerConnected, this);
+  g_object_unref(message);
 }
 
 void WebsocketClient::disconnect()
 {
- if (mConnection) {
-    if (mDisconnectHandleId) {
-      g_signal_handler_disconnect(G_OBJECT(mConnection), mDisconnectHandleId);
-      mDisconnectHandleId = 0;
-    }
-
-    if (mMessageHandleId) {
-      g_signal_handler_disconnect(G_OBJECT(mConnection), mMessageHandleId);
-      mMessageHandleId = 0;
-    }
+  mDisconnectHandler.disconnect();
+  mMessageHandler.disconnect();
 
+  if (mConnection) {
     if (soup_websocket_connection_get_state(mConnection) == SOUP_WEBSOCKET_STATE_OPEN) {
       soup_websocket_connection_close(mConnection, 1000, "disconnect");
     }
@@ -73,15 +84,51 @@ void WebsocketClient::disconnect()
   }
 }
 
-void WebsocketClient::sendMessage(std::string& message)
+size_t WebsocketClient::sendMessage(std::string& message)
 {
-  if (mConnection) {
-    soup_websocket_connection_send_text(mConnection, message.c_str());
+  if (!mConnection) {
+    return 0;
   }
+  soup_websocket_connection_send_text(mConnection, message.c_str());
+  return message.size();
+}
+
+size_t WebsocketClient::sendMessage(std::string& peerId, std::string& message)
+{
+  if (!mTargetedRouting || peerId.empty()) {
+    return sendMessage(message);
+  }
+
+  std::string envelope;
+  if (!SignalingEnvelope::wrap("to", peerId, message, envelope)) {
+    return 0;
+  }
+  return sendMessage(envelope);
 }
 
 // private functions.
 
+void WebsocketClient::applyCompression()
+{
+#if SOUP_CHECK_VERSION(2, 68, 0)
+  // libsoup 2.68 以降のセッションには拡張のマネージャと permessage-deflate が最初から登録されている
+  if (mCompression) {
+    if (!soup_session_has_feature(mSession, SOUP_TYPE_WEBSOCKET_EXTENSION_MANAGER)) {
+      soup_session_add_feature_by_type(mSession, SOUP_TYPE_WEBSOCKET_EXTENSION_MANAGER);
+    }
+    if (!soup_session_has_feature(mSession, SOUP_TYPE_WEBSOCKET_EXTENSION_DEFLATE)) {
+      soup_session_add_feature_by_type(mSession, SOUP_TYPE_WEBSOCKET_EXTENSION_DEFLATE);
+    }
+  } else {
+    soup_session_remove_feature_by_type(mSession, SOUP_TYPE_WEBSOCKET_EXTENSION_DEFLATE);
+  }
+#else
+  if (mCompression) {
+    g_printerr("permessage-deflate requires libsoup 2.68 or later, sending uncompressed.\n");
+  }
+#endif
+}
+
 void WebsocketClient::onServerConnected(SoupSession *session, GAsyncResult *res, gpointer userData)
 {
   GError *error = NULL;
@@ -93,10 +140,17 @@ void WebsocketClient::onServerConnected(SoupSession *session, GAsyncResult *res,
 
   WebsocketClient *client = (WebsocketClient *) userData;
   if (client) {
+#if SOUP_CHECK_VERSION(2, 68, 0)
+    if (client->mCompression) {
+      // シグナリングサーバが対応していない場合は拡張なしで接続される
+      GList *extensions = soup_websocket_connection_get_extensions(wsConn);
+      g_print("Signaling compression: %s\n", extensions ? G_OBJECT_TYPE_NAME(extensions->data) : "none");
+    }
+#endif
     client->mConnection = wsConn;
-    client->mDisconnectHandleId = g_signal_connect(wsConn, "closed", 
+    client->mDisconnectHandler.connect(wsConn, "closed", 
         G_CALLBACK(WebsocketClient::onServerClosed), userData);
-    client->mMessageHandleId = g_signal_connect(wsConn, "message", 
+    client->mMessageHandler.connect(wsConn, "message", 
         G_CALLBACK(WebsocketClient::onServerMessage), userData);
 
     if (client->mListener) {
@@ -127,8 +181,16 @@ void WebsocketClient::onServerMessage(SoupWebsocketConnection *conn, SoupWebsock
       gchar *text = g_strndup(data, size);
       if (text) {
         std::string msg(text);
+        std::string peerId;
+        size_t wireSize = msg.size();
         if (client && client->mListener) {
-          client->mListener->onMessage(client, msg);
+          if (client->mTargetedRouting) {
+            std::string payload;
+            if (SignalingEnvelope::unwrap("from", msg, peerId, payload)) {
+              msg.swap(payload);
+            }
+          }
+          client->mListener->onMessage(client, peerId, msg, wireSize);
         }
         g_free(text);
       }
@@ -4,22 +4,23 @@
 #include <vector>
 #include <libsoup/soup.h>
 
-class WebsocketClient;
+#include "gst-signal-handler.h"
+#include "gst-signaling-transport.h"
 
-class WebsocketClientListener {
-public:
-  virtual void onConnected(WebsocketClient *client) {}
-  virtual void onDisconnected(WebsocketClient *client) {}
-  virtual void onMessage(WebsocketClient *client, std::string& message) {}
-};
+// 宛先指定モードで接続する場合のサブプロトコル名
+#define WEBSOCKET_TARGETED_PROTOCOL "targeted"
 
-class WebsocketClient {
+class WebsocketClient : public SignalingTransport {
 private:
+  SoupSession *mSession;
   SoupWebsocketConnection *mConnection;
-  WebsocketClientListener *mListener;
+  bool mTargetedRouting;
+  bool mCompression;
+
+  SignalHandler mDisconnectHandler;
+  SignalHandler mMessageHandler;
 
-  gint mDisconnectHandleId;
-  gint mMessageHandleId;
+  void applyCompression();
 
   static void onServerConnected(SoupSession *session, GAsyncResult *res, gpointer userData);
   static void onServerClosed(SoupWebsocketConnection *conn G_GNUC_UNUSED, gpointer userData);
@@ -29,13 +30,34 @@ public:
   WebsocketClient();
   virtual ~WebsocketClient();
 
-  inline void setListener(WebsocketClientListener *listener) {
-    mListener = listener;
+  /**
+   * 宛先指定モードを設定します。
+   * 
+   * 有効にした場合には、サブプロトコル targeted でシグナリングサーバに接続し、
+   * メッセージをピア ID 付きの封筒に入れて送受信します。
+   * connectAsync の前に設定する必要があります。
+   */
+  inline void setTargetedRouting(bool targeted) {
+    mTargetedRouting = targeted;
   }
 
-  void connectAsync(std::string& url, std::string& origin);
+  /**
+   * permessage-deflate でメッセージを圧縮するかを設定します。
+   *
+   * 有効にした場合には、接続時に permessage-deflate を要求し、シグナリングサーバが対応していれば圧縮して送受信します。
+   * libsoup 2.68 より前のバージョンでは圧縮できません。
+   * connectAsync の前に設定する必要があります。
+   */
+  inline void setCompression(bool compression) {
+    mCompression = compression;
+  }
+
+  // SignalingTransport implements.
+  virtual void connectAsync(std::string& url, std::string& origin);
+  virtual void disconnect();
+  virtual size_t sendMessage(std::string& peerId, std::string& message);
+
   void connectAsync(std::string& url, std::string& origin, std::vector<std::string>& protocols);
   void connectAsync(std::string& url, std::string& origin, std::vector<std::string>& protocols, std::string& userAgent, bool isLogger);
-  void disconnect();
-  void sendMessage(std::string& message);
+  size_t sendMessage(std::string& message);
 };
@@ -0,0 +1,116 @@
+#include "gst-admission-controller.h"
+
+static AdmissionUsage createUsage(guint sessions, gdouble cpu, guint64 memory, guint64 bandwidth)
+{
+  AdmissionUsage usage;
+  usage.sessions = sessions;
+  usage.cpu = cpu;
+  usage.memory = memory;
+  usage.bandwidth = bandwidth;
+  return usage;
+}
+
+// 上限を設定しない場合は全て受け入れる
+static void test_disabled()
+{
+  AdmissionController controller;
+  g_assert_false(controller.isEnabled());
+
+  std::string reason("previous");
+  g_assert_cmpint(controller.decide(createUsage(1000, 800.0, G_MAXUINT32, G_MAXUINT32), reason), ==, ADMISSION_ACCEPT);
+  g_assert_true(reason.empty());
+}
+
+static void test_sessions()
+{
+  AdmissionLimits limits;
+  limits.maxSessions = 10;
+
+  AdmissionController controller;
+  controller.setLimits(limits);
+  g_assert_true(controller.isEnabled());
+
+  std::string reason;
+  g_assert_cmpint(controller.decide(createUsage(0, 0.0, 0, 0), reason), ==, ADMISSION_ACCEPT);
+  g_assert_true(reason.empty());
+
+  // 追加後が 8 セッションまでは degradeRatio (0.8) 以内
+  g_assert_cmpint(controller.decide(createUsage(7, 0.0, 0, 0), reason), ==, ADMISSION_ACCEPT);
+
+  g_assert_cmpint(controller.decide(createUsage(8, 0.0, 0, 0), reason), ==, ADMISSION_DEGRADE);
+  g_assert_cmpstr(reason.c_str(), ==, "sessions");
+
+  // 追加後がちょうど上限の場合は拒否しない
+  g_assert_cmpint(controller.decide(createUsage(9, 0.0, 0, 0), reason), ==, ADMISSION_DEGRADE);
+
+  g_assert_cmpint(controller.decide(createUsage(10, 0.0, 0, 0), reason), ==, ADMISSION_REJECT);
+  g_assert_cmpstr(reason.c_str(), ==, "sessions");
+
+  g_assert_cmpuint(controller.getAcceptCount(), ==, 2);
+  g_assert_cmpuint(controller.getDegradeCount(), ==, 2);
+  g_assert_cmpuint(controller.getRejectCount(), ==, 1);
+}
+
+// セッション数以外は、既存のセッションの平均を新しいセッションの分として見積もる
+static void test_estimate()
+{
+  AdmissionLimits limits;
+  limits.maxCpu = 100.0;
+  limits.maxBandwidth = 10000000;
+
+  AdmissionController controller;
+  controller.setLimits(limits);
+
+  std::string reason;
+  // 2 セッションで 40% なので、追加後は 60%
+  g_assert_cmpint(controller.decide(createUsage(2, 40.0, 0, 0), reason), ==, ADMISSION_ACCEPT);
+
+  // 2 セッションで 60% なので、追加後は 90%
+  g_assert_cmpint(controller.decide(createUsage(2, 60.0, 0, 0), reason), ==, ADMISSION_DEGRADE);
+  g_assert_cmpstr(reason.c_str(), ==, "cpu");
+
+  // 2 セッションで 80% なので、追加後は 120%
+  g_assert_cmpint(controller.decide(createUsage(2, 80.0, 0, 0), reason), ==, ADMISSION_REJECT);
+  g_assert_cmpstr(reason.c_str(), ==, "cpu");
+
+  // セッションがない場合は現在の値をそのまま使う
+  g_assert_cmpint(controller.decide(createUsage(0, 50.0, 0, 0), reason), ==, ADMISSION_ACCEPT);
+
+  g_assert_cmpint(controller.decide(createUsage(4, 0.0, 0, 9000000), reason), ==, ADMISSION_REJECT);
+  g_assert_cmpstr(reason.c_str(), ==, "bandwidth");
+}
+
+// 品質を下げる判定より、拒否の判定を優先する
+static void test_reject_wins()
+{
+  AdmissionLimits limits;
+  limits.maxSessions = 10;
+  limits.maxMemory = 1000;
+
+  AdmissionController controller;
+  controller.setLimits(limits);
+
+  std::string reason;
+  g_assert_cmpint(controller.decide(createUsage(8, 0.0, 1000, 0), reason), ==, ADMISSION_REJECT);
+  g_assert_cmpstr(reason.c_str(), ==, "memory");
+}
+
+static void test_decision_name()
+{
+  g_assert_cmpstr(AdmissionController::getDecisionName(ADMISSION_ACCEPT), ==, "accept");
+  g_assert_cmpstr(AdmissionController::getDecisionName(ADMISSION_DEGRADE), ==, "degrade");
+  g_assert_cmpstr(AdmissionController::getDecisionName(ADMISSION_REJECT), ==, "reject");
+}
+
+int main(int argc, char *argv[])
+{
+  g_test_init(&argc, &argv, NULL);
+
+  g_test_add_func("/admission-controller/disabled", test_disabled);
+  g_test_add_func("/admission-controller/sessions", test_sessions);
+  g_test_add_func("/admission-controller/estimate", test_estimate);
+  g_test_add_func("/admission-controller/reject-wins", test_reject_wins);
+  g_test_add_func("/admission-controller/decision-name", test_decision_name);
+
+  return g_test_run();
+}
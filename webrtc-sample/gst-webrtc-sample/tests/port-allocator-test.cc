@@ -0,0 +1,91 @@
+#include "gst-port-allocator.h"
+
+static void test_acquire_all()
+{
+  UdpPortAllocator allocator;
+  allocator.setRange(50000, 50002);
+  g_assert_cmpuint(allocator.getAvailableCount(), ==, 3);
+
+  g_assert_cmpuint(allocator.acquire(), ==, 50000);
+  g_assert_cmpuint(allocator.acquire(), ==, 50001);
+  g_assert_cmpuint(allocator.acquire(), ==, 50002);
+  g_assert_cmpuint(allocator.getAvailableCount(), ==, 0);
+
+  // 空いていない場合は 0 を返す
+  g_assert_cmpuint(allocator.acquire(), ==, 0);
+
+  allocator.release(50001);
+  g_assert_cmpuint(allocator.getAvailableCount(), ==, 1);
+  g_assert_cmpuint(allocator.acquire(), ==, 50001);
+}
+
+// 直前に解放したポートはすぐに再利用しない
+static void test_round_robin()
+{
+  UdpPortAllocator allocator;
+  allocator.setRange(50000, 50002);
+
+  guint port = allocator.acquire();
+  g_assert_cmpuint(port, ==, 50000);
+  allocator.release(port);
+
+  g_assert_cmpuint(allocator.acquire(), ==, 50001);
+  g_assert_cmpuint(allocator.acquire(), ==, 50002);
+  g_assert_cmpuint(allocator.acquire(), ==, 50000);
+}
+
+static void test_release_out_of_range()
+{
+  UdpPortAllocator allocator;
+  allocator.setRange(50000, 50001);
+  g_assert_cmpuint(allocator.acquire(), ==, 50000);
+
+  allocator.release(0);
+  allocator.release(49999);
+  allocator.release(50002);
+  g_assert_cmpuint(allocator.getAvailableCount(), ==, 1);
+
+  // 同じポートを 2 回解放しても空きは増えない
+  allocator.release(50000);
+  allocator.release(50000);
+  g_assert_cmpuint(allocator.getAvailableCount(), ==, 2);
+}
+
+static void test_invalid_range()
+{
+  UdpPortAllocator allocator;
+  g_assert_cmpuint(allocator.acquire(), ==, 0);
+
+  allocator.setRange(50001, 50000);
+  g_assert_cmpuint(allocator.getAvailableCount(), ==, 0);
+  g_assert_cmpuint(allocator.acquire(), ==, 0);
+
+  allocator.setRange(0, 50000);
+  g_assert_cmpuint(allocator.acquire(), ==, 0);
+}
+
+// 範囲を変更すると、割り当て済みのポートは全て解放される
+static void test_set_range_resets()
+{
+  UdpPortAllocator allocator;
+  allocator.setRange(50000, 50000);
+  g_assert_cmpuint(allocator.acquire(), ==, 50000);
+  g_assert_cmpuint(allocator.acquire(), ==, 0);
+
+  allocator.setRange(60000, 60001);
+  g_assert_cmpuint(allocator.getAvailableCount(), ==, 2);
+  g_assert_cmpuint(allocator.acquire(), ==, 60000);
+}
+
+int main(int argc, char *argv[])
+{
+  g_test_init(&argc, &argv, NULL);
+
+  g_test_add_func("/port-allocator/acquire-all", test_acquire_all);
+  g_test_add_func("/port-allocator/round-robin", test_round_robin);
+  g_test_add_func("/port-allocator/release-out-of-range", test_release_out_of_range);
+  g_test_add_func("/port-allocator/invalid-range", test_invalid_range);
+  g_test_add_func("/port-allocator/set-range-resets", test_set_range_resets);
+
+  return g_test_run();
+}
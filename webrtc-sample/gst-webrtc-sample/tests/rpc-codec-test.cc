@@ -0,0 +1,185 @@
+#include "gst-rpc-codec.h"
+
+// 境界のちょうどの値ではなく、上限に収まる・超えることがはっきりしたサイズで確認する
+#define LARGE_PAYLOAD_SIZE (900 * 1024)
+
+static bool decode(const std::string& message, std::vector<RpcFrame>& frames)
+{
+  return RpcCodec::decode((const guint8 *) message.data(), message.size(), frames);
+}
+
+static RpcFrame createFrame(guint8 type, guint64 requestId, guint32 code, const std::string& payload)
+{
+  RpcFrame frame;
+  frame.type = type;
+  frame.requestId = requestId;
+  frame.code = code;
+  frame.payload = payload;
+  return frame;
+}
+
+static void test_varint()
+{
+  const guint64 values[] = { 0, 1, 127, 128, 300, G_MAXUINT32, G_MAXUINT64 };
+
+  for (size_t i = 0; i < G_N_ELEMENTS(values); i++) {
+    std::string out;
+    RpcCodec::writeVarint(out, values[i]);
+
+    const guint8 *data = (const guint8 *) out.data();
+    const guint8 *end = data + out.size();
+    guint64 value = 0;
+    g_assert_true(RpcCodec::readVarint(data, end, value));
+    g_assert_cmpuint(value, ==, values[i]);
+    g_assert_true(data == end);
+
+    // 最後のバイトがない場合は読み込めない
+    data = (const guint8 *) out.data();
+    g_assert_false(RpcCodec::readVarint(data, end - 1, value));
+  }
+}
+
+static void test_round_trip()
+{
+  std::string message;
+  RpcCodec::encode(createFrame(RPC_FRAME_REQUEST, 1, 42, "hello"), message);
+  RpcCodec::encode(createFrame(RPC_FRAME_RESPONSE, 1, 0, ""), message);
+  RpcCodec::encode(createFrame(RPC_FRAME_ERROR, G_MAXUINT64, G_MAXUINT32, std::string("\0\1\2", 3)), message);
+
+  std::vector<RpcFrame> frames;
+  g_assert_true(decode(message, frames));
+  g_assert_cmpuint(frames.size(), ==, 3);
+
+  g_assert_cmpuint(frames[0].type, ==, RPC_FRAME_REQUEST);
+  g_assert_cmpuint(frames[0].requestId, ==, 1);
+  g_assert_cmpuint(frames[0].code, ==, 42);
+  g_assert_cmpstr(frames[0].payload.c_str(), ==, "hello");
+
+  g_assert_cmpuint(frames[1].type, ==, RPC_FRAME_RESPONSE);
+  g_assert_true(frames[1].payload.empty());
+
+  g_assert_cmpuint(frames[2].type, ==, RPC_FRAME_ERROR);
+  g_assert_cmpuint(frames[2].requestId, ==, G_MAXUINT64);
+  g_assert_cmpuint(frames[2].code, ==, G_MAXUINT32);
+  g_assert_true(frames[2].payload == std::string("\0\1\2", 3));
+}
+
+static void test_compressed_round_trip()
+{
+  std::string payload(16 * 1024, 'a');
+  std::string message;
+  RpcCodec::encode(createFrame(RPC_FRAME_RESPONSE, 7, 0, payload), message, 1024);
+
+  g_assert_true(((guint8) message[0] & RPC_FRAME_FLAG_COMPRESSED) != 0);
+  g_assert_cmpuint(message.size(), <, payload.size());
+
+  std::vector<RpcFrame> frames;
+  g_assert_true(decode(message, frames));
+  g_assert_cmpuint(frames.size(), ==, 1);
+  g_assert_cmpuint(frames[0].type, ==, RPC_FRAME_RESPONSE);
+  g_assert_true(frames[0].payload == payload);
+}
+
+// 閾値より小さい場合と、圧縮しても小さくならない場合はそのまま送る
+static void test_compress_threshold()
+{
+  std::string message;
+  RpcCodec::encode(createFrame(RPC_FRAME_REQUEST, 1, 1, std::string(512, 'a')), message, 1024);
+  g_assert_true(((guint8) message[0] & RPC_FRAME_FLAG_COMPRESSED) == 0);
+
+  std::string random;
+  for (int i = 0; i < 4096; i++) {
+    random.push_back((char) g_random_int());
+  }
+  message.clear();
+  RpcCodec::encode(createFrame(RPC_FRAME_REQUEST, 1, 1, random), message, 1024);
+  g_assert_true(((guint8) message[0] & RPC_FRAME_FLAG_COMPRESSED) == 0);
+}
+
+static void test_truncated()
+{
+  std::string message;
+  RpcCodec::encode(createFrame(RPC_FRAME_REQUEST, 300, 1, "hello"), message);
+
+  // 途中で切れたメッセージは全て失敗する
+  for (size_t size = 1; size < message.size(); size++) {
+    std::vector<RpcFrame> frames;
+    g_assert_false(decode(message.substr(0, size), frames));
+  }
+}
+
+static void test_code_overflow()
+{
+  std::string message;
+  message.push_back((char) RPC_FRAME_REQUEST);
+  RpcCodec::writeVarint(message, 1);
+  RpcCodec::writeVarint(message, (guint64) G_MAXUINT32 + 1);
+  RpcCodec::writeVarint(message, 0);
+
+  std::vector<RpcFrame> frames;
+  g_assert_false(decode(message, frames));
+}
+
+static void test_payload_limit()
+{
+  // 長さだけを大きくしたヘッダは、データを読む前に拒否する
+  std::string header;
+  header.push_back((char) RPC_FRAME_REQUEST);
+  RpcCodec::writeVarint(header, 1);
+  RpcCodec::writeVarint(header, 1);
+  RpcCodec::writeVarint(header, RPC_MAX_PAYLOAD_SIZE + 1);
+
+  std::vector<RpcFrame> frames;
+  g_assert_false(decode(header, frames));
+
+  std::string message;
+  RpcCodec::encode(createFrame(RPC_FRAME_REQUEST, 1, 1, std::string(RPC_MAX_PAYLOAD_SIZE + 1, 'a')), message);
+  frames.clear();
+  g_assert_false(decode(message, frames));
+
+  // 圧縮後は小さくても、展開後が上限を超える場合は拒否する
+  message.clear();
+  RpcCodec::encode(createFrame(RPC_FRAME_REQUEST, 1, 1, std::string(2 * RPC_MAX_PAYLOAD_SIZE, 'a')), message, 1024);
+  g_assert_true(((guint8) message[0] & RPC_FRAME_FLAG_COMPRESSED) != 0);
+  g_assert_cmpuint(message.size(), <, RPC_MAX_PAYLOAD_SIZE);
+  frames.clear();
+  g_assert_false(decode(message, frames));
+}
+
+static void test_message_limit()
+{
+  // 1 フレームは上限以内でも、展開後の合計が RPC_MAX_MESSAGE_SIZE を超えるメッセージは拒否する
+  std::string payload(LARGE_PAYLOAD_SIZE, 'a');
+  guint count = RPC_MAX_MESSAGE_SIZE / LARGE_PAYLOAD_SIZE;
+
+  for (gsize threshold = 0; threshold <= 1024; threshold += 1024) {
+    std::string message;
+    for (guint i = 0; i < count; i++) {
+      RpcCodec::encode(createFrame(RPC_FRAME_REQUEST, i, 1, payload), message, threshold);
+    }
+
+    std::vector<RpcFrame> frames;
+    g_assert_true(decode(message, frames));
+    g_assert_cmpuint(frames.size(), ==, count);
+
+    RpcCodec::encode(createFrame(RPC_FRAME_REQUEST, count, 1, payload), message, threshold);
+    frames.clear();
+    g_assert_false(decode(message, frames));
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  g_test_init(&argc, &argv, NULL);
+
+  g_test_add_func("/rpc-codec/varint", test_varint);
+  g_test_add_func("/rpc-codec/round-trip", test_round_trip);
+  g_test_add_func("/rpc-codec/compressed-round-trip", test_compressed_round_trip);
+  g_test_add_func("/rpc-codec/compress-threshold", test_compress_threshold);
+  g_test_add_func("/rpc-codec/truncated", test_truncated);
+  g_test_add_func("/rpc-codec/code-overflow", test_code_overflow);
+  g_test_add_func("/rpc-codec/payload-limit", test_payload_limit);
+  g_test_add_func("/rpc-codec/message-limit", test_message_limit);
+
+  return g_test_run();
+}
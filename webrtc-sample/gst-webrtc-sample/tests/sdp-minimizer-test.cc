@@ -0,0 +1,128 @@
+#include "gst-sdp-minimizer.h"
+
+#include <string.h>
+
+// 映像は VP8 だけを使い、音声は使わない (inactive) offer
+static const gchar *OFFER =
+  "v=0\r\n"
+  "o=- 1234 0 IN IP4 0.0.0.0\r\n"
+  "s=-\r\n"
+  "t=0 0\r\n"
+  "a=group:BUNDLE video0 audio1\r\n"
+  "m=video 9 UDP/TLS/RTP/SAVPF 96\r\n"
+  "c=IN IP4 0.0.0.0\r\n"
+  "a=mid:video0\r\n"
+  "a=sendonly\r\n"
+  "a=rtpmap:96 VP8/90000\r\n"
+  "a=rtcp-fb:96 nack pli\r\n"
+  "a=rtpmap:97 H264/90000\r\n"
+  "a=fmtp:97 profile-level-id=42e01f\r\n"
+  "a=rtcp-fb:97 nack pli\r\n"
+  "a=rtcp-fb:* transport-cc\r\n"
+  "a=extmap:1 urn:ietf:params:rtp-hdrext:sdes:mid\r\n"
+  "a=extmap:2 http://www.webrtc.org/experiments/rtp-hdrext/abs-send-time\r\n"
+  "a=extmap:3 http://www.ietf.org/id/draft-holmer-rmcat-transport-wide-cc-extensions-01\r\n"
+  "a=ssrc:1111 cname:video\r\n"
+  "m=audio 0 UDP/TLS/RTP/SAVPF 111 0\r\n"
+  "c=IN IP4 0.0.0.0\r\n"
+  "a=mid:audio1\r\n"
+  "a=inactive\r\n"
+  "a=rtpmap:111 OPUS/48000/2\r\n"
+  "a=fmtp:111 minptime=10\r\n"
+  "a=rtpmap:0 PCMU/8000\r\n"
+  "a=extmap:1 urn:ietf:params:rtp-hdrext:sdes:mid\r\n"
+  "a=ssrc:2222 cname:audio\r\n";
+
+static GstSDPMessage *parse(const gchar *text)
+{
+  GstSDPMessage *sdp = NULL;
+  g_assert_cmpint(gst_sdp_message_new(&sdp), ==, GST_SDP_OK);
+  g_assert_cmpint(gst_sdp_message_parse_buffer((const guint8 *) text, strlen(text), sdp), ==, GST_SDP_OK);
+  return sdp;
+}
+
+static bool contains(const gchar *text, const gchar *line)
+{
+  return strstr(text, line) != NULL;
+}
+
+static void test_minimize()
+{
+  GstSDPMessage *sdp = parse(OFFER);
+  gchar *text = SdpMinimizer::minimize(sdp);
+  g_assert_nonnull(text);
+  g_assert_cmpuint(strlen(text), <, strlen(OFFER));
+
+  // 使うペイロードタイプと、mid と transport-cc の拡張は残す
+  g_assert_true(contains(text, "a=mid:video0\r\n"));
+  g_assert_true(contains(text, "a=rtpmap:96 VP8/90000\r\n"));
+  g_assert_true(contains(text, "a=rtcp-fb:96 nack pli\r\n"));
+  g_assert_true(contains(text, "a=rtcp-fb:* transport-cc\r\n"));
+  g_assert_true(contains(text, "a=extmap:1 urn:ietf:params:rtp-hdrext:sdes:mid\r\n"));
+  g_assert_true(contains(text, "transport-wide-cc-extensions-01\r\n"));
+  g_assert_true(contains(text, "a=ssrc:1111 cname:video\r\n"));
+
+  // m-line にないペイロードタイプと、使わない拡張は削除する
+  g_assert_false(contains(text, "H264"));
+  g_assert_false(contains(text, "a=fmtp:97"));
+  g_assert_false(contains(text, "a=rtcp-fb:97"));
+  g_assert_false(contains(text, "abs-send-time"));
+
+  // inactive の m-line はフォーマットを 1 つにして、送信用の記述を削除する
+  g_assert_true(contains(text, "m=audio 0 UDP/TLS/RTP/SAVPF 111\r\n"));
+  g_assert_true(contains(text, "a=mid:audio1\r\n"));
+  g_assert_true(contains(text, "a=inactive\r\n"));
+  g_assert_true(contains(text, "a=rtpmap:111 OPUS/48000/2\r\n"));
+  g_assert_false(contains(text, "PCMU"));
+  g_assert_false(contains(text, "a=fmtp:111"));
+  g_assert_false(contains(text, "a=ssrc:2222"));
+
+  // 削減した SDP も解析できる
+  GstSDPMessage *minimized = parse(text);
+  g_assert_cmpuint(gst_sdp_message_medias_len(minimized), ==, 2);
+  gst_sdp_message_free(minimized);
+  g_free(text);
+
+  // 元の SDP は変更しない
+  text = gst_sdp_message_as_text(sdp);
+  g_assert_true(contains(text, "a=rtpmap:97 H264/90000\r\n"));
+  g_assert_true(contains(text, "a=ssrc:2222 cname:audio\r\n"));
+  g_free(text);
+
+  gst_sdp_message_free(sdp);
+}
+
+static void test_compact_candidate()
+{
+  std::string out;
+
+  SdpMinimizer::compactCandidate(
+      "candidate:1 1 UDP 2015363327 192.168.1.2 50000 typ host generation 0 ufrag abcd network-id 1 network-cost 10", out);
+  g_assert_cmpstr(out.c_str(), ==, "candidate:1 1 UDP 2015363327 192.168.1.2 50000 typ host");
+
+  SdpMinimizer::compactCandidate(
+      "candidate:2 1 UDP 1679819007 203.0.113.5 50000 typ srflx raddr 192.168.1.2 rport 50000 generation 0", out);
+  g_assert_cmpstr(out.c_str(), ==, "candidate:2 1 UDP 1679819007 203.0.113.5 50000 typ srflx");
+
+  // TCP の候補の種類は接続に必要なので残す
+  SdpMinimizer::compactCandidate(
+      "candidate:3 1 TCP 1015022079 192.168.1.2 9 typ host tcptype active generation 0", out);
+  g_assert_cmpstr(out.c_str(), ==, "candidate:3 1 TCP 1015022079 192.168.1.2 9 typ host tcptype active");
+
+  // 省略できる属性がない場合はそのまま
+  SdpMinimizer::compactCandidate("candidate:1 1 UDP 2015363327 192.168.1.2 50000 typ host", out);
+  g_assert_cmpstr(out.c_str(), ==, "candidate:1 1 UDP 2015363327 192.168.1.2 50000 typ host");
+
+  SdpMinimizer::compactCandidate("", out);
+  g_assert_cmpstr(out.c_str(), ==, "");
+}
+
+int main(int argc, char *argv[])
+{
+  g_test_init(&argc, &argv, NULL);
+
+  g_test_add_func("/sdp-minimizer/minimize", test_minimize);
+  g_test_add_func("/sdp-minimizer/compact-candidate", test_compact_candidate);
+
+  return g_test_run();
+}
@@ -0,0 +1,61 @@
+#include "gst-signaling-envelope.h"
+#include <glib.h>
+
+static void test_round_trip()
+{
+  // ペイロードは JSON の文字列として入るので、引用符や改行もそのまま戻る
+  std::string message("{\"type\":\"sdp\",\"data\":{\"sdp\":\"v=0\\r\\n\"}}");
+  std::string text;
+  g_assert_true(SignalingEnvelope::wrap("to", "conn_1", message, text));
+
+  std::string peerId;
+  std::string payload;
+  g_assert_true(SignalingEnvelope::unwrap("to", text, peerId, payload));
+  g_assert_cmpstr(peerId.c_str(), ==, "conn_1");
+  g_assert_cmpstr(payload.c_str(), ==, message.c_str());
+}
+
+// 送信用の封筒 (to) を受信用のキー (from) で開くことはできない
+static void test_key_mismatch()
+{
+  std::string text;
+  g_assert_true(SignalingEnvelope::wrap("to", "conn_1", "playerConnected", text));
+
+  std::string peerId;
+  std::string payload;
+  g_assert_false(SignalingEnvelope::unwrap("from", text, peerId, payload));
+}
+
+static void test_malformed()
+{
+  const char *messages[] = {
+    "",
+    "playerConnected",
+    "{",
+    "[\"conn_1\"]",
+    "{\"from\":\"conn_1\"}",
+    "{\"payload\":\"playerConnected\"}",
+    "{\"from\":1,\"payload\":\"playerConnected\"}",
+    "{\"from\":\"conn_1\",\"payload\":{\"type\":\"sdp\"}}",
+    "{\"from\":null,\"payload\":\"playerConnected\"}",
+  };
+
+  for (size_t i = 0; i < G_N_ELEMENTS(messages); i++) {
+    std::string peerId;
+    std::string payload;
+    if (SignalingEnvelope::unwrap("from", messages[i], peerId, payload)) {
+      g_error("Unwrapped malformed envelope %s", messages[i]);
+    }
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  g_test_init(&argc, &argv, NULL);
+
+  g_test_add_func("/signaling-envelope/round-trip", test_round_trip);
+  g_test_add_func("/signaling-envelope/key-mismatch", test_key_mismatch);
+  g_test_add_func("/signaling-envelope/malformed", test_malformed);
+
+  return g_test_run();
+}
@@ -0,0 +1,78 @@
+#include "gst-signaling-message.h"
+
+#define SDP_TEXT "v=0\r\no=- 1 0 IN IP4 0.0.0.0\r\ns=-\r\nt=0 0\r\n"
+#define CANDIDATE_TEXT "candidate:1 1 UDP 2015363327 192.168.1.2 50000 typ host"
+
+static void test_sdp_round_trip()
+{
+  std::string text;
+  g_assert_true(SignalingMessage::encodeSdp("offer", SDP_TEXT, text));
+
+  SignalingPayload payload;
+  g_assert_true(SignalingMessage::decode(text, payload));
+  g_assert_cmpstr(payload.type.c_str(), ==, "sdp");
+  g_assert_cmpstr(payload.sdpType.c_str(), ==, "offer");
+  g_assert_cmpstr(payload.sdp.c_str(), ==, SDP_TEXT);
+}
+
+static void test_ice_round_trip()
+{
+  std::string text;
+  g_assert_true(SignalingMessage::encodeIce(1, CANDIDATE_TEXT, text));
+
+  SignalingPayload payload;
+  g_assert_true(SignalingMessage::decode(text, payload));
+  g_assert_cmpstr(payload.type.c_str(), ==, "ice");
+  g_assert_cmpuint(payload.sdpMLineIndex, ==, 1);
+  g_assert_cmpstr(payload.candidate.c_str(), ==, CANDIDATE_TEXT);
+}
+
+// 種類だけ返して、SDP と ICE 以外の処理は呼び出し側に任せる
+static void test_unknown_type()
+{
+  SignalingPayload payload;
+  g_assert_true(SignalingMessage::decode("{\"type\":\"bye\",\"data\":{}}", payload));
+  g_assert_cmpstr(payload.type.c_str(), ==, "bye");
+}
+
+static void test_malformed()
+{
+  const char *messages[] = {
+    "",
+    "playerConnected",
+    "{",
+    "{\"type\":\"sdp\"",
+    "[{\"type\":\"sdp\"}]",
+    "{\"type\":\"sdp\"}",
+    "{\"data\":{}}",
+    "{\"type\":1,\"data\":{}}",
+    "{\"type\":\"sdp\",\"data\":\"offer\"}",
+    "{\"type\":\"sdp\",\"data\":{\"type\":\"offer\"}}",
+    "{\"type\":\"sdp\",\"data\":{\"sdp\":\"v=0\"}}",
+    "{\"type\":\"sdp\",\"data\":{\"type\":\"offer\",\"sdp\":{}}}",
+    "{\"type\":\"ice\",\"data\":{\"candidate\":\"" CANDIDATE_TEXT "\"}}",
+    "{\"type\":\"ice\",\"data\":{\"sdpMLineIndex\":0}}",
+    "{\"type\":\"ice\",\"data\":{\"candidate\":\"" CANDIDATE_TEXT "\",\"sdpMLineIndex\":\"0\"}}",
+    "{\"type\":\"ice\",\"data\":{\"candidate\":\"" CANDIDATE_TEXT "\",\"sdpMLineIndex\":-1}}",
+    "{\"type\":\"ice\",\"data\":{\"candidate\":null,\"sdpMLineIndex\":0}}",
+  };
+
+  for (size_t i = 0; i < G_N_ELEMENTS(messages); i++) {
+    SignalingPayload payload;
+    if (SignalingMessage::decode(messages[i], payload)) {
+      g_error("Decoded malformed message %s", messages[i]);
+    }
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  g_test_init(&argc, &argv, NULL);
+
+  g_test_add_func("/signaling-message/sdp-round-trip", test_sdp_round_trip);
+  g_test_add_func("/signaling-message/ice-round-trip", test_ice_round_trip);
+  g_test_add_func("/signaling-message/unknown-type", test_unknown_type);
+  g_test_add_func("/signaling-message/malformed", test_malformed);
+
+  return g_test_run();
+}